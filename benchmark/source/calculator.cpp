@@ -0,0 +1,165 @@
+#include <benchmark/benchmark.h>
+#include <peg_parser/generator.h>
+#include <peg_parser/static_grammar.h>
+
+#include <string>
+
+using namespace peg_parser;
+
+namespace {
+
+  std::string createExpression(size_t terms) {
+    std::string expression;
+    for (size_t i = 0; i < terms; ++i) {
+      expression += i > 0 ? (i % 3 == 0 ? " + " : " * ") : "";
+      expression += i % 5 == 0 ? "(1.5 - " + std::to_string(i) + ")" : std::to_string(i);
+    }
+    return expression;
+  }
+
+  // clang-format off
+  void setupCalculator(ParserGenerator<float> &g) {
+    g.setSeparator(g["Whitespace"] << "[\t ]");
+    g["Sum"] << "Add | Subtract | Product";
+    g["Product"] << "Multiply | Divide | Atomic";
+    g["Atomic"] << "Number | '(' Sum ')'";
+    g["Add"] << "Sum '+' Product" >> [](auto e) { return e[0].evaluate() + e[1].evaluate(); };
+    g["Subtract"] << "Sum '-' Product" >> [](auto e) { return e[0].evaluate() - e[1].evaluate(); };
+    g["Multiply"] << "Product '*' Atomic" >> [](auto e) { return e[0].evaluate() * e[1].evaluate(); };
+    g["Divide"] << "Product '/' Atomic" >> [](auto e) { return e[0].evaluate() / e[1].evaluate(); };
+    g["Number"] << "'-'? [0-9]+ ('.' [0-9]+)?" >> [](auto e) { return e.template number<float>(); };
+    g.setStart(g["Sum"]);
+  }
+
+  void setupPrecedenceCalculator(ParserGenerator<float> &g) {
+    g.setSeparator(g["Whitespace"] << "[\t ]");
+    g["Sum"] << "{Atomic; left: Add '+', Subtract '-'; left: Multiply '*', Divide '/'}";
+    g["Atomic"] << "Number | '(' Sum ')'";
+    g["Add"] >> [](auto e) { return e[0].evaluate() + e[1].evaluate(); };
+    g["Subtract"] >> [](auto e) { return e[0].evaluate() - e[1].evaluate(); };
+    g["Multiply"] >> [](auto e) { return e[0].evaluate() * e[1].evaluate(); };
+    g["Divide"] >> [](auto e) { return e[0].evaluate() / e[1].evaluate(); };
+    g["Number"] << "'-'? [0-9]+ ('.' [0-9]+)?" >> [](auto e) { return e.template number<float>(); };
+    g.setStart(g["Sum"]);
+  }
+  // clang-format on
+
+  namespace static_calculator {
+    using namespace static_grammar;
+
+    struct Whitespace : Rule<Whitespace, Choice<Char<' '>, Char<'\t'>>> {
+      static constexpr auto name = "Whitespace";
+      static constexpr bool hidden = true;
+    };
+
+    template <class R> using Token
+        = Sequence<ZeroOrMore<Ref<Whitespace>>, Ref<R>, ZeroOrMore<Ref<Whitespace>>>;
+
+    struct Sum;
+    struct Product;
+    struct Atomic;
+
+    struct Number
+        : Rule<Number, Sequence<Optional<Char<'-'>>, OneOrMore<Range<'0', '9'>>,
+                                Optional<Sequence<Char<'.'>, OneOrMore<Range<'0', '9'>>>>>> {
+      static constexpr auto name = "Number";
+    };
+
+    struct Add : Rule<Add, Sequence<Token<Sum>, Char<'+'>, Token<Product>>> {
+      static constexpr auto name = "Add";
+    };
+
+    struct Subtract : Rule<Subtract, Sequence<Token<Sum>, Char<'-'>, Token<Product>>> {
+      static constexpr auto name = "Subtract";
+    };
+
+    struct Multiply : Rule<Multiply, Sequence<Token<Product>, Char<'*'>, Token<Atomic>>> {
+      static constexpr auto name = "Multiply";
+    };
+
+    struct Divide : Rule<Divide, Sequence<Token<Product>, Char<'/'>, Token<Atomic>>> {
+      static constexpr auto name = "Divide";
+    };
+
+    struct Atomic
+        : Rule<Atomic, Choice<Token<Number>, Sequence<Char<'('>, Token<Sum>, Char<')'>>>> {
+      static constexpr auto name = "Atomic";
+    };
+
+    struct Product : Rule<Product, Choice<Token<Multiply>, Token<Divide>, Token<Atomic>>> {
+      static constexpr auto name = "Product";
+      static constexpr bool leftRecursive = true;
+    };
+
+    struct Sum : Rule<Sum, Choice<Token<Add>, Token<Subtract>, Token<Product>>> {
+      static constexpr auto name = "Sum";
+      static constexpr bool leftRecursive = true;
+    };
+
+    void setup(static_grammar::Program<Sum, float> &program) {
+      program.setEvaluator<Add>([](auto e) { return e[0].evaluate() + e[1].evaluate(); });
+      program.setEvaluator<Subtract>([](auto e) { return e[0].evaluate() - e[1].evaluate(); });
+      program.setEvaluator<Multiply>([](auto e) { return e[0].evaluate() * e[1].evaluate(); });
+      program.setEvaluator<Divide>([](auto e) { return e[0].evaluate() / e[1].evaluate(); });
+      program.setEvaluator<Number>([](auto e) { return e.template number<float>(); });
+    }
+  }  // namespace static_calculator
+
+}  // namespace
+
+static void DynamicCalculator(benchmark::State &state) {
+  ParserGenerator<float> calculator;
+  setupCalculator(calculator);
+  auto input = createExpression(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(calculator.run(input));
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(input.size()));
+}
+BENCHMARK(DynamicCalculator)->Range(8, 512);
+
+static void OptimizedCalculator(benchmark::State &state) {
+  ParserGenerator<float> calculator;
+  setupCalculator(calculator);
+  calculator.optimize();
+  auto input = createExpression(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(calculator.run(input));
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(input.size()));
+}
+BENCHMARK(OptimizedCalculator)->Range(8, 512);
+
+static void ContextCalculator(benchmark::State &state) {
+  ParserGenerator<float> calculator;
+  setupCalculator(calculator);
+  Parser::Context context;
+  auto input = createExpression(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(calculator.run(input, context));
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(input.size()));
+}
+BENCHMARK(ContextCalculator)->Range(8, 512);
+
+static void PrecedenceCalculator(benchmark::State &state) {
+  ParserGenerator<float> calculator;
+  setupPrecedenceCalculator(calculator);
+  auto input = createExpression(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(calculator.run(input));
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(input.size()));
+}
+BENCHMARK(PrecedenceCalculator)->Range(8, 512);
+
+static void StaticCalculator(benchmark::State &state) {
+  static_grammar::Program<static_calculator::Sum, float> calculator;
+  static_calculator::setup(calculator);
+  auto input = createExpression(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(calculator.run(input));
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(input.size()));
+}
+BENCHMARK(StaticCalculator)->Range(8, 512);
@@ -0,0 +1,71 @@
+#include <benchmark/benchmark.h>
+#include <peg_parser/generator.h>
+
+#include <string>
+
+using namespace peg_parser;
+
+namespace {
+
+  void setupSum(ParserGenerator<int> &program) {
+    program.setSeparator(program["Whitespace"] << "[\t ]");
+    program["Number"] << "[0-9]+" >> [](auto e) { return e.template number<int>(); };
+    program["Product"] << "Number ('*' Number)*" >> [](auto e) {
+      int result = 1;
+      for (auto n : e) {
+        result *= n.evaluate();
+      }
+      return result;
+    };
+    program.setStart(program["Sum"] << "Product ('+' Product)*" >> [](auto e) {
+      int result = 0;
+      for (auto p : e) {
+        result += p.evaluate();
+      }
+      return result;
+    });
+  }
+
+  std::string createSum(size_t count) {
+    std::string sum;
+    for (size_t i = 0; i < count; ++i) {
+      sum += i > 0 ? " + " : "";
+      sum += std::to_string(i % 10) + " * " + std::to_string(i % 7);
+    }
+    return sum;
+  }
+
+  size_t syntaxTreeMemoryUsage(const SyntaxTree &tree) {
+    // shared_ptr control block and object are allocated together by make_shared
+    auto usage = sizeof(SyntaxTree) + 2 * sizeof(void *) + tree.inner.capacity() * sizeof(tree.inner[0]);
+    for (auto &inner : tree.inner) {
+      usage += syntaxTreeMemoryUsage(*inner);
+    }
+    return usage;
+  }
+
+}  // namespace
+
+static void EvaluateSyntaxTree(benchmark::State &state) {
+  ParserGenerator<int> program;
+  setupSum(program);
+  auto input = createSum(state.range(0));
+  auto tree = program.parse(input);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(program.interpreter.evaluate(tree));
+  }
+  state.counters["bytes_per_tree"] = double(syntaxTreeMemoryUsage(*tree));
+}
+BENCHMARK(EvaluateSyntaxTree)->Range(8, 4096);
+
+static void EvaluateCompactSyntaxTree(benchmark::State &state) {
+  ParserGenerator<int> program;
+  setupSum(program);
+  auto input = createSum(state.range(0));
+  CompactSyntaxTree tree(*program.parse(input));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(program.interpreter.evaluate(tree));
+  }
+  state.counters["bytes_per_tree"] = double(tree.memoryUsage());
+}
+BENCHMARK(EvaluateCompactSyntaxTree)->Range(8, 4096);
@@ -0,0 +1,57 @@
+#include <benchmark/benchmark.h>
+#include <peg_parser/generator.h>
+
+#include <string>
+
+using namespace peg_parser;
+
+namespace {
+
+  struct EventCounter : Parser::EventHandler {
+    size_t count = 0;
+    void enter(const grammar::Rule &, size_t) override { ++count; }
+    void exit(const grammar::Rule &, size_t, size_t) override {}
+  };
+
+  void setupLines(ParserGenerator<> &program) {
+    program.setSeparator(program["Whitespace"] << "[\t ]");
+    program["Number"] << "[0-9]+";
+    program["Atomic"] << "Number | '(' Sum ')'";
+    program["Product"] << "Product '*' Atomic | Atomic";
+    program["Sum"] << "Sum '+' Product | Product";
+    program["Line"] << "Sum '\n'";
+    program.setStart(program["Lines"] << "Line*");
+  }
+
+  std::string createLines(size_t count) {
+    std::string lines;
+    for (size_t i = 0; i < count; ++i) {
+      lines += std::to_string(i) + " + 2 * (3 + " + std::to_string(i % 7) + ")\n";
+    }
+    return lines;
+  }
+
+}  // namespace
+
+static void ParseLines(benchmark::State &state) {
+  ParserGenerator<> program;
+  setupLines(program);
+  auto input = createLines(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(program.parser.parse(input));
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(input.size()));
+}
+BENCHMARK(ParseLines)->Range(8, 128);
+
+static void ParseLineEvents(benchmark::State &state) {
+  ParserGenerator<> program;
+  setupLines(program);
+  auto input = createLines(state.range(0));
+  for (auto _ : state) {
+    EventCounter counter;
+    benchmark::DoNotOptimize(program.parser.parse(input, counter));
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(input.size()));
+}
+BENCHMARK(ParseLineEvents)->Range(8, 128);
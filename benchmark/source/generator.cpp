@@ -0,0 +1,22 @@
+#include <benchmark/benchmark.h>
+#include <peg_parser/generator.h>
+
+using namespace peg_parser;
+
+static void CreateCalculatorGenerator(benchmark::State &state) {
+  for (auto _ : state) {
+    ParserGenerator<float> g;
+    g.setSeparator(g["Whitespace"] << "[\t ]");
+    g["Sum"] << "Add | Subtract | Product";
+    g["Product"] << "Multiply | Divide | Atomic";
+    g["Atomic"] << "Number | '(' Sum ')'";
+    g["Add"] << "Sum '+' Product";
+    g["Subtract"] << "Sum '-' Product";
+    g["Multiply"] << "Product '*' Atomic";
+    g["Divide"] << "Product '/' Atomic";
+    g["Number"] << "'-'? [0-9]+ ('.' [0-9]+)?";
+    g.setStart(g["Sum"]);
+    benchmark::DoNotOptimize(g.parser.grammar);
+  }
+}
+BENCHMARK(CreateCalculatorGenerator);
@@ -0,0 +1,33 @@
+#include <benchmark/benchmark.h>
+#include <peg_parser/generator.h>
+
+#include <string>
+
+using namespace peg_parser;
+
+namespace {
+
+  std::string createNestedExpression(size_t depth) {
+    return std::string(depth, '(') + "1" + std::string(depth, ')');
+  }
+
+}  // namespace
+
+static void ParseDeeplyNested(benchmark::State &state) {
+  ParserGenerator<float> program;
+  program.setSeparator(program["Whitespace"] << "[\t ]");
+  program["Sum"] << "Sum '+' Product | Product";
+  program["Product"] << "Product '*' Atomic | Atomic";
+  program["Atomic"] << "'(' Sum ')' | [0-9]+";
+  program.setStart(program["Sum"]);
+  program.parser.limits.depth = 4 * size_t(state.range(0)) + 16;
+  auto input = createNestedExpression(state.range(0));
+  for (auto _ : state) {
+    auto tree = program.parser.parse(input);
+    if (!tree->valid) {
+      state.SkipWithError("deeply nested expression not parsed");
+    }
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(input.size()));
+}
+BENCHMARK(ParseDeeplyNested)->Range(1 << 6, 1 << 16);
@@ -0,0 +1,60 @@
+#include <benchmark/benchmark.h>
+#include <peg_parser/generator.h>
+
+#include <cstdio>
+#include <string>
+
+using namespace peg_parser;
+
+namespace {
+
+  /** Creates a CSV-like row of `count` numbers formatted by `format` */
+  std::string createNumberRow(size_t count, const char *format) {
+    std::string row;
+    char buffer[32];
+    for (size_t i = 0; i < count; ++i) {
+      auto length = std::snprintf(buffer, sizeof(buffer), format, int(i * 7919 % 100000));
+      row += (i > 0 ? "," : "") + std::string(buffer, length);
+    }
+    return row;
+  }
+
+  template <class T, class P>
+  void benchmarkNumberRow(benchmark::State &state, P subprogram, const char *format) {
+    ParserGenerator<T> program;
+    program.setProgramRule("Number", subprogram);
+    program.setStart(program.setRule("Row", "Number (',' Number)*", [](auto e) {
+      T sum = 0;
+      for (auto n : e) {
+        sum += n.evaluate();
+      }
+      return sum;
+    }));
+    auto input = createNumberRow(state.range(0), format);
+    for (auto _ : state) {
+      benchmark::DoNotOptimize(program.run(input));
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(input.size()));
+  }
+
+}  // namespace
+
+static void IntegerRow(benchmark::State &state) {
+  benchmarkNumberRow<int>(state, presets::createIntegerProgram(), "%d");
+}
+BENCHMARK(IntegerRow)->Range(8, 4096);
+
+static void FloatRow(benchmark::State &state) {
+  benchmarkNumberRow<float>(state, presets::createFloatProgram(), "-%d.25e-1");
+}
+BENCHMARK(FloatRow)->Range(8, 4096);
+
+static void DoubleRow(benchmark::State &state) {
+  benchmarkNumberRow<double>(state, presets::createDoubleProgram(), "%d.125");
+}
+BENCHMARK(DoubleRow)->Range(8, 4096);
+
+static void HexRow(benchmark::State &state) {
+  benchmarkNumberRow<int>(state, presets::createHexProgram(), "%x");
+}
+BENCHMARK(HexRow)->Range(8, 4096);
@@ -0,0 +1,109 @@
+#include <benchmark/benchmark.h>
+#include <peg_parser/generator.h>
+
+#include <string>
+
+using namespace peg_parser;
+
+namespace {
+
+  void setupDocument(ParserGenerator<> &program) {
+    program.setSeparator(program["Whitespace"] << "[\t ]");
+    program.setStart(program["Document"] << "Statement*");
+    program["Statement"] << "(Name '=' Sum)? '\n'";
+    program["Sum"] << "Sum '+' Atomic | Atomic";
+    program["Atomic"] << "Name | Number | '(' Sum ')'";
+    program["Name"] << "[a-z] [a-z0-9]*";
+    program["Number"] << "[0-9]+";
+  }
+
+  std::string createDocument(size_t lines) {
+    std::string document;
+    for (size_t i = 0; i < lines; ++i) {
+      document += "x" + std::to_string(i) + " = (x" + std::to_string(i / 2) + " + 17) + "
+                  + std::to_string(i) + "\n";
+    }
+    return document;
+  }
+
+  /** Sums of a costly series per number, to evaluate items of the same size concurrently */
+  void setupSeries(ParserGenerator<double> &program) {
+    program.setSeparator(program["Whitespace"] << "[\t ]");
+    program.setStart(program["List"] << "Series (',' Series)*");
+    program["Series"] << "[0-9]+" >> [](auto e) {
+      double sum = 0;
+      for (auto i = e.template number<int>(); i > 0; --i) {
+        sum += 1.0 / (double(i) * double(i));
+      }
+      return sum;
+    };
+    program.setEvaluator("List", [](auto e) {
+      double sum = 0;
+      for (auto series : e) {
+        sum += series.evaluate();
+      }
+      return sum;
+    });
+  }
+
+  std::string createSeries(size_t count) {
+    std::string list;
+    for (size_t i = 0; i < count; ++i) {
+      list += i > 0 ? ", 100000" : "100000";
+    }
+    return list;
+  }
+
+}  // namespace
+
+static void ParseDocument(benchmark::State &state) {
+  ParserGenerator<> program;
+  setupDocument(program);
+  auto input = createDocument(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(program.parser.parse(input));
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(input.size()));
+}
+BENCHMARK(ParseDocument)->Range(1 << 8, 1 << 12)->UseRealTime();
+
+static void ParseDocumentInParallel(benchmark::State &state) {
+  ParserGenerator<> program;
+  setupDocument(program);
+  Parser::Chunking chunking;
+  chunking.boundary = program.parseRule("'\n'");
+  chunking.threads = size_t(state.range(1));
+  auto input = createDocument(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(program.parser.parseParallel(input, chunking));
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(input.size()));
+}
+BENCHMARK(ParseDocumentInParallel)
+    ->Ranges({{1 << 8, 1 << 12}, {1, 4}})
+    ->UseRealTime();
+
+static void EvaluateSeries(benchmark::State &state) {
+  ParserGenerator<double> program;
+  setupSeries(program);
+  auto input = createSeries(state.range(0));
+  auto tree = program.parse(input);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(program.interpret(tree).evaluate());
+  }
+}
+BENCHMARK(EvaluateSeries)->Arg(64)->UseRealTime();
+
+static void EvaluateSeriesInParallel(benchmark::State &state) {
+  ParserGenerator<double> program;
+  setupSeries(program);
+  program.setPure("Series");
+  program.setParallel("List");
+  program.interpreter.minParallelLength = 0;
+  auto input = createSeries(state.range(0));
+  auto tree = program.parse(input);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(program.interpret(tree).evaluate());
+  }
+}
+BENCHMARK(EvaluateSeriesInParallel)->Arg(64)->UseRealTime();
@@ -0,0 +1,124 @@
+#include <benchmark/benchmark.h>
+#include <peg_parser/generator.h>
+
+#include <string>
+
+using namespace peg_parser;
+
+namespace {
+
+  void setupExpression(ParserGenerator<> &program) {
+    program.setSeparator(program["Whitespace"] << "[\t ]");
+    program["Number"] << "[0-9]+";
+    program["Atomic"] << "Number | '(' Sum ')'";
+    program["Product"] << "Product '*' Atomic | Atomic";
+    program.setStart(program["Sum"] << "Sum '+' Product | Product");
+  }
+
+  std::string createExpression(size_t count) {
+    std::string expression;
+    for (size_t i = 0; i < count; ++i) {
+      expression += i > 0 ? " + " : "";
+      expression += "(" + std::to_string(i) + " * 3 + 1) * " + std::to_string(i % 7);
+    }
+    return expression;
+  }
+
+  void setupTokenList(ParserGenerator<> &program) {
+    program.setSeparator(program["Whitespace"] << "[\t ]");
+    program["Identifier"] << "[a-zA-Z_] [a-zA-Z0-9_]*";
+    program["Number"] << "'-'? [0-9]+ ('.' [0-9]+)?";
+    program["Token"] << "Identifier | Number";
+    program.setStart(program["List"] << "Token (',' Token)*");
+  }
+
+  std::string createTokenList(size_t count) {
+    std::string list;
+    for (size_t i = 0; i < count; ++i) {
+      list += i > 0 ? ", " : "";
+      list += i % 2 ? "identifier_" + std::to_string(i) : "-" + std::to_string(i * 7919) + ".125";
+    }
+    return list;
+  }
+
+  enum class TokenMode { NODES, AUTOMATA, LEXER };
+
+  void benchmarkTokenList(benchmark::State &state, TokenMode mode) {
+    ParserGenerator<> program;
+    setupTokenList(program);
+    if (mode == TokenMode::AUTOMATA) {
+      grammar::compileAutomata(program.parser.grammar);
+    } else if (mode == TokenMode::LEXER) {
+      program.setTokens({"Identifier", "Number"});
+    }
+    auto input = createTokenList(state.range(0));
+    for (auto _ : state) {
+      benchmark::DoNotOptimize(program.parser.recognize(input));
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(input.size()));
+  }
+
+}  // namespace
+
+static void ParseExpression(benchmark::State &state) {
+  ParserGenerator<> program;
+  setupExpression(program);
+  auto input = createExpression(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(program.parser.parse(input));
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(input.size()));
+}
+BENCHMARK(ParseExpression)->Range(8, 512);
+
+static void ParseExpressionInSlices(benchmark::State &state) {
+  ParserGenerator<> program;
+  setupExpression(program);
+  auto input = createExpression(state.range(0));
+  for (auto _ : state) {
+    auto parse = program.parser.start(input);
+    while (!parse.resume(256)) {
+    }
+    benchmark::DoNotOptimize(parse.result());
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(input.size()));
+}
+BENCHMARK(ParseExpressionInSlices)->Range(8, 512);
+
+static void RecognizeExpression(benchmark::State &state) {
+  ParserGenerator<> program;
+  setupExpression(program);
+  auto input = createExpression(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(program.parser.recognize(input));
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(input.size()));
+}
+BENCHMARK(RecognizeExpression)->Range(8, 512);
+
+static void CaptureNumbers(benchmark::State &state) {
+  ParserGenerator<> program;
+  setupExpression(program);
+  auto captures = program.parser.createCaptures({program.getRule("Number")});
+  auto input = createExpression(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(program.parser.parse(input, captures));
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(input.size()));
+}
+BENCHMARK(CaptureNumbers)->Range(8, 512);
+
+static void RecognizeTokens(benchmark::State &state) {
+  benchmarkTokenList(state, TokenMode::NODES);
+}
+BENCHMARK(RecognizeTokens)->Range(8, 4096);
+
+static void RecognizeTokensWithAutomata(benchmark::State &state) {
+  benchmarkTokenList(state, TokenMode::AUTOMATA);
+}
+BENCHMARK(RecognizeTokensWithAutomata)->Range(8, 4096);
+
+static void RecognizeTokensWithLexer(benchmark::State &state) {
+  benchmarkTokenList(state, TokenMode::LEXER);
+}
+BENCHMARK(RecognizeTokensWithLexer)->Range(8, 4096);
@@ -0,0 +1,60 @@
+#include <benchmark/benchmark.h>
+#include <peg_parser/generator.h>
+
+#include <string>
+
+using namespace peg_parser;
+
+namespace {
+
+  /** Creates a config-like list of `count` quoted strings, every `escapeEvery`th one escaped */
+  std::string createStringList(size_t count, size_t escapeEvery) {
+    std::string list;
+    for (size_t i = 0; i < count; ++i) {
+      list += i > 0 ? ", " : "";
+      list += i % escapeEvery == 0 ? "'key\\t" : "'key ";
+      list += std::to_string(i) + " = some configuration value'";
+    }
+    return list;
+  }
+
+}  // namespace
+
+static void StringList(benchmark::State &state) {
+  ParserGenerator<size_t> program;
+  program.setProgramRule("String", presets::createStringProgram("'", "'"),
+                         [](auto e) { return e.evaluate().size(); });
+  program.setStart(program.setRule("List", "String (', ' String)*", [](auto e) {
+    size_t length = 0;
+    for (auto s : e) {
+      length += s.evaluate();
+    }
+    return length;
+  }));
+  auto input = createStringList(state.range(0), 8);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(program.run(input));
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(input.size()));
+}
+BENCHMARK(StringList)->Range(8, 1024);
+
+static void StringViewList(benchmark::State &state) {
+  ParserGenerator<size_t> program;
+  std::string buffer;
+  program.setProgramRule("String", presets::createStringViewProgram("'", "'"),
+                         [&buffer](auto e) { return e.evaluate(buffer).size(); });
+  program.setStart(program.setRule("List", "String (', ' String)*", [](auto e) {
+    size_t length = 0;
+    for (auto s : e) {
+      length += s.evaluate();
+    }
+    return length;
+  }));
+  auto input = createStringList(state.range(0), 8);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(program.run(input));
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(input.size()));
+}
+BENCHMARK(StringViewList)->Range(8, 1024);
@@ -0,0 +1,189 @@
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <string_view>
+
+#ifndef PEGPARSER_DECIMAL_H
+#define PEGPARSER_DECIMAL_H
+
+/**
+ * Fixed-point decimal number with six fractional digits stored in a 64 bit integer.
+ * Addition and subtraction are exact, multiplication and division round to the nearest
+ * representable value. Results out of range throw a `std::domain_error`.
+ */
+class Decimal {
+public:
+  static constexpr int digits = 6;
+  static constexpr int64_t scale = 1000000;
+
+  constexpr Decimal() = default;
+  constexpr explicit Decimal(long long integer) : raw(multiply(integer, scale)) {}
+  explicit Decimal(double value) : raw(roundToRaw(value * scale)) {}
+
+  static constexpr Decimal fromRaw(int64_t raw) {
+    Decimal result;
+    result.raw = raw;
+    return result;
+  }
+
+  /** Parses `-?[0-9]+(.[0-9]+)?` without allocating. Extra fractional digits are truncated. */
+  static Decimal parse(std::string_view str) {
+    bool negative = !str.empty() && str.front() == '-';
+    if (negative) {
+      str.remove_prefix(1);
+    }
+    auto dot = str.find('.');
+    auto integerPart = str.substr(0, dot);
+    if (integerPart.empty() || !isDigit(integerPart.front())) {
+      throw std::invalid_argument("invalid decimal number");
+    }
+    int64_t integer = 0;
+    auto [end, error] = std::from_chars(integerPart.begin(), integerPart.end(), integer);
+    if (error == std::errc::result_out_of_range) {
+      throw std::domain_error("decimal number out of range");
+    }
+    if (error != std::errc() || end != integerPart.end()) {
+      throw std::invalid_argument("invalid decimal number");
+    }
+    int64_t fraction = 0;
+    if (dot != std::string_view::npos) {
+      auto fractionPart = str.substr(dot + 1);
+      if (fractionPart.empty()) {
+        throw std::invalid_argument("invalid decimal number");
+      }
+      for (size_t i = 0; i < fractionPart.size(); ++i) {
+        if (!isDigit(fractionPart[i])) {
+          throw std::invalid_argument("invalid decimal number");
+        }
+        if (i < size_t(digits)) {
+          fraction = fraction * 10 + (fractionPart[i] - '0');
+        }
+      }
+      for (auto i = fractionPart.size(); i < size_t(digits); ++i) {
+        fraction *= 10;
+      }
+    }
+    auto raw = add(multiply(integer, scale), fraction);
+    return fromRaw(negative ? -raw : raw);
+  }
+
+  constexpr int64_t getRaw() const { return raw; }
+  explicit operator double() const { return double(raw) / scale; }
+
+  friend Decimal operator+(Decimal a, Decimal b) { return fromRaw(add(a.raw, b.raw)); }
+  friend Decimal operator-(Decimal a, Decimal b) { return fromRaw(subtract(a.raw, b.raw)); }
+  friend Decimal operator-(Decimal a) { return fromRaw(subtract(0, a.raw)); }
+
+  friend Decimal operator*(Decimal a, Decimal b) {
+    return fromRaw(roundedDivide(Wide(a.raw) * b.raw, scale));
+  }
+
+  friend Decimal operator/(Decimal a, Decimal b) {
+    if (b.raw == 0) {
+      throw std::domain_error("division by zero");
+    }
+    return fromRaw(roundedDivide(Wide(a.raw) * scale, b.raw));
+  }
+
+  friend bool operator==(Decimal a, Decimal b) { return a.raw == b.raw; }
+  friend bool operator!=(Decimal a, Decimal b) { return a.raw != b.raw; }
+
+  friend Decimal pow(Decimal a, Decimal b) {
+    return Decimal(std::pow(double(a), double(b)));
+  }
+  friend Decimal sin(Decimal a) { return Decimal(std::sin(double(a))); }
+  friend Decimal cos(Decimal a) { return Decimal(std::cos(double(a))); }
+
+  friend std::ostream &operator<<(std::ostream &stream, Decimal value) {
+    auto magnitude = value.raw < 0 ? -value.raw : value.raw;
+    auto fraction = magnitude % scale;
+    if (value.raw < 0) {
+      stream << '-';
+    }
+    stream << magnitude / scale;
+    if (fraction != 0) {
+      char buffer[digits];
+      for (int i = digits - 1; i >= 0; --i, fraction /= 10) {
+        buffer[i] = char('0' + fraction % 10);
+      }
+      auto length = digits;
+      while (buffer[length - 1] == '0') {
+        --length;
+      }
+      stream << '.' << std::string_view(buffer, length);
+    }
+    return stream;
+  }
+
+private:
+  static constexpr int64_t minRaw = std::numeric_limits<int64_t>::min();
+  static constexpr int64_t maxRaw = std::numeric_limits<int64_t>::max();
+
+  [[noreturn]] static void overflow() { throw std::domain_error("decimal overflow"); }
+
+  static constexpr bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+  static constexpr int64_t add(int64_t a, int64_t b) {
+    if (b > 0 ? a > maxRaw - b : a < minRaw - b) {
+      overflow();
+    }
+    return a + b;
+  }
+
+  static constexpr int64_t subtract(int64_t a, int64_t b) {
+    if (b > 0 ? a < minRaw + b : a > maxRaw + b) {
+      overflow();
+    }
+    return a - b;
+  }
+
+  /** `b` must be positive */
+  static constexpr int64_t multiply(int64_t a, int64_t b) {
+    if (a > maxRaw / b || a < minRaw / b) {
+      overflow();
+    }
+    return a * b;
+  }
+
+  static int64_t roundToRaw(double value) {
+    // also rejects NaN, the upper bound is 2^63 exactly
+    if (!(value >= -9223372036854775808.0 && value < 9223372036854775808.0)) {
+      overflow();
+    }
+    return llround(value);
+  }
+
+#ifdef __SIZEOF_INT128__
+  __extension__ typedef __int128 Wide;
+#else
+  typedef long double Wide;
+#endif
+
+  static int64_t roundedDivide(Wide numerator, Wide denominator) {
+    auto quotient = numerator / denominator;
+#ifdef __SIZEOF_INT128__
+    auto remainder = numerator % denominator;
+    auto absRemainder = remainder < 0 ? -remainder : remainder;
+    auto absDenominator = denominator < 0 ? -denominator : denominator;
+    if (absRemainder * 2 >= absDenominator) {
+      quotient += (numerator < 0) == (denominator < 0) ? 1 : -1;
+    }
+    if (quotient > maxRaw || quotient < minRaw) {
+      overflow();
+    }
+    return int64_t(quotient);
+#else
+    if (!(quotient >= -9223372036854775808.0L && quotient < 9223372036854775808.0L)) {
+      overflow();
+    }
+    return llroundl(quotient);
+#endif
+  }
+
+  int64_t raw = 0;
+};
+
+#endif  // PEGPARSER_DECIMAL_H
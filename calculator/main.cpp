@@ -1,21 +1,70 @@
 #include <peg_parser/generator.h>
+#include <peg_parser/structural_index.h>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include "report.h"
+#include "server.h"
 #include "visitor.h"
 
 using namespace std;
 using namespace peg_parser;
 
-void parserGenerator(ParserGenerator<void, Visitor &> &calculator);
+template <class Number> void parserGenerator(ParserGenerator<void, Visitor<Number> &> &calculator);
+template <class Number> int runCalculator(const char *batchPath, const char *socketPath);
+template <class Number>
+int runBatch(ParserGenerator<void, Visitor<Number> &> &calculator, Visitor<Number> &visitor,
+             const char *path);
 void checkExitProgram(string &input);
+int usage(const char *program);
 
-int main() {
+int main(int argc, char *argv[]) {
 
-  ParserGenerator<void, Visitor &> calculator;
-  Visitor visitor;
+  string precision = argc > 1 ? argv[1] : "float";
+  const char *batchPath = nullptr;
+  const char *socketPath = nullptr;
+
+  if (argc > 2 && string(argv[2]) == "--serve") {
+    socketPath = argc == 4 ? argv[3] : nullptr;
+    if (!socketPath) {
+      return usage(argv[0]);
+    }
+  } else if (argc == 3) {
+    batchPath = argv[2];
+  } else if (argc > 3) {
+    return usage(argv[0]);
+  }
+
+  if (precision == "float") {
+    return runCalculator<float>(batchPath, socketPath);
+  } else if (precision == "double") {
+    return runCalculator<double>(batchPath, socketPath);
+  } else if (precision == "decimal") {
+    return runCalculator<Decimal>(batchPath, socketPath);
+  }
+
+  cerr << "Unknown precision '" << precision << "', expected float, double or decimal." << endl;
+  return EXIT_FAILURE;
+}
+
+template <class Number> int runCalculator(const char *batchPath, const char *socketPath) {
+
+  ParserGenerator<void, Visitor<Number> &> calculator;
+  Visitor<Number> visitor;
   string input;
 
   parserGenerator(calculator);
 
+  if (batchPath) {
+    return runBatch(calculator, visitor, batchPath);
+  }
+
+  if (socketPath) {
+    // a single request must not occupy a worker for long
+    calculator.parser.limits.time = chrono::seconds(1);
+    return runServer(calculator, socketPath);
+  }
+
   cout << "Enter 'exit' to exit a program." << endl;
 
   while (true) {
@@ -25,17 +74,70 @@ int main() {
 
     checkExitProgram(input);
 
-    try {
-
+    reportErrors([&]() {
       calculator.run(input, visitor);
       cout << "Output: " << visitor.result << endl;
+    });
+  }
+}
+
+/** Evaluates each line of the file at `path`, printing one result or error per line */
+template <class Number>
+int runBatch(ParserGenerator<void, Visitor<Number> &> &calculator, Visitor<Number> &visitor,
+             const char *path) {
+
+  ifstream file(path, ios::binary);
 
-    } catch (SyntaxError &error) {
+  if (!file) {
 
-      cout << "*** Syntax error while parsing " << error.syntax->rule->name << endl;
+    cerr << "Cannot open '" << path << "'." << endl;
+    return EXIT_FAILURE;
+  }
+
+  string batch{istreambuf_iterator<char>(file), istreambuf_iterator<char>()};
+
+  // a single pass finds all lines and brackets, so unbalanced lines are rejected without parsing
+  StructuralIndex index(batch, "\n()");
+  Parser::Context context;
+  auto status = EXIT_SUCCESS;
+
+  for (auto line : index.split()) {
+
+    if (!line.empty() && line.back() == '\r') {
+      line.remove_suffix(1);
+    }
+
+    if (line.empty()) {
+      continue;
+    }
+
+    auto begin = size_t(line.data() - batch.data());
+    auto unbalanced = index.findUnbalanced('(', ')', begin, begin + line.size());
 
+    if (unbalanced != StructuralIndex::npos) {
+
+      cout << "*** unbalanced bracket at character " << unbalanced - begin + 1 << endl;
+      status = EXIT_FAILURE;
+      continue;
+    }
+
+    auto evaluated = reportErrors([&]() {
+      calculator.run(line, context, visitor);
+      cout << visitor.result << endl;
+    });
+
+    if (!evaluated) {
+      status = EXIT_FAILURE;
     }
   }
+
+  return status;
+}
+
+int usage(const char *program) {
+  cerr << "Usage: " << program << " [float|double|decimal] [<batch file> | --serve <socket path>]"
+       << endl;
+  return EXIT_FAILURE;
 }
 
 void checkExitProgram(string &input) {
@@ -46,7 +148,7 @@ void checkExitProgram(string &input) {
   }
 }
 
-void parserGenerator(ParserGenerator<void, Visitor &> &calculator) {
+template <class Number> void parserGenerator(ParserGenerator<void, Visitor<Number> &> &calculator) {
 
   auto &parserGenerator = calculator;
 
@@ -66,11 +168,8 @@ void parserGenerator(ParserGenerator<void, Visitor &> &calculator) {
         visitor.visitAssignment(expression[0], expression[1]);
       };
 
-  parserGenerator["Equation"] << "Add | Subtract | Product | Variable";
-
-  parserGenerator["Product"] << "Multiply | Divide | Exponent";
-
-  parserGenerator["Exponent"] << "Power | Atomic";
+  parserGenerator["Equation"] << "{Atomic; left: Add '+', Subtract '-'; "
+                                 "left: Multiply '*', Divide '/'; right: Power '^'}";
 
   parserGenerator["Atomic"] << "Number | Brackets | Functions | Variable";
 
@@ -88,34 +187,34 @@ void parserGenerator(ParserGenerator<void, Visitor &> &calculator) {
         visitor.visitCos(expression[0]);
       };
 
-  parserGenerator["Add"] << "Equation '+' Product" >>
+  parserGenerator["Add"] >>
       [](auto expression, auto &visitor) {
         visitor.visitAddition(expression[0], expression[1]);
       };
 
-  parserGenerator["Subtract"] << "Equation '-' Product" >>
+  parserGenerator["Subtract"] >>
       [](auto expression, auto &visitor) {
         visitor.visitSubtraction(expression[0], expression[1]);
       };
 
-  parserGenerator["Multiply"] << "Product '*' Exponent" >>
+  parserGenerator["Multiply"] >>
       [](auto expression, auto &visitor) {
         visitor.visitMultiplication(expression[0], expression[1]);
       };
 
-  parserGenerator["Divide"] << "Product '/' Exponent" >>
+  parserGenerator["Divide"] >>
       [](auto expression, auto &visitor) {
         visitor.visitDivision(expression[0], expression[1]);
       };
 
-  parserGenerator["Power"] << "Atomic ('^' Exponent)" >>
+  parserGenerator["Power"] >>
       [](auto expression, auto &visitor) {
         visitor.visitPower(expression[0], expression[1]);
       };
 
   parserGenerator["Variable"] << "Name" >>
       [](auto expression, auto &visitor) {
-        visitor.visitVariable(expression);
+        visitor.visitVariable(expression[0]);
       };
 
   parserGenerator["Name"] << "[a-zA-Z]+";
@@ -138,4 +237,5 @@ void parserGenerator(ParserGenerator<void, Visitor &> &calculator) {
       };
 
   parserGenerator.setStart(parserGenerator["Session"]);
+  parserGenerator.optimize();
 }
\ No newline at end of file
@@ -0,0 +1,36 @@
+#include <peg_parser/generator.h>
+#include <iostream>
+#include <stdexcept>
+
+#ifndef PEGPARSER_REPORT_H
+#define PEGPARSER_REPORT_H
+
+/**
+ * Calls `evaluate` and writes the errors of invalid input to `out`, one line each. Returns
+ * whether there was no error.
+ */
+template <class F> bool reportErrors(F &&evaluate, std::ostream &out = std::cout) {
+
+  try {
+
+    evaluate();
+    return true;
+
+  } catch (peg_parser::SyntaxError &error) {
+
+    out << "*** " << error.what() << std::endl;
+
+  } catch (std::domain_error &error) {
+
+    out << "*** Math error: " << error.what() << std::endl;
+
+  } catch (peg_parser::Parser::LimitError &error) {
+
+    out << "*** " << error.what() << std::endl;
+
+  }
+
+  return false;
+}
+
+#endif  // PEGPARSER_REPORT_H
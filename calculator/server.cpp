@@ -0,0 +1,390 @@
+#include "server.h"
+
+#include <peg_parser/thread_pool.h>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include "report.h"
+
+#ifdef __linux__
+#  include <sys/epoll.h>
+#  include <sys/eventfd.h>
+#  include <sys/socket.h>
+#  include <sys/un.h>
+#  include <unistd.h>
+#endif
+
+#ifdef __linux__
+
+namespace {
+
+  /** connections sending a longer line are closed */
+  constexpr size_t maxRequestLength = 1 << 20;
+  /** sessions are not read while their queued requests and unsent answers are longer */
+  constexpr size_t maxPendingLength = 1 << 20;
+
+  template <class Number> struct Session {
+    uint64_t id;
+    int socket;
+
+    /** used by the event loop only */
+    string received;
+    string unsent;
+    uint32_t interest = EPOLLIN;
+    /** set once the client has stopped sending */
+    bool closing = false;
+
+    /** shared with the task evaluating the session */
+    mutex lock;
+    deque<string> requests;
+    /** total length of `requests` */
+    size_t requestsLength = 0;
+    string responses;
+    bool evaluating = false;
+
+    /** used by the task evaluating the session only */
+    Visitor<Number> visitor;
+    Parser::Context context;
+
+    Session(uint64_t i, int s) : id(i), socket(s) {}
+  };
+
+  /**
+   * Event loop accepting and reading connections on a single thread. Requests are evaluated by
+   * one task per session at a time, which passes the answers back through an event file.
+   */
+  template <class Number> class Server {
+  private:
+    using Calculator = ParserGenerator<void, Visitor<Number> &>;
+
+    /** ids of the listening socket and the event file, sessions are counted from 2 */
+    enum : uint64_t { LISTENER, WAKEUP };
+
+    const Calculator &calculator;
+    int listener = -1;
+    int events = -1;
+    int wakeup = -1;
+    uint64_t nextId = 2;
+    /** cleared while connections cannot be accepted, for instance without file descriptors */
+    bool accepting = true;
+    unordered_map<uint64_t, shared_ptr<Session<Number>>> sessions;
+
+    mutex readyLock;
+    /** sessions with new answers or that have finished evaluating */
+    vector<uint64_t> ready;
+
+    ThreadPool pool;
+    /** declared last, so that the tasks are waited for first */
+    ThreadPool::Group tasks;
+
+    int fail(const string &what) {
+      auto error = errno;
+      cerr << "*** " << what << ": " << strerror(error) << endl;
+      return EXIT_FAILURE;
+    }
+
+    bool watch(int socket, uint64_t id, uint32_t interest, int operation = EPOLL_CTL_ADD) {
+      epoll_event event{};
+      event.events = interest;
+      event.data.u64 = id;
+      return epoll_ctl(events, operation, socket, &event) == 0;
+    }
+
+    void accept() {
+      while (true) {
+        auto socket = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (socket < 0) {
+          auto error = errno;
+          if (error == ECONNABORTED || error == EINTR) {
+            continue;
+          }
+          if (error != EAGAIN && error != EWOULDBLOCK) {
+            // the listener stays readable, so wait for a session to close instead of retrying
+            cerr << "*** Cannot accept connections: " << strerror(error) << endl;
+            if (watch(listener, LISTENER, 0, EPOLL_CTL_MOD)) {
+              accepting = false;
+            }
+          }
+          return;
+        }
+        auto session = make_shared<Session<Number>>(nextId++, socket);
+        if (!watch(socket, session->id, session->interest)) {
+          ::close(socket);
+          continue;
+        }
+        sessions[session->id] = session;
+      }
+    }
+
+    void close(Session<Number> &session) {
+      auto id = session.id;
+      {
+        lock_guard<mutex> guard(session.lock);
+        session.requests.clear();
+        session.requestsLength = 0;
+      }
+      epoll_ctl(events, EPOLL_CTL_DEL, session.socket, nullptr);
+      ::close(session.socket);
+      // may destroy the session
+      sessions.erase(id);
+      if (!accepting) {
+        accepting = watch(listener, LISTENER, EPOLLIN, EPOLL_CTL_MOD);
+      }
+    }
+
+    void receive(const shared_ptr<Session<Number>> &session) {
+      char buffer[1 << 16];
+      auto count = read(session->socket, buffer, sizeof(buffer));
+      if (count < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+          close(*session);
+        }
+        return;
+      }
+      if (count == 0) {
+        session->closing = true;
+      }
+
+      auto &received = session->received;
+      received.append(buffer, size_t(count));
+      deque<string> requests;
+      size_t begin = 0;
+      for (auto end = received.find('\n'); end != string::npos;
+           begin = end + 1, end = received.find('\n', begin)) {
+        auto line = string_view(received).substr(begin, end - begin);
+        if (!line.empty() && line.back() == '\r') {
+          line.remove_suffix(1);
+        }
+        if (!line.empty()) {
+          requests.emplace_back(line);
+        }
+      }
+      received.erase(0, begin);
+      if (session->closing && !received.empty()) {
+        // the last line may end without a line break
+        requests.push_back(std::move(received));
+        received.clear();
+      } else if (received.size() > maxRequestLength) {
+        received.clear();
+        session->unsent += "*** Request too long\n";
+        session->closing = true;
+      }
+
+      if (!requests.empty()) {
+        lock_guard<mutex> guard(session->lock);
+        for (auto &request : requests) {
+          session->requestsLength += request.size();
+        }
+        session->requests.insert(session->requests.end(), make_move_iterator(requests.begin()),
+                                 make_move_iterator(requests.end()));
+        if (!session->evaluating) {
+          session->evaluating = true;
+          tasks.run([this, session]() { evaluate(*session); });
+        }
+      }
+      flush(*session);
+    }
+
+    /** Answers the requests of `session` on a worker until there are none left */
+    void evaluate(Session<Number> &session) {
+      while (true) {
+        string request;
+        {
+          lock_guard<mutex> guard(session.lock);
+          if (session.requests.empty()) {
+            session.evaluating = false;
+            break;
+          }
+          request = std::move(session.requests.front());
+          session.requests.pop_front();
+          session.requestsLength -= request.size();
+        }
+
+        ostringstream response;
+        try {
+          reportErrors(
+              [&]() {
+                calculator.run(request, session.context, session.visitor);
+                response << session.visitor.result << '\n';
+              },
+              response);
+        } catch (exception &error) {
+          response << "*** " << error.what() << '\n';
+        }
+
+        bool notify;
+        {
+          lock_guard<mutex> guard(session.lock);
+          notify = session.responses.empty();
+          session.responses += response.str();
+        }
+        if (notify) {
+          wake(session.id);
+        }
+      }
+      // the event loop may be waiting for the evaluation to close the session
+      wake(session.id);
+    }
+
+    void wake(uint64_t id) {
+      {
+        lock_guard<mutex> guard(readyLock);
+        ready.push_back(id);
+      }
+      uint64_t one = 1;
+      [[maybe_unused]] auto written = write(wakeup, &one, sizeof(one));
+    }
+
+    void flushReady() {
+      uint64_t count;
+      [[maybe_unused]] auto drained = read(wakeup, &count, sizeof(count));
+      vector<uint64_t> ids;
+      {
+        lock_guard<mutex> guard(readyLock);
+        ids.swap(ready);
+      }
+      for (auto id : ids) {
+        auto it = sessions.find(id);
+        if (it != sessions.end()) {
+          flush(*it->second);
+        }
+      }
+    }
+
+    /**
+     * Sends the answers of `session`, and closes it once the client has been answered fully.
+     * Stops reading from clients that send faster than they read until they have caught up.
+     */
+    void flush(Session<Number> &session) {
+      bool evaluating;
+      size_t requestsLength;
+      {
+        lock_guard<mutex> guard(session.lock);
+        session.unsent += session.responses;
+        session.responses.clear();
+        evaluating = session.evaluating;
+        requestsLength = session.requestsLength;
+      }
+
+      size_t sent = 0;
+      while (sent < session.unsent.size()) {
+        auto count = send(session.socket, session.unsent.data() + sent,
+                          session.unsent.size() - sent, MSG_NOSIGNAL);
+        if (count >= 0) {
+          sent += size_t(count);
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          break;
+        } else if (errno != EINTR) {
+          return close(session);
+        }
+      }
+      session.unsent.erase(0, sent);
+
+      if (session.closing && !evaluating && session.unsent.empty()) {
+        return close(session);
+      }
+      auto reading = !session.closing && requestsLength + session.unsent.size() < maxPendingLength;
+      uint32_t interest = reading ? uint32_t(EPOLLIN) : 0u;
+      if (!session.unsent.empty()) {
+        interest |= EPOLLOUT;
+      }
+      if (interest != session.interest) {
+        watch(session.socket, session.id, interest, EPOLL_CTL_MOD);
+        session.interest = interest;
+      }
+    }
+
+  public:
+    Server(const Calculator &c, size_t workers) : calculator(c), pool(workers), tasks(pool) {}
+
+    ~Server() {
+      tasks.wait();
+      for (auto &session : sessions) {
+        ::close(session.second->socket);
+      }
+      for (auto file : {listener, events, wakeup}) {
+        if (file >= 0) {
+          ::close(file);
+        }
+      }
+    }
+
+    int run(const char *path) {
+      sockaddr_un address{};
+      address.sun_family = AF_UNIX;
+      if (strlen(path) >= sizeof(address.sun_path)) {
+        cerr << "*** Socket path '" << path << "' is too long." << endl;
+        return EXIT_FAILURE;
+      }
+      strcpy(address.sun_path, path);
+
+      listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+      unlink(path);
+      if (listener < 0 || bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address))
+          || listen(listener, SOMAXCONN)) {
+        return fail("Cannot listen on '" + string(path) + "'");
+      }
+      events = epoll_create1(EPOLL_CLOEXEC);
+      wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (events < 0 || wakeup < 0 || !watch(listener, LISTENER, EPOLLIN)
+          || !watch(wakeup, WAKEUP, EPOLLIN)) {
+        return fail("Cannot wait for connections");
+      }
+      cout << "Serving on '" << path << "' with " << pool.size() << " workers." << endl;
+
+      epoll_event occurred[64];
+      while (true) {
+        auto count = epoll_wait(events, occurred, 64, -1);
+        if (count < 0) {
+          if (errno == EINTR) {
+            continue;
+          }
+          return fail("Cannot wait for connections");
+        }
+        for (int i = 0; i < count; ++i) {
+          auto id = occurred[i].data.u64;
+          if (id == LISTENER) {
+            accept();
+          } else if (id == WAKEUP) {
+            flushReady();
+          } else if (auto it = sessions.find(id); it != sessions.end()) {
+            auto session = it->second;
+            if (occurred[i].events & (EPOLLHUP | EPOLLERR)) {
+              // the client cannot receive any answers anymore
+              close(*session);
+            } else if (occurred[i].events & EPOLLIN) {
+              receive(session);
+            } else {
+              flush(*session);
+            }
+          }
+        }
+      }
+    }
+  };
+
+}  // namespace
+
+template <class Number>
+int runServer(const ParserGenerator<void, Visitor<Number> &> &calculator, const char *path,
+              size_t workers) {
+  Server<Number> server(calculator, workers);
+  return server.run(path);
+}
+
+#else
+
+template <class Number>
+int runServer(const ParserGenerator<void, Visitor<Number> &> &, const char *, size_t) {
+  cerr << "*** Server mode is only available on Linux." << endl;
+  return EXIT_FAILURE;
+}
+
+#endif
+
+template int runServer(const ParserGenerator<void, Visitor<float> &> &, const char *, size_t);
+template int runServer(const ParserGenerator<void, Visitor<double> &> &, const char *, size_t);
+template int runServer(const ParserGenerator<void, Visitor<Decimal> &> &, const char *, size_t);
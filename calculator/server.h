@@ -0,0 +1,18 @@
+#include <peg_parser/generator.h>
+#include "visitor.h"
+
+#ifndef PEGPARSER_SERVER_H
+#define PEGPARSER_SERVER_H
+
+/**
+ * Serves `calculator` on the Unix domain socket at `path`. Every connection is a session with
+ * its own variables. Each line a client sends is answered by a line with the result or an
+ * error, in order, and clients may send further lines before reading the answers. Empty lines
+ * are ignored. Sessions are evaluated on `workers` threads, one per core if 0. Only available
+ * on Linux, returns once the socket cannot be served anymore.
+ */
+template <class Number>
+int runServer(const ParserGenerator<void, Visitor<Number> &> &calculator, const char *path,
+              size_t workers = 0);
+
+#endif  // PEGPARSER_SERVER_H
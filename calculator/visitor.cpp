@@ -5,62 +5,86 @@
 #include <cmath>
 #include "visitor.h"
 
-float Visitor::getValue(Expression &expression) {
+namespace {
+
+  template <class Number> Number parseDecimal(string_view digits) {
+    return parseNumber<Number>(digits);
+  }
+
+  template <> Decimal parseDecimal<Decimal>(string_view digits) { return Decimal::parse(digits); }
+
+  template <class Number> Number parseInteger(string_view digits, int base) {
+    return static_cast<Number>(parseNumber<long long>(digits, base));
+  }
+
+}  // namespace
+
+template <class Number> Number Visitor<Number>::getValue(Expression &expression) {
   expression.evaluate(*this);
   return result;
 }
 
-void Visitor::visitAddition(Expression left, Expression right) {
+template <class Number> void Visitor<Number>::visitAddition(Expression left, Expression right) {
   result = getValue(left) + getValue(right);
 }
 
-void Visitor::visitSubtraction(Expression left, Expression right) {
+template <class Number> void Visitor<Number>::visitSubtraction(Expression left, Expression right) {
   result = getValue(left) - getValue(right);
 }
 
-void Visitor::visitMultiplication(Expression left, Expression right) {
+template <class Number>
+void Visitor<Number>::visitMultiplication(Expression left, Expression right) {
   result = getValue(left) * getValue(right);
 }
 
-void Visitor::visitDivision(Expression left, Expression right) {
+template <class Number> void Visitor<Number>::visitDivision(Expression left, Expression right) {
   result = getValue(left) / getValue(right);
 }
 
-void Visitor::visitPower(Expression left, Expression right) {
-  result = pow(getValue(left), getValue(right));
+template <class Number> void Visitor<Number>::visitPower(Expression left, Expression right) {
+  using std::pow;
+  result = static_cast<Number>(pow(getValue(left), getValue(right)));
 }
 
-void Visitor::visitVariable(const Expression& name) {
+template <class Number> void Visitor<Number>::visitVariable(const Expression& name) {
   result = variables[name.string()];
 }
 
-void Visitor::visitAssignment(const Expression& name, Expression value) {
+template <class Number>
+void Visitor<Number>::visitAssignment(const Expression& name, Expression value) {
   variables[name.string()] = getValue(value);
 }
 
-void Visitor::visitDecimalNumber(const Expression& value) {
-  result = stof(value.string());
+template <class Number> void Visitor<Number>::visitDecimalNumber(const Expression& value) {
+  result = parseDecimal<Number>(value.view());
 }
 
-void Visitor::visitHexadecimalNumber(const Expression& value) {
-  result = stof(value.string());
+template <class Number> void Visitor<Number>::visitHexadecimalNumber(const Expression& value) {
+  // skip the '0x' prefix
+  result = parseInteger<Number>(value.view().substr(2), 16);
 }
 
-void Visitor::visitBinaryNumber(const Expression& value) {
-  string binary = value.string();
-  binary.pop_back();
-  result = (float) stoi(binary, nullptr, 2);
+template <class Number> void Visitor<Number>::visitBinaryNumber(const Expression& value) {
+  // skip the 'b' suffix
+  auto binary = value.view();
+  result = parseInteger<Number>(binary.substr(0, binary.size() - 1), 2);
 }
 
-void Visitor::visitSin(Expression value) {
+template <class Number> void Visitor<Number>::visitSin(Expression value) {
+  using std::sin;
   result = sin(getValue(value));
 }
 
-void Visitor::visitCos(Expression value) {
+template <class Number> void Visitor<Number>::visitCos(Expression value) {
+  using std::cos;
   result = cos(getValue(value));
 }
 
-void Visitor::visitHeader() {
+template <class Number> void Visitor<Number>::visitHeader() {
   result = {};
-  variables = unordered_map<string, float>();
-}
\ No newline at end of file
+  variables = unordered_map<string, Number>();
+}
+
+template struct Visitor<float>;
+template struct Visitor<double>;
+template struct Visitor<Decimal>;
@@ -4,7 +4,9 @@
 
 #include <peg_parser/generator.h>
 #include <iostream>
+#include <string_view>
 #include <unordered_map>
+#include "decimal.h"
 
 
 using namespace std;
@@ -13,16 +15,18 @@ using namespace peg_parser;
 #ifndef PEGPARSER_VISITOR_H
 #define PEGPARSER_VISITOR_H
 
-struct Visitor;
+/**
+ * Evaluates calculator syntax trees using `Number` for all intermediate values.
+ * Instantiated for `float`, `double` and `Decimal` in visitor.cpp.
+ */
+template <class Number> struct Visitor {
 
-using Expression = Interpreter<void, Visitor &>::Expression;
+  using Expression = typename Interpreter<void, Visitor &>::Expression;
 
-struct Visitor {
+  Number result{};
+  unordered_map<string, Number> variables{};
 
-  float result{};
-  unordered_map<string, float> variables{};
-
-  float getValue(Expression &expression);
+  Number getValue(Expression &expression);
 
   void visitAddition(Expression left, Expression right);
 
@@ -51,4 +55,4 @@ struct Visitor {
   void visitHeader();
 };
 
-#endif  // PEGPARSER_VISITOR_H
\ No newline at end of file
+#endif  // PEGPARSER_VISITOR_H
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <ostream>
+#include <unordered_set>
+#include <vector>
+
+#include "grammar.h"
+
+namespace peg_parser {
+
+  namespace grammar {
+
+    /** Static properties of the rules reachable from a start rule, see `analyze` */
+    struct Analysis {
+      /** reachable rules in the order they were found */
+      std::vector<std::shared_ptr<Rule>> rules;
+      /** rules that can succeed without consuming any input */
+      std::unordered_set<const Rule *> nullable;
+      /** rules that can be called again at the position they began at */
+      std::unordered_set<const Rule *> leftRecursive;
+      /** shortest left recursive call cycles, each beginning and ending with the same rule */
+      std::vector<std::vector<std::shared_ptr<Rule>>> cycles;
+    };
+
+    /** Lists the left recursive cycles, one per line */
+    std::ostream &operator<<(std::ostream &stream, const Analysis &analysis);
+
+    /**
+     * Finds the nullable and left recursive rules reachable from `start` and updates their
+     * `Rule::leftRecursive`, so that only left recursive rules are parsed with support for
+     * growing a seed. Must be repeated after changing the nodes of any of the rules.
+     */
+    Analysis analyze(const std::shared_ptr<Rule> &start);
+
+  }  // namespace grammar
+
+}  // namespace peg_parser
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "grammar.h"
+
+namespace peg_parser {
+
+  namespace grammar {
+
+    /**
+     * Deterministic finite automaton matching a regular node, that is one built only from words,
+     * letters, sequences, choices and repetitions. The automaton follows the parser exactly:
+     * choices commit to the first alternative that matches and repetitions never give back what
+     * they consumed, so the match is not necessarily the longest one.
+     */
+    class Automaton {
+    public:
+      using StateIndex = uint16_t;
+      static constexpr size_t npos = std::string_view::npos;
+
+      /**
+       * Returns null if `node` is not regular, contains letters the parser would also match at
+       * the end of the input or if the automaton would need more than `maxStates` states.
+       */
+      static std::shared_ptr<const Automaton> compile(const Node &node, size_t maxStates = 256);
+
+      /** Returns the end of the match beginning at `position` or `npos` if there is none */
+      size_t match(std::string_view string, size_t position) const;
+
+      size_t stateCount() const { return flags.size(); }
+
+    private:
+      enum Flag : uint8_t {
+        /** a match ended before the letter leading to the state */
+        MATCHED = 1,
+        /** the last match is kept if the input ends here or the state is final */
+        PENDING = 2,
+        /** the result does not depend on any further letters */
+        FINAL = 4,
+        /** a match ends at the end of the input if it ends here */
+        MATCHED_AT_END = 8
+      };
+
+      /** the next state for each state and letter, state 0 never matches */
+      std::vector<StateIndex> transitions;
+      std::vector<uint8_t> flags;
+    };
+
+    /**
+     * Compiles automata for all regular rules reachable from `start`, so that they are parsed by
+     * a single loop over the input instead of walking their nodes. Returns the number of rules
+     * compiled. Must be repeated after changing the nodes of any of the rules.
+     */
+    size_t compileAutomata(const std::shared_ptr<Rule> &start, size_t maxStates = 256);
+
+  }  // namespace grammar
+
+}  // namespace peg_parser
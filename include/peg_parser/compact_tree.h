@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+
+#include "parser.h"
+
+namespace peg_parser {
+
+  /**
+   * Read-only syntax tree stored as a struct of arrays. Nodes are numbered in pre-order and each
+   * node only takes a rule id, its range, its number of children and the index of its next
+   * sibling, so a tree uses a fraction of the memory of the corresponding `SyntaxTree`s and can
+   * be traversed without chasing pointers. The input is referenced once for the whole tree.
+   */
+  class CompactSyntaxTree {
+  public:
+    using Index = uint32_t;
+
+    class Cursor {
+    private:
+      const CompactSyntaxTree *tree;
+      Index index;
+
+    public:
+      Cursor(const CompactSyntaxTree *t, Index i) : tree(t), index(i) {}
+
+      const CompactSyntaxTree &compactTree() const { return *tree; }
+      Index getIndex() const { return index; }
+
+      const std::shared_ptr<grammar::Rule> &rule() const {
+        return tree->rules[tree->ruleIds[index]];
+      }
+      size_t begin() const { return tree->begins[index]; }
+      size_t end() const { return tree->ends[index]; }
+      size_t length() const { return end() - begin(); }
+      std::string_view view() const { return tree->fullString.substr(begin(), length()); }
+      size_t size() const { return tree->childCounts[index]; }
+
+      /** Only valid if `size() > 0` */
+      Cursor firstChild() const { return Cursor(tree, index + 1); }
+      /** Only valid if this is not the last child of its parent */
+      Cursor nextSibling() const { return Cursor(tree, tree->nextSiblings[index]); }
+
+      /** Linear in `idx` */
+      Cursor operator[](size_t idx) const {
+        auto child = firstChild();
+        while (idx-- > 0) {
+          child = child.nextSibling();
+        }
+        return child;
+      }
+
+      bool operator==(const Cursor &other) const {
+        return tree == other.tree && index == other.index;
+      }
+      bool operator!=(const Cursor &other) const { return !(*this == other); }
+    };
+
+    /** Copies a valid syntax tree. Throws `std::length_error` if it does not fit in 32 bits. */
+    explicit CompactSyntaxTree(const SyntaxTree &tree);
+
+    Cursor root() const { return Cursor(this, 0); }
+    size_t nodeCount() const { return ruleIds.size(); }
+    std::string_view string() const { return fullString; }
+
+    /** Recreates the `SyntaxTree` starting at `cursor` */
+    std::shared_ptr<SyntaxTree> expand(const Cursor &cursor) const;
+
+    /** Bytes allocated by the tree, excluding the rules and the input */
+    size_t memoryUsage() const;
+
+  private:
+    std::string_view fullString;
+    std::vector<std::shared_ptr<grammar::Rule>> rules;
+    std::vector<Index> ruleIds;
+    std::vector<Index> begins;
+    std::vector<Index> ends;
+    std::vector<Index> childCounts;
+    std::vector<Index> nextSiblings;
+
+    void add(const SyntaxTree &tree, std::unordered_map<grammar::Rule *, Index> &ruleIndices);
+  };
+
+  std::ostream &operator<<(std::ostream &stream, const CompactSyntaxTree::Cursor &cursor);
+
+}  // namespace peg_parser
@@ -1,18 +1,60 @@
 #pragma once
 
+#include <algorithm>
+#include <stdexcept>
+
+#include "analysis.h"
+#include "automaton.h"
+#include "lexer.h"
+#include "optimizer.h"
 #include "presets.h"
+#include "serialization.h"
 
 namespace peg_parser {
 
   template <class R = void, typename... Args> class ParserGenerator : public Program<R, Args...> {
   private:
-    presets::GrammarProgram grammarProgram;
     std::unordered_map<std::string, std::shared_ptr<grammar::Rule>> rules;
+    std::vector<std::shared_ptr<grammar::Rule>> loadedRules;
     grammar::Node::Shared separatorRule;
+    /** set if `Rule::leftRecursive` has been computed for the current rules */
+    bool analyzed = false;
+    /** lexer of the token rules, see `setTokens` */
+    std::shared_ptr<const grammar::Lexer> lexer;
 
-  public:
-    ParserGenerator() { grammarProgram = presets::createPEGProgram(); }
+    /** Resets the analysis of all rules as any change may create a left recursion */
+    void invalidateAnalysis() {
+      if (analyzed) {
+        for (auto &it : rules) {
+          it.second->leftRecursive = true;
+        }
+        for (auto &rule : loadedRules) {
+          rule->leftRecursive = true;
+        }
+        analyzed = false;
+      }
+    }
+
+    /** Replaces the node of `rule`, dropping everything derived from the previous one */
+    void setNode(const std::shared_ptr<grammar::Rule> &rule, grammar::Node::Shared node) {
+      invalidateAnalysis();
+      if (rule->lexer) {
+        unsetTokens();
+      }
+      rule->node = std::move(node);
+      rule->automaton.reset();
+    }
+
+    void setGrammar(serialization::Grammar &&grammar) {
+      unsetTokens();
+      separatorRule = grammar.separator;
+      this->parser.grammar = grammar.start;
+      loadedRules = std::move(grammar.internalRules);
+      // the loaded rules may have been analyzed before saving
+      analyzed = true;
+    }
 
+  public:
     std::shared_ptr<grammar::Rule> getRule(const std::string &name) {
       auto it = rules.find(name);
       if (it != rules.end()) {
@@ -38,14 +80,14 @@ namespace peg_parser {
         const typename Interpreter<R, Args...>::Callback &callback
         = typename Interpreter<R, Args...>::Callback()) {
       auto rule = getRule(name);
-      rule->node = grammar;
+      setNode(rule, grammar);
       this->interpreter.setEvaluator(rule, callback);
       return rule;
     }
 
     grammar::Node::Shared parseRule(const std::string_view &grammar) {
       presets::RuleGetter rg = [this](const auto &name) { return getRuleNode(std::string(name)); };
-      return grammarProgram.run(grammar, rg);
+      return presets::parsePEGExpression(grammar, rg);
     }
 
     std::shared_ptr<grammar::Rule> setRule(
@@ -59,7 +101,7 @@ namespace peg_parser {
     std::shared_ptr<grammar::Rule> setProgramRule(const std::string &name,
                                                   Program<R2, Args2...> subprogram, C &&callback) {
       auto rule = getRule(name);
-      rule->node = grammar::Node::Rule(subprogram.parser.grammar);
+      setNode(rule, grammar::Node::Rule(subprogram.parser.grammar));
       this->interpreter.setEvaluator(
           rule, [callback = std::forward<C>(callback), interpreter = subprogram.interpreter](
                     auto e, Args &&...args) {
@@ -73,7 +115,7 @@ namespace peg_parser {
       static_assert(sizeof...(Args2) == 0);
       static_assert(std::is_convertible<R2, R>::value);
       auto rule = getRule(name);
-      rule->node = grammar::Node::Rule(subprogram.parser.grammar);
+      setNode(rule, grammar::Node::Rule(subprogram.parser.grammar));
       this->interpreter.setEvaluator(rule,
                                      [interpreter = subprogram.interpreter](auto e, auto &&...) {
                                        return R(interpreter.interpret(e[0].syntax()).evaluate());
@@ -90,7 +132,45 @@ namespace peg_parser {
                      callback);
     }
 
+    /**
+     * Sets `name` to match `operand`s joined by the binary operators added with `addOperator`,
+     * see `grammar::Node::Precedence`.
+     */
+    std::shared_ptr<grammar::Rule> setPrecedenceRule(
+        const std::string &name, const std::string_view &operand,
+        const typename Interpreter<R, Args...>::Callback &callback
+        = typename Interpreter<R, Args...>::Callback()) {
+      return setRule(name, grammar::Node::Precedence(parseRule(operand), {}), callback);
+    }
+
+    /**
+     * Adds an operator matching `pattern` to the precedence rule `name`. Each operation creates a
+     * syntax tree of the rule `operatorName`, whose first and last inner trees are the operands.
+     * If given, `callback` replaces the evaluator of `operatorName`.
+     */
+    std::shared_ptr<grammar::Rule> addOperator(
+        const std::string &name, const std::string &operatorName,
+        const std::string_view &pattern, unsigned precedence, bool rightAssociative = false,
+        const typename Interpreter<R, Args...>::Callback &callback
+        = typename Interpreter<R, Args...>::Callback()) {
+      auto rule = getRule(name);
+      auto table = std::get_if<grammar::Node::OperatorTable>(&rule->node->data);
+      if (!table) {
+        throw std::invalid_argument("rule " + name + " is not a precedence rule");
+      }
+      auto operators = table->operators;
+      auto operatorRule = getRule(operatorName);
+      operators.push_back(
+          grammar::Node::Operator{operatorRule, parseRule(pattern), precedence, rightAssociative});
+      setNode(rule, grammar::Node::Precedence(table->operand, operators));
+      if (callback) {
+        this->interpreter.setEvaluator(operatorRule, callback);
+      }
+      return operatorRule;
+    }
+
     void setSeparator(const std::shared_ptr<grammar::Rule> &rule) {
+      unsetTokens();
       rule->hidden = true;
       separatorRule = grammar::Node::Rule(rule);
     }
@@ -109,7 +189,112 @@ namespace peg_parser {
 
     void setStart(const std::shared_ptr<grammar::Rule> &rule) { this->parser.grammar = rule; }
 
-    void unsetSeparatorRule() { separatorRule.reset(); }
+    /** Sets the synchronization point for error recovery in `rule`, see `grammar::Rule::recovery` */
+    std::shared_ptr<grammar::Rule> setRecovery(const std::string &name,
+                                               const std::string_view &grammar) {
+      auto rule = getRule(name);
+      rule->recovery = parseRule(grammar);
+      return rule;
+    }
+
+    void unsetSeparatorRule() {
+      unsetTokens();
+      separatorRule.reset();
+    }
+
+    /**
+     * Splits the input into tokens of the rules `names` and the separator in a single pass before
+     * parsing, see `grammar::Lexer`. All token rules must be regular. Changing one of them or
+     * the separator removes the lexer again.
+     */
+    std::shared_ptr<const grammar::Lexer> setTokens(const std::vector<std::string> &names) {
+      unsetTokens();
+      std::vector<std::shared_ptr<grammar::Rule>> tokens;
+      for (auto &name : names) {
+        tokens.push_back(getRule(name));
+      }
+      std::shared_ptr<grammar::Rule> separator;
+      if (separatorRule) {
+        if (auto rule = std::get_if<std::shared_ptr<grammar::Rule>>(&separatorRule->data)) {
+          separator = *rule;
+        }
+      }
+      lexer = grammar::Lexer::create(tokens, separator);
+      return lexer;
+    }
+
+    /** Removes the lexer set by `setTokens`, so that all rules match characters again */
+    void unsetTokens() {
+      if (lexer) {
+        lexer->release();
+        lexer.reset();
+      }
+    }
+
+    /**
+     * Finalizes the grammar: optimizes the nodes of all rules reachable from the start rule,
+     * analyzes them, see `analyze`, and compiles the regular ones to automata, see
+     * `grammar::compileAutomata`. Should be called again after changing the grammar.
+     */
+    grammar::OptimizationStatistics optimize() {
+      auto statistics = grammar::optimize(this->parser.grammar);
+      analyze();
+      grammar::compileAutomata(this->parser.grammar);
+      return statistics;
+    }
+
+    /**
+     * Finds the left recursive rules reachable from the start rule, so that all other rules are
+     * parsed without left recursion bookkeeping until the grammar is changed. The returned
+     * analysis reports the left recursive cycles.
+     */
+    grammar::Analysis analyze() {
+      auto analysis = grammar::analyze(this->parser.grammar);
+      analyzed = true;
+      return analysis;
+    }
+
+    void setEvaluator(const std::string &name,
+                      const typename Interpreter<R, Args...>::Callback &callback) {
+      this->interpreter.setEvaluator(getRule(name), callback);
+    }
+
+    /** Evaluates each syntax tree of `name` once per evaluation, see `Interpreter::setPure` */
+    void setPure(const std::string &name, bool pure = true) {
+      this->interpreter.setPure(getRule(name), pure);
+    }
+
+    /** Evaluates the pure inner trees of `name` concurrently, see `Interpreter::setParallel` */
+    void setParallel(const std::string &name, bool parallel = true) {
+      this->interpreter.setParallel(getRule(name), parallel);
+    }
+
+    /** Serializes rules, separator and start rule. Evaluators are not serialized. */
+    std::string save() const {
+      serialization::Grammar grammar;
+      for (auto &it : rules) {
+        grammar.rules.push_back(it.second);
+      }
+      std::sort(grammar.rules.begin(), grammar.rules.end(),
+                [](auto &a, auto &b) { return a->name < b->name; });
+      grammar.start = this->parser.grammar;
+      grammar.separator = separatorRule;
+      return serialization::save(grammar);
+    }
+
+    /**
+     * Replaces the grammar by one created with `save`. Rules are matched by name, so evaluators can
+     * be set before or after loading.
+     */
+    void load(std::string_view data) {
+      setGrammar(
+          serialization::load(data, [this](auto name) { return getRule(std::string(name)); }));
+    }
+
+    void loadFile(const std::string &path) {
+      setGrammar(
+          serialization::loadFile(path, [this](auto name) { return getRule(std::string(name)); }));
+    }
 
     /** Operator overloads */
 
@@ -149,6 +334,8 @@ namespace peg_parser {
           } else {
             parent->setRule(ruleName, grammar, callback);
           }
+        } else if (callback) {
+          parent->setEvaluator(ruleName, callback);
         }
       }
     };
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <bitset>
 #include <functional>
 #include <memory>
 #include <ostream>
@@ -17,12 +18,35 @@ namespace peg_parser {
 
     using Letter = char;
     struct Node;
+    class Automaton;
+    class Lexer;
 
     struct Rule {
       std::string name;
       std::shared_ptr<Node> node;
       bool hidden = false;
       bool cacheable = true;
+      /**
+       * Whether the rule may call itself before consuming input. Only such rules can grow a seed,
+       * all others are memoized without left recursion bookkeeping. Set by `grammar::analyze`.
+       */
+      bool leftRecursive = true;
+      /**
+       * Synchronization point used by `Parser::parseWithRecovery`. If set and the rule fails, the
+       * input up to and including the next match is skipped and the rule succeeds without adding
+       * a syntax tree.
+       */
+      std::shared_ptr<Node> recovery;
+      /**
+       * Matches `node` in a single loop over the input if it is regular, used unless errors are
+       * reported. Set by `grammar::compileAutomata` and must be reset when changing `node`.
+       */
+      std::shared_ptr<const Automaton> automaton;
+      /**
+       * Lexer this rule is a token rule of, if set the rule only matches the tokens the lexer
+       * found. Set by `Lexer::create`.
+       */
+      std::shared_ptr<const Lexer> lexer;
       Rule(const std::string_view &n, const std::shared_ptr<Node> &t) : name(n), node(t) {}
     };
 
@@ -33,6 +57,7 @@ namespace peg_parser {
 
     struct Node {
       using FilterCallback = std::function<bool(const std::shared_ptr<SyntaxTree> &)>;
+      using CharacterSet = std::bitset<256>;
 
       enum class Symbol {
         WORD,
@@ -50,16 +75,33 @@ namespace peg_parser {
         RULE,
         WEAK_RULE,
         END_OF_FILE,
-        FILTER
+        FILTER,
+        CHARACTER_SET,
+        PRECEDENCE
       };
 
       using Shared = std::shared_ptr<Node>;
 
+      /** Binary operator of a precedence node */
+      struct Operator {
+        /** rule of the syntax tree created for each operation, its own node is not used */
+        std::shared_ptr<grammar::Rule> rule;
+        Shared pattern;
+        /** operators with a higher precedence bind more tightly */
+        unsigned precedence = 0;
+        bool rightAssociative = false;
+      };
+
+      struct OperatorTable {
+        Shared operand;
+        std::vector<Operator> operators;
+      };
+
       Symbol symbol;
 
       std::variant<std::vector<Shared>, Shared, std::weak_ptr<grammar::Rule>,
                    std::shared_ptr<grammar::Rule>, std::string, std::array<Letter, 2>,
-                   FilterCallback>
+                   FilterCallback, CharacterSet, OperatorTable>
           data;
 
     private:
@@ -99,6 +141,18 @@ namespace peg_parser {
       static Shared Filter(const FilterCallback &callback) {
         return Shared(new Node(Symbol::FILTER, callback));
       }
+      /** Matches a single letter contained in `set`, indexed by its unsigned value */
+      static Shared Set(const CharacterSet &set) {
+        return Shared(new Node(Symbol::CHARACTER_SET, set));
+      }
+      /**
+       * Matches `operand`s joined by binary `operators`, which are tried in order. Parsed by
+       * precedence climbing in a single loop, each operation adds a syntax tree of the operator's
+       * rule containing the trees of both operands and of the operator itself.
+       */
+      static Shared Precedence(const Shared &operand, const std::vector<Operator> &operators) {
+        return Shared(new Node(Symbol::PRECEDENCE, OperatorTable{operand, operators}));
+      }
     };
 
     std::ostream &operator<<(std::ostream &stream, const Node &node);
@@ -1,10 +1,17 @@
 #pragma once
 
+#include <charconv>
 #include <iterator>
+#include <mutex>
 #include <optional>
+#include <string_view>
 #include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
 
+#include "compact_tree.h"
 #include "parser.h"
+#include "thread_pool.h"
 
 namespace peg_parser {
 
@@ -15,11 +22,36 @@ namespace peg_parser {
     const char *what() const noexcept override;
   };
 
+  /**
+   * Parses the whole of `str` as a number using `std::from_chars`, without allocating.
+   * `base` is only used for integral types. Throws `std::invalid_argument` or `std::out_of_range`
+   * like `std::stoi`.
+   */
+  template <class T> T parseNumber(std::string_view str, [[maybe_unused]] int base = 10) {
+    static_assert(std::is_arithmetic<T>::value);
+    T value{};
+    auto end = str.data() + str.size();
+    std::from_chars_result result;
+    if constexpr (std::is_integral<T>::value) {
+      result = std::from_chars(str.data(), end, value, base);
+    } else {
+      result = std::from_chars(str.data(), end, value);
+    }
+    if (result.ec == std::errc::result_out_of_range) {
+      throw std::out_of_range("number out of range: " + std::string(str));
+    }
+    if (result.ec != std::errc() || result.ptr != end) {
+      throw std::invalid_argument("invalid number: " + std::string(str));
+    }
+    return value;
+  }
+
   template <class R, typename... Args> class Interpreter {
   public:
     class Expression;
     using Callback = std::function<R(const Expression &e, Args... args)>;
 
+    /** Evaluation context of a `SyntaxTree` or a node of a `CompactSyntaxTree` */
     class Expression {
     protected:
       struct iterator {
@@ -30,40 +62,150 @@ namespace peg_parser {
 
         const Expression &parent;
         size_t idx;
-        iterator(const Expression &p, size_t i) : parent(p), idx(i) {}
+        CompactSyntaxTree::Cursor child;
+        iterator(const Expression &p, size_t i)
+            : parent(p), idx(i), child(p.cursor.firstChild()) {}
         iterator &operator++() {
+          if (parent.isCompact()) {
+            child = child.nextSibling();
+          }
           idx++;
           return *this;
         }
-        Expression operator*() const { return parent[idx]; }
+        Expression operator*() const {
+          return parent.isCompact() ? parent.interpreter.interpret(child) : parent[idx];
+        }
         bool operator!=(const iterator &other) const {
           return other.idx != idx || &other.parent != &parent;
         }
       };
 
+      /** results of the pure rules evaluated so far, by their syntax tree */
+      struct Memo {
+        std::unordered_map<const SyntaxTree *, std::conditional_t<std::is_void<R>::value, char, R>>
+            results;
+        /** only locked if inner trees may be evaluated concurrently */
+        std::mutex mutex;
+      };
+
       const Interpreter<R, Args...> &interpreter;
       std::shared_ptr<SyntaxTree> syntaxTree;
+      CompactSyntaxTree::Cursor cursor{nullptr, 0};
+      /** shared by all expressions of an evaluation, set once pure rules are evaluated */
+      std::shared_ptr<Memo> memo;
+
+      bool isCompact() const { return !syntaxTree; }
+      grammar::Rule *rulePointer() const {
+        return isCompact() ? cursor.rule().get() : syntaxTree->rule.get();
+      }
+
+      Expression inner(const std::shared_ptr<SyntaxTree> &tree) const {
+        auto expression = interpreter.interpret(tree);
+        expression.memo = memo;
+        return expression;
+      }
+
+      R evaluateMemoized(Args... args) const {
+        if (!memo) {
+          auto root = *this;
+          root.memo = std::make_shared<Memo>();
+          return root.evaluateMemoized(args...);
+        }
+        auto pure = interpreter.pureRules.count(rulePointer()) > 0;
+        auto concurrent = !interpreter.parallelRules.empty();
+        std::unique_lock<std::mutex> lock(memo->mutex, std::defer_lock);
+        if (pure) {
+          if (concurrent) {
+            lock.lock();
+          }
+          auto it = memo->results.find(syntaxTree.get());
+          if (it != memo->results.end()) {
+            return it->second;
+          }
+          if (concurrent) {
+            lock.unlock();
+          }
+        }
+        if (concurrent && interpreter.parallelRules.count(rulePointer())) {
+          evaluateInnerConcurrently(args...);
+        }
+        auto result = evaluateRule(args...);
+        if (pure) {
+          if (concurrent) {
+            lock.lock();
+          }
+          memo->results.emplace(syntaxTree.get(), result);
+        }
+        return result;
+      }
+
+      /**
+       * Evaluates the inner trees of pure rules ahead of the callback, which then finds their
+       * results in `memo`. Trees of at least `minParallelLength` bytes become tasks of the pool.
+       */
+      void evaluateInnerConcurrently(Args... args) const {
+        ThreadPool::Group group(*interpreter.threadPool);
+        for (auto &tree : syntaxTree->inner) {
+          if (!interpreter.pureRules.count(tree->rule.get())) {
+            continue;
+          }
+          if (tree->length() >= interpreter.minParallelLength) {
+            group.run([&]() { inner(tree).evaluate(args...); });
+          } else {
+            inner(tree).evaluate(args...);
+          }
+        }
+        group.wait();
+      }
+
+      R evaluateRule(Args... args) const {
+        auto it = interpreter.evaluators.find(rulePointer());
+        if (it == interpreter.evaluators.end()) {
+          if (interpreter.defaultEvaluator) {
+            return interpreter.defaultEvaluator(*this, args...);
+          }
+          throw InterpreterError(syntax());
+        }
+        return it->second(*this, args...);
+      }
 
     public:
       Expression(const Interpreter<R, Args...> &i, std::shared_ptr<SyntaxTree> s)
           : interpreter(i), syntaxTree(s) {}
+      Expression(const Interpreter<R, Args...> &i, const CompactSyntaxTree::Cursor &c)
+          : interpreter(i), cursor(c) {}
 
-      auto size() const { return syntaxTree->inner.size(); }
-      auto view() const { return syntaxTree->view(); }
+      size_t size() const { return isCompact() ? cursor.size() : syntaxTree->inner.size(); }
+      std::string_view view() const { return isCompact() ? cursor.view() : syntaxTree->view(); }
       auto string() const { return std::string(view()); }
-      auto position() const { return syntaxTree->begin; }
-      auto length() const { return syntaxTree->length(); }
-      auto rule() const { return syntaxTree->rule; }
-      auto syntax() const { return syntaxTree; }
+      size_t position() const { return isCompact() ? cursor.begin() : syntaxTree->begin; }
+      size_t length() const { return isCompact() ? cursor.length() : syntaxTree->length(); }
+      auto rule() const { return isCompact() ? cursor.rule() : syntaxTree->rule; }
+      /** For compact trees, the `SyntaxTree` is recreated on every call */
+      auto syntax() const {
+        return isCompact() ? cursor.compactTree().expand(cursor) : syntaxTree;
+      }
+      template <class T> T number(int base = 10) const { return parseNumber<T>(view(), base); }
 
       Expression operator[](size_t idx) const {
-        return interpreter.interpret(syntaxTree->inner[idx]);
+        if (isCompact()) {
+          return interpreter.interpret(cursor[idx]);
+        }
+        return inner(syntaxTree->inner[idx]);
       }
       std::optional<Expression> operator[](std::string_view name) const {
+        if (isCompact()) {
+          for (auto e : *this) {
+            if (e.rulePointer()->name == name) {
+              return e;
+            }
+          }
+          return {};
+        }
         auto it = std::find_if(syntaxTree->inner.begin(), syntaxTree->inner.end(),
                                [name](auto st) { return st->rule->name == name; });
         if (it != syntaxTree->inner.end()) {
-          return interpreter.interpret(*it);
+          return inner(*it);
         }
         return {};
       }
@@ -72,31 +214,36 @@ namespace peg_parser {
 
       template <class R2, typename... Args2>
       auto evaluateBy(const Interpreter<R2, Args2...> &interpreter, Args2... args) const {
+        if (isCompact()) {
+          return interpreter.interpret(cursor).evaluate(args...);
+        }
         return interpreter.evaluate(syntaxTree, args...);
       }
 
       R evaluate(Args... args) const {
-        auto it = interpreter.evaluators.find(syntaxTree->rule.get());
-        if (it == interpreter.evaluators.end()) {
-          if (interpreter.defaultEvaluator) {
-            return interpreter.defaultEvaluator(*this, args...);
+        // memoized results are copied, so `R` may also be move-only as long as no rule is pure
+        if constexpr (std::is_copy_constructible<R>::value) {
+          if (!isCompact() && !interpreter.pureRules.empty()) {
+            return evaluateMemoized(args...);
           }
-          throw InterpreterError(syntaxTree);
         }
-        return it->second(*this, args...);
+        return evaluateRule(args...);
       }
     };
 
   private:
     std::unordered_map<grammar::Rule *, Callback> evaluators;
+    std::unordered_set<const grammar::Rule *> pureRules;
+    std::unordered_set<const grammar::Rule *> parallelRules;
 
     static R __defaultEvaluator(const Expression &e, Args... args) {
       size_t N = e.size();
       if (N > 0) {
-        for (size_t i = 0; i < N - 1; ++i) {
-          e[i].evaluate(std::forward<Args>(args)...);
+        auto it = e.begin();
+        for (size_t i = 0; i < N - 1; ++i, ++it) {
+          (*it).evaluate(std::forward<Args>(args)...);
         }
-        return e[N - 1].evaluate(std::forward<Args>(args)...);
+        return (*it).evaluate(std::forward<Args>(args)...);
       }
       if (!std::is_same<R, void>::value) {
         throw InterpreterError(e.syntax());
@@ -131,6 +278,41 @@ namespace peg_parser {
       }
     }
 
+    /**
+     * Marks the results of `rule` as depending on its syntax tree only, not on other state or the
+     * arguments. Each tree of a pure rule is then evaluated once per evaluation, even if it is
+     * shared or evaluated several times by its parent. Compact trees are not memoized.
+     */
+    void setPure(const std::shared_ptr<grammar::Rule> &rule, bool pure = true) {
+      static_assert(std::is_copy_constructible<R>::value,
+                    "pure rules require a copyable result type");
+      if (pure) {
+        pureRules.insert(rule.get());
+      } else {
+        pureRules.erase(rule.get());
+      }
+    }
+
+    /** pool evaluating the trees of parallel rules, created by `setParallel` if not set */
+    std::shared_ptr<ThreadPool> threadPool;
+    /** inner trees shorter than this many bytes are evaluated on the current thread */
+    size_t minParallelLength = 1024;
+
+    /**
+     * Evaluates the inner trees of pure rules within trees of `rule` concurrently before calling
+     * its callback, which receives their memoized results, see `setPure`.
+     */
+    void setParallel(const std::shared_ptr<grammar::Rule> &rule, bool parallel = true) {
+      if (parallel) {
+        if (!threadPool) {
+          threadPool = std::make_shared<ThreadPool>();
+        }
+        parallelRules.insert(rule.get());
+      } else {
+        parallelRules.erase(rule.get());
+      }
+    }
+
     Expression interpret(const std::shared_ptr<SyntaxTree> &tree) const {
       return Expression{*this, tree};
     }
@@ -138,6 +320,14 @@ namespace peg_parser {
     R evaluate(const std::shared_ptr<SyntaxTree> &tree, Args... args) const {
       return interpret(tree).evaluate(args...);
     }
+
+    Expression interpret(const CompactSyntaxTree::Cursor &cursor) const {
+      return Expression{*this, cursor};
+    }
+
+    R evaluate(const CompactSyntaxTree &tree, Args... args) const {
+      return interpret(tree.root()).evaluate(args...);
+    }
   };
 
   class SyntaxError : public std::exception {
@@ -146,8 +336,10 @@ namespace peg_parser {
 
   public:
     std::shared_ptr<SyntaxTree> syntax;
+    std::vector<std::string> expected;
 
-    SyntaxError(const std::shared_ptr<SyntaxTree> &t) : syntax(t) {}
+    SyntaxError(const std::shared_ptr<SyntaxTree> &t, std::vector<std::string> e = {})
+        : syntax(t), expected(std::move(e)) {}
     const char *what() const noexcept override;
   };
 
@@ -169,9 +361,29 @@ namespace peg_parser {
     }
 
     R run(const std::string_view &str, Args &&...args) const {
-      auto parsed = parser.parseAndGetError(str);
+      return evaluate(str, parser.parseAndGetError(str), std::forward<Args>(args)...);
+    }
+
+    /** Runs `str` reusing the parser memory of `context`, see `Parser::Context` */
+    R run(const std::string_view &str, Parser::Context &context, Args &&...args) const {
+      return evaluate(str, parser.parseAndGetError(str, context), std::forward<Args>(args)...);
+    }
+
+    /**
+     * Starts parsing `str` in slices, see `Parser::Resumable`. Once `resume` returns true, the
+     * parse is evaluated by `run(parse)`.
+     */
+    Parser::Resumable start(const std::string_view &str) const { return parser.start(str); }
+
+    /** Evaluates a finished resumable parse, throwing a `SyntaxError` like `run` */
+    R run(const Parser::Resumable &parse, Args &&...args) const {
+      return evaluate(parse.input(), parse.result(), std::forward<Args>(args)...);
+    }
+
+  private:
+    R evaluate(const std::string_view &str, const Parser::Result &parsed, Args &&...args) const {
       if (!parsed.syntax->valid || parsed.syntax->end < str.size()) {
-        throw SyntaxError(parsed.error);
+        throw SyntaxError(parsed.error, parsed.expected);
       }
       return interpret(parsed.syntax).evaluate(std::forward<Args>(args)...);
     }
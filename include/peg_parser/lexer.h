@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "automaton.h"
+#include "grammar.h"
+
+namespace peg_parser {
+
+  namespace grammar {
+
+    /** Text matched by a token rule of a `Lexer` */
+    struct Token {
+      uint32_t begin;
+      uint32_t end;
+      /** index of the token rule, see `Lexer::getRule` */
+      uint32_t rule;
+    };
+
+    /**
+     * Splits the input into tokens in a single pass before parsing, so that token rules only
+     * look up the token at the current position instead of matching their nodes. At each position
+     * the longest token is taken, preferring the earlier rule on ties. Input that does not begin
+     * a token is skipped by the lexer and left to the other rules, which still match characters.
+     * Consecutive separators are combined into a single token, so a repeated separator rule takes
+     * a single step.
+     *
+     * Token rules only match whole tokens, for instance an identifier rule does not match the
+     * beginning of a longer keyword, and never match empty input.
+     */
+    class Lexer {
+    public:
+      /**
+       * Creates a lexer for the regular rules `tokens` and, if set, `separator`, and sets their
+       * `Rule::lexer`. Throws `std::invalid_argument` if one of the rules is not regular, see
+       * `Automaton`. Must be created again after changing the nodes of any of the rules.
+       */
+      static std::shared_ptr<const Lexer> create(
+          const std::vector<std::shared_ptr<Rule>> &tokens,
+          const std::shared_ptr<Rule> &separator = nullptr);
+
+      /** Replaces `tokens` by the tokens of `string`, throws `std::length_error` above 4 GiB */
+      void tokenize(std::string_view string, std::vector<Token> &tokens) const;
+      std::vector<Token> tokenize(std::string_view string) const;
+
+      /** The rule matching `token`, only used to identify it */
+      const Rule *getRule(const Token &token) const { return rules[token.rule]; }
+
+      /** Removes the lexer from its rules, which match their nodes again */
+      void release() const;
+
+    private:
+      std::vector<const Rule *> rules;
+      std::vector<std::shared_ptr<const Automaton>> automata;
+      /** the separator is the last rule if set */
+      bool hasSeparator = false;
+      /** the rules themselves own the lexer, which therefore does not own them */
+      std::vector<std::weak_ptr<Rule>> owners;
+    };
+
+  }  // namespace grammar
+
+}  // namespace peg_parser
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <ostream>
+
+#include "grammar.h"
+
+namespace peg_parser {
+
+  namespace grammar {
+
+    struct OptimizationStatistics {
+      size_t rules = 0;
+      size_t nodesBefore = 0;
+      size_t nodesAfter = 0;
+    };
+
+    std::ostream &operator<<(std::ostream &stream, const OptimizationStatistics &statistics);
+
+    /**
+     * Returns an equivalent, usually smaller node graph. Nested sequences and choices are
+     * flattened, adjacent words merged, choices of letters converted to character sets, common
+     * prefixes of choice alternatives factored out and no-op nodes removed. Rule boundaries are
+     * kept, so the resulting syntax trees are unchanged. Nodes are never modified in place.
+     */
+    Node::Shared optimize(const Node::Shared &node);
+
+    /** Optimizes the nodes of `start` and all rules reachable from it in place. */
+    OptimizationStatistics optimize(const std::shared_ptr<Rule> &start);
+
+  }  // namespace grammar
+
+}  // namespace peg_parser
@@ -1,6 +1,11 @@
 #pragma once
 
+#include <chrono>
+#include <limits>
 #include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <vector>
 
 #include "grammar.h"
 
@@ -15,18 +20,83 @@ namespace peg_parser {
     bool valid = false;
     bool active = true;
     bool recursive = false;
+    bool recovered = false;
 
     SyntaxTree(const std::shared_ptr<grammar::Rule> &r, std::string_view s, size_t p);
+    /** Releases inner trees iteratively, so deeply nested trees cannot overflow the stack */
+    ~SyntaxTree();
 
     size_t length() const { return end - begin; }
     std::string_view view() const { return fullString.substr(begin, length()); }
     std::string string() const { return std::string(view()); }
   };
 
+  /**
+   * Limits of a single parse. Exceeding them throws a `Parser::LimitError`. All but `depth` are
+   * unlimited by default.
+   */
+  struct ParseLimits {
+    /** maximum number of nested rules */
+    size_t depth = 10000;
+    /** maximum number of grammar nodes and rules visited */
+    size_t steps = std::numeric_limits<size_t>::max();
+    /** maximum number of syntax trees created, including ones discarded when backtracking */
+    size_t syntaxTrees = std::numeric_limits<size_t>::max();
+    /** maximum number of results added to the packrat cache */
+    size_t cacheEntries = std::numeric_limits<size_t>::max();
+    /** maximum number of bytes allocated for syntax trees and cache entries, estimated */
+    size_t memory = std::numeric_limits<size_t>::max();
+    /** maximum time spent parsing, checked every few thousand steps */
+    std::chrono::steady_clock::duration time = std::chrono::steady_clock::duration::max();
+  };
+
   struct Parser {
     struct Result {
       std::shared_ptr<SyntaxTree> syntax;
+      /** ends at the furthest position the parser failed at */
       std::shared_ptr<SyntaxTree> error;
+      /** rules and terminals that would have allowed the parser to continue at the error */
+      std::vector<std::string> expected;
+    };
+
+    struct Error {
+      std::shared_ptr<SyntaxTree> syntax;
+      std::vector<std::string> expected;
+    };
+
+    struct Match {
+      bool valid;
+      size_t end;
+    };
+
+    /**
+     * Rules that create syntax trees when parsing with `parse(str, captures)`. Created by
+     * `createCaptures`.
+     */
+    struct Captures {
+      /** rules added to the syntax tree */
+      std::unordered_set<const grammar::Rule *> captured;
+      /**
+       * captured rules and all rules that may contain them. Rules that are not captured are
+       * replaced by their inner trees.
+       */
+      std::unordered_set<const grammar::Rule *> trees;
+    };
+
+    /**
+     * Receives the syntax tree of a parse as a sequence of events, see `parse(str, events)`.
+     * Hidden rules are not reported.
+     */
+    struct EventHandler {
+      virtual void enter(const grammar::Rule &rule, size_t begin) = 0;
+      virtual void exit(const grammar::Rule &rule, size_t begin, size_t end) = 0;
+      virtual ~EventHandler() {}
+    };
+
+    struct RecoveryResult {
+      /** contains everything but the input skipped after errors */
+      std::shared_ptr<SyntaxTree> syntax;
+      std::vector<Error> errors;
     };
 
     struct GrammarError : std::exception {
@@ -37,18 +107,164 @@ namespace peg_parser {
       const char *what() const noexcept override;
     };
 
+    struct LimitError : std::exception {
+      enum Type { DEPTH, STEPS, SYNTAX_TREES, CACHE_ENTRIES, MEMORY, TIME } type;
+      /** the exceeded limit, in microseconds for `TIME` */
+      size_t limit;
+      mutable std::string buffer;
+      LimitError(Type t, size_t l) : type(t), limit(l) {}
+      const char *what() const noexcept override;
+    };
+
+    /**
+     * Memory kept between parses using the same context, such as the cache buckets and the parser
+     * stack, so that parsing many short inputs barely allocates. A context can only be used by one
+     * parse at a time, for instance by creating one per thread.
+     */
+    class Context {
+    public:
+      Context();
+      ~Context();
+
+    private:
+      struct Storage;
+      std::unique_ptr<Storage> storage;
+      friend struct Parser;
+    };
+
+    /**
+     * Parse that runs in slices of a limited number of steps, so that a single thread can
+     * interleave many parses without waiting for a long one. Created by `Parser::start` and
+     * finished like `parseAndGetError`, including the second parse locating an error. The
+     * time limit includes the time the parse is suspended.
+     */
+    class Resumable {
+    public:
+      Resumable(Resumable &&);
+      Resumable &operator=(Resumable &&);
+      ~Resumable();
+
+      /**
+       * Continues parsing for about `steps` more steps, stopping before the next grammar node.
+       * Returns true once the parse has finished. Rethrows the errors of the parse, which is
+       * finished afterwards.
+       */
+      bool resume(size_t steps);
+      bool finished() const;
+      std::string_view input() const;
+      /** Throws `std::logic_error` unless the parse has finished successfully */
+      const Result &result() const;
+
+    private:
+      struct Process;
+      std::unique_ptr<Process> process;
+      explicit Resumable(std::unique_ptr<Process> p);
+      friend struct Parser;
+    };
+
+    /** How `parseParallel` splits an input into chunks that are parsed concurrently */
+    struct Chunking {
+      /** items may begin right after a match of `boundary`, such as a line break */
+      grammar::Node::Shared boundary;
+      /** number of chunks parsed at once, the number of hardware threads if 0 */
+      size_t threads = 0;
+      /** chunks are not made shorter than this many bytes */
+      size_t minLength = 1 << 16;
+    };
+
     std::shared_ptr<grammar::Rule> grammar;
+    ParseLimits limits;
 
     Parser(const std::shared_ptr<grammar::Rule> &grammar
            = std::make_shared<grammar::Rule>("undefined", grammar::Node::Error()));
 
+    /**
+     * Parses `str` and, if it cannot be parsed completely, parses it a second time to locate the
+     * error. Successful parses pay nothing for error reporting.
+     */
     static Result parseAndGetError(const std::string_view &str,
-                                   std::shared_ptr<grammar::Rule> grammar);
+                                   std::shared_ptr<grammar::Rule> grammar,
+                                   const ParseLimits &limits = ParseLimits());
     static std::shared_ptr<SyntaxTree> parse(const std::string_view &str,
-                                             std::shared_ptr<grammar::Rule> grammar);
+                                             std::shared_ptr<grammar::Rule> grammar,
+                                             const ParseLimits &limits = ParseLimits());
+
+    /**
+     * Parses `str` in a single pass, recovering from errors in rules that define a `recovery`
+     * synchronization point. An error is added whenever the parser recovers, and if the input
+     * could not be parsed completely nevertheless.
+     */
+    static RecoveryResult parseWithRecovery(const std::string_view &str,
+                                            std::shared_ptr<grammar::Rule> grammar,
+                                            const ParseLimits &limits = ParseLimits());
+
+    /**
+     * Matches `str` without creating any syntax trees. Filters receive a syntax tree without inner
+     * trees.
+     */
+    static Match recognize(const std::string_view &str, std::shared_ptr<grammar::Rule> grammar,
+                           const ParseLimits &limits = ParseLimits());
+
+    /**
+     * Parses `str`, only adding the captured rules to the syntax tree. Rules that cannot contain
+     * a captured rule do not create any syntax trees. The start rule is always returned.
+     */
+    static std::shared_ptr<SyntaxTree> parse(const std::string_view &str,
+                                             std::shared_ptr<grammar::Rule> grammar,
+                                             const Captures &captures,
+                                             const ParseLimits &limits = ParseLimits());
+
+    /**
+     * Parses `str`, passing each rule to `events` as soon as the parser can no longer backtrack
+     * past it. Only the rules that may still be backtracked are kept in memory, so for grammars
+     * consisting of repetitions memory usage is proportional to the nesting depth rather than
+     * the input size. Events are only complete if the returned match is valid.
+     */
+    static Match parse(const std::string_view &str, std::shared_ptr<grammar::Rule> grammar,
+                       EventHandler &events, const ParseLimits &limits = ParseLimits());
+
+    /** Counterparts of `parse` and `parseAndGetError` reusing the memory of `context` */
+    static std::shared_ptr<SyntaxTree> parse(const std::string_view &str,
+                                             std::shared_ptr<grammar::Rule> grammar,
+                                             Context &context,
+                                             const ParseLimits &limits = ParseLimits());
+    static Result parseAndGetError(const std::string_view &str,
+                                   std::shared_ptr<grammar::Rule> grammar, Context &context,
+                                   const ParseLimits &limits = ParseLimits());
+
+    /** Starts a parse of `str` that is run by `Resumable::resume`, `str` must outlive it */
+    static Resumable start(const std::string_view &str, std::shared_ptr<grammar::Rule> grammar,
+                           const ParseLimits &limits = ParseLimits());
+
+    /**
+     * Parses `str` with a start rule of the form `item*` on several threads and returns the same
+     * syntax tree as `parse`. The input is split behind matches of the boundary and the items of
+     * each chunk are parsed from there. Items misaligned with a split are parsed again after the
+     * preceding item until they meet one of the chunk. The limits apply to each chunk. Throws
+     * `std::invalid_argument` if `grammar` is not a repetition or no boundary is given.
+     */
+    static std::shared_ptr<SyntaxTree> parseParallel(const std::string_view &str,
+                                                     std::shared_ptr<grammar::Rule> grammar,
+                                                     const Chunking &chunking,
+                                                     const ParseLimits &limits = ParseLimits());
+
+    /** Captures `rules` and rules that may contain them when parsing from `grammar` */
+    static Captures createCaptures(const std::shared_ptr<grammar::Rule> &grammar,
+                                   const std::vector<std::shared_ptr<grammar::Rule>> &rules);
 
     std::shared_ptr<SyntaxTree> parse(const std::string_view &str) const;
     Result parseAndGetError(const std::string_view &str) const;
+    RecoveryResult parseWithRecovery(const std::string_view &str) const;
+    Match recognize(const std::string_view &str) const;
+    std::shared_ptr<SyntaxTree> parse(const std::string_view &str,
+                                      const Captures &captures) const;
+    Match parse(const std::string_view &str, EventHandler &events) const;
+    std::shared_ptr<SyntaxTree> parse(const std::string_view &str, Context &context) const;
+    Result parseAndGetError(const std::string_view &str, Context &context) const;
+    std::shared_ptr<SyntaxTree> parseParallel(const std::string_view &str,
+                                              const Chunking &chunking) const;
+    Resumable start(const std::string_view &str) const;
+    Captures createCaptures(const std::vector<std::shared_ptr<grammar::Rule>> &rules) const;
   };
 
   std::ostream &operator<<(std::ostream &stream, const SyntaxTree &tree);
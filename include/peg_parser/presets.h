@@ -12,11 +12,35 @@ namespace peg_parser {
     std::function<char(char)> defaultEscapeCodeCallback();
     Program<char> createCharacterProgram(const std::function<char(char)> escapeCodeCallback
                                          = defaultEscapeCodeCallback());
-    Program<std::string> createStringProgram(const std::string &open, const std::string &close);
+    Program<std::string> createStringProgram(const std::string &open, const std::string &close,
+                                             const std::function<char(char)> escapeCodeCallback
+                                             = defaultEscapeCodeCallback());
+
+    /**
+     * Like `createStringProgram`, but returns a view into the input if the string contains no
+     * escape sequences. Otherwise the string is decoded into the buffer argument, which is reused
+     * between runs, and a view of the buffer is returned.
+     */
+    Program<std::string_view, std::string &> createStringViewProgram(
+        const std::string &open, const std::string &close,
+        const std::function<char(char)> escapeCodeCallback = defaultEscapeCodeCallback());
 
     using RuleGetter = const std::function<grammar::Node::Shared(const std::string_view &)> &;
     using GrammarProgram = Program<grammar::Node::Shared, RuleGetter &>;
     GrammarProgram createPEGProgram();
+
+    /** Immutable PEG program shared by all parser generators, created on first use. */
+    const GrammarProgram &getPEGProgram();
+
+    /**
+     * Parses a PEG expression using the shared PEG program. Syntax trees of the most recently
+     * parsed valid expressions are cached process-wide, so identical grammar text is usually only
+     * parsed once.
+     */
+    grammar::Node::Shared parsePEGExpression(const std::string_view &grammar, RuleGetter getRule);
+
+    /** Removes all cached PEG syntax trees. */
+    void clearPEGExpressionCache();
   }  // namespace presets
 
 }  // namespace peg_parser
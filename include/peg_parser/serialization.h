@@ -0,0 +1,47 @@
+#pragma once
+
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "grammar.h"
+
+namespace peg_parser {
+
+  namespace serialization {
+
+    /**
+     * A finalized grammar. `rules` are the named rules that are resolved by name when loading,
+     * all other rules reachable from `start` or `separator` are stored anonymously.
+     */
+    struct Grammar {
+      std::vector<std::shared_ptr<grammar::Rule>> rules;
+      std::shared_ptr<grammar::Rule> start;
+      grammar::Node::Shared separator;
+      /** anonymous rules created when loading, kept alive for weak references */
+      std::vector<std::shared_ptr<grammar::Rule>> internalRules;
+    };
+
+    struct SerializationError : public std::runtime_error {
+      using std::runtime_error::runtime_error;
+    };
+
+    using NamedRuleGetter
+        = std::function<std::shared_ptr<grammar::Rule>(const std::string_view &name)>;
+
+    /** Encodes the grammar into a compact binary blob. Filter nodes cannot be serialized. */
+    std::string save(const Grammar &grammar);
+
+    /**
+     * Decodes a blob created by `save`. Named rules are obtained from `getRule`, so evaluators
+     * attached to existing rules of the same name stay valid.
+     */
+    Grammar load(std::string_view data, const NamedRuleGetter &getRule = NamedRuleGetter());
+
+    /** Maps the file at `path` into memory and decodes it with `load`. */
+    Grammar loadFile(const std::string &path, const NamedRuleGetter &getRule = NamedRuleGetter());
+
+  }  // namespace serialization
+
+}  // namespace peg_parser
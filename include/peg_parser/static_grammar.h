@@ -0,0 +1,512 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "interpreter.h"
+
+namespace peg_parser {
+
+  /**
+   * Grammars defined at compile time as C++ types. Matching code is generated per rule, so the
+   * compiler can inline and specialize it, while the resulting `SyntaxTree`s have the same shape
+   * as the ones created by `Parser` and can be evaluated by an `Interpreter`.
+   *
+   *     struct Sum;
+   *     struct Number : Rule<Number, OneOrMore<Range<'0', '9'>>> {
+   *       static constexpr auto name = "Number";
+   *     };
+   *     struct Add : Rule<Add, Sequence<Ref<Sum>, Char<'+'>, Ref<Number>>> {
+   *       static constexpr auto name = "Add";
+   *     };
+   *     struct Sum : Rule<Sum, Choice<Ref<Add>, Ref<Number>>> {
+   *       static constexpr auto name = "Sum";
+   *       static constexpr bool leftRecursive = true;
+   *     };
+   *
+   * Left recursion is only supported through rules that declare `leftRecursive`. Results of rules
+   * are memoized per position unless they declare `cacheable = false`.
+   */
+  namespace static_grammar {
+
+    class State {
+    public:
+      struct Saved {
+        size_t position;
+        size_t innerCount;
+      };
+
+      struct Growing {
+        const grammar::Rule *rule;
+        size_t position;
+        std::shared_ptr<SyntaxTree> seed;
+      };
+
+      struct MemoKey {
+        const grammar::Rule *rule;
+        size_t position;
+        bool operator==(const MemoKey &other) const {
+          return rule == other.rule && position == other.position;
+        }
+      };
+
+      struct MemoHash {
+        size_t operator()(const MemoKey &key) const {
+          return std::hash<const void *>()(key.rule) ^ (key.position * 0x9e3779b97f4a7c15ull);
+        }
+      };
+
+      struct Memoized {
+        std::shared_ptr<SyntaxTree> tree;
+        /** furthest position reached while parsing the tree */
+        size_t maxPosition;
+      };
+
+      static constexpr size_t noSeed = std::numeric_limits<size_t>::max();
+
+      std::string_view string;
+      size_t position = 0;
+      size_t maxPosition = 0;
+      std::vector<std::shared_ptr<SyntaxTree>> *inner = nullptr;
+      std::vector<Growing> growing;
+      /** lowest index into `growing` whose seed the current rule has used */
+      size_t seedUsed = noSeed;
+      std::unordered_map<MemoKey, Memoized, MemoHash> memo;
+      size_t depth = 0;
+      size_t maxDepth;
+
+      /** innermost rule being parsed that is not hidden */
+      const SyntaxTree *context = nullptr;
+      /** only set when parsing a failed input again to locate the error, see `parse` */
+      bool trackErrors = false;
+      /** expectations inside of `Not` are not reported */
+      size_t silenced = 0;
+      size_t errorPosition = 0;
+      /** incremented whenever `errorPosition` moves */
+      size_t errorGeneration = 0;
+      std::shared_ptr<grammar::Rule> errorRule;
+      size_t errorBegin = 0;
+      std::vector<std::string> expected;
+
+      State(std::string_view s, size_t d = ParseLimits().depth) : string(s), maxDepth(d) {}
+
+      bool isAtEnd() const { return position >= string.size(); }
+      grammar::Letter current() const { return string[position]; }
+
+      void advance(size_t amount = 1) {
+        position += amount;
+        maxPosition = std::max(maxPosition, position);
+      }
+
+      Saved save() const { return Saved{position, inner ? inner->size() : 0}; }
+
+      void load(const Saved &saved) {
+        if (inner) {
+          inner->resize(saved.innerCount);
+        }
+        position = saved.position;
+      }
+
+      Growing *findGrowing(const grammar::Rule *rule, size_t p) {
+        for (auto &g : growing) {
+          if (g.rule == rule && g.position == p) {
+            seedUsed = std::min(seedUsed, size_t(&g - growing.data()));
+            return &g;
+          }
+        }
+        return nullptr;
+      }
+
+      void addInnerSyntaxTree(const std::shared_ptr<SyntaxTree> &tree) {
+        if (inner && !tree->rule->hidden) {
+          inner->push_back(tree);
+        }
+      }
+
+      /** Records that `T` failed to match at the current position */
+      template <class T> void fail() {
+        if (trackErrors) {
+          expect(position, T::expectation());
+        }
+      }
+
+      void expect(size_t p, std::string expectation) {
+        if (silenced > 0 || p < errorPosition) {
+          return;
+        }
+        if (p > errorPosition || errorGeneration == 0) {
+          errorPosition = p;
+          expected.clear();
+          ++errorGeneration;
+          setErrorContext();
+        }
+        expected.push_back(std::move(expectation));
+      }
+
+      /** Replaces everything expected inside of `rule`, which failed at `errorPosition` */
+      void failRule(const std::shared_ptr<grammar::Rule> &rule, size_t previousGeneration,
+                    size_t previousCount) {
+        if (errorGeneration == previousGeneration) {
+          if (expected.size() == previousCount) {
+            return;
+          }
+          expected.resize(previousCount);
+        } else {
+          expected.clear();
+        }
+        if (!rule->hidden) {
+          setErrorContext();
+          expected.push_back(rule->name);
+        }
+      }
+
+      void setErrorContext() {
+        if (context) {
+          errorRule = context->rule;
+          errorBegin = context->begin;
+        } else {
+          errorRule.reset();
+        }
+      }
+    };
+
+    struct Any {
+      static std::string expectation() { return "any character"; }
+      static bool match(State &s) {
+        if (s.isAtEnd()) {
+          s.fail<Any>();
+          return false;
+        }
+        s.advance();
+        return true;
+      }
+    };
+
+    template <grammar::Letter A, grammar::Letter B> struct Range {
+      static std::string expectation() { return std::string{'[', A, '-', B, ']'}; }
+      static bool match(State &s) {
+        if (s.isAtEnd() || s.current() < A || s.current() > B) {
+          s.fail<Range>();
+          return false;
+        }
+        s.advance();
+        return true;
+      }
+    };
+
+    template <grammar::Letter... Cs> struct Literal {
+      static std::string expectation() { return std::string{'\'', Cs..., '\''}; }
+      static bool match(State &s) {
+        constexpr grammar::Letter word[] = {Cs..., '\0'};
+        constexpr size_t length = sizeof...(Cs);
+        if (s.string.size() - s.position < length
+            || s.string.compare(s.position, length, word, length) != 0) {
+          s.fail<Literal>();
+          return false;
+        }
+        s.advance(length);
+        return true;
+      }
+    };
+
+    template <grammar::Letter C> using Char = Literal<C>;
+
+    struct Empty {
+      static bool match(State &) { return true; }
+    };
+
+    struct EndOfFile {
+      static std::string expectation() { return "end of input"; }
+      static bool match(State &s) {
+        if (!s.isAtEnd()) {
+          s.fail<EndOfFile>();
+          return false;
+        }
+        return true;
+      }
+    };
+
+    template <class... Ts> struct Sequence {
+      static bool match(State &s) {
+        auto saved = s.save();
+        if ((Ts::match(s) && ...)) {
+          return true;
+        }
+        s.load(saved);
+        return false;
+      }
+    };
+
+    template <class... Ts> struct Choice {
+      static bool match(State &s) { return (Ts::match(s) || ...); }
+    };
+
+    template <class T> struct ZeroOrMore {
+      static bool match(State &s) {
+        while (T::match(s)) {
+        }
+        return true;
+      }
+    };
+
+    template <class T> struct OneOrMore {
+      static bool match(State &s) {
+        if (!T::match(s)) {
+          return false;
+        }
+        while (T::match(s)) {
+        }
+        return true;
+      }
+    };
+
+    template <class T> struct Optional {
+      static bool match(State &s) {
+        T::match(s);
+        return true;
+      }
+    };
+
+    template <class T> struct Also {
+      static bool match(State &s) {
+        auto saved = s.save();
+        auto result = T::match(s);
+        s.load(saved);
+        return result;
+      }
+    };
+
+    template <class T> struct Not {
+      static bool match(State &s) {
+        auto saved = s.save();
+        ++s.silenced;
+        auto result = T::match(s);
+        --s.silenced;
+        s.load(saved);
+        return !result;
+      }
+    };
+
+    /** Reference to a rule type, which may be incomplete at the point of use */
+    template <class R> struct Ref {
+      static bool match(State &s) { return R::parseRule(s)->valid; }
+    };
+
+    /**
+     * Base of rule types. `Self` must provide a `name` and may set `hidden`, `leftRecursive` or
+     * `cacheable`.
+     */
+    template <class Self, class Body> struct Rule {
+      static constexpr bool hidden = false;
+      static constexpr bool leftRecursive = false;
+      static constexpr bool cacheable = true;
+
+      /** Rule object used for the syntax trees and as key for evaluators */
+      static const std::shared_ptr<grammar::Rule> &rule() {
+        static const std::shared_ptr<grammar::Rule> instance = [] {
+          auto rule = grammar::makeRule(Self::name, grammar::Node::Error());
+          rule->hidden = Self::hidden;
+          return rule;
+        }();
+        return instance;
+      }
+
+      static bool match(State &s) { return parseRule(s)->valid; }
+
+      static std::shared_ptr<SyntaxTree> parseBody(State &s) {
+        auto tree = std::make_shared<SyntaxTree>(rule(), s.string, s.position);
+        auto parent = s.inner;
+        auto parentContext = s.context;
+        auto outerMaxPosition = s.maxPosition;
+        auto errorGeneration = s.errorGeneration;
+        auto errorCount = s.expected.size();
+        s.inner = &tree->inner;
+        if (!Self::hidden) {
+          s.context = tree.get();
+        }
+        s.maxPosition = tree->begin;
+        tree->valid = Body::match(s);
+        s.inner = parent;
+        s.context = parentContext;
+        tree->active = false;
+        if (tree->valid) {
+          tree->end = s.position;
+        } else {
+          tree->end = s.maxPosition;
+          s.position = tree->begin;
+          // the start rule keeps the expectations of its body
+          if (s.trackErrors && s.silenced == 0 && s.errorPosition == tree->begin && s.depth > 1) {
+            s.failRule(rule(), errorGeneration, errorCount);
+          }
+        }
+        s.maxPosition = std::max(outerMaxPosition, s.maxPosition);
+        return tree;
+      }
+
+      static std::shared_ptr<SyntaxTree> parseRule(State &s) {
+        if (++s.depth > s.maxDepth) {
+          throw Parser::LimitError(Parser::LimitError::DEPTH, s.maxDepth);
+        }
+        std::shared_ptr<SyntaxTree> tree;
+        if constexpr (Self::cacheable) {
+          tree = parseMemoized(s);
+        } else {
+          tree = parseUncached(s);
+        }
+        --s.depth;
+        if (tree->valid) {
+          s.addInnerSyntaxTree(tree);
+        }
+        return tree;
+      }
+
+    private:
+      static std::shared_ptr<SyntaxTree> parseUncached(State &s) {
+        if constexpr (Self::leftRecursive) {
+          return parseLeftRecursion(s);
+        } else {
+          return parseBody(s);
+        }
+      }
+
+      /**
+       * Reuses the result of a previous parse at the same position. Results that depend on the
+       * seed of a left recursive rule which is still growing are not memoized.
+       */
+      static std::shared_ptr<SyntaxTree> parseMemoized(State &s) {
+        State::MemoKey key{rule().get(), s.position};
+        auto it = s.memo.find(key);
+        if (it != s.memo.end()) {
+          auto &tree = it->second.tree;
+          s.position = tree->valid ? tree->end : tree->begin;
+          s.maxPosition = std::max(s.maxPosition, it->second.maxPosition);
+          return tree;
+        }
+
+        auto outerMaxPosition = s.maxPosition;
+        auto outerSeedUsed = s.seedUsed;
+        s.maxPosition = s.position;
+        s.seedUsed = State::noSeed;
+        auto tree = parseUncached(s);
+        if (s.seedUsed >= s.growing.size()) {
+          s.memo.emplace(key, State::Memoized{tree, s.maxPosition});
+          s.seedUsed = outerSeedUsed;
+        } else {
+          s.seedUsed = std::min(outerSeedUsed, s.seedUsed);
+        }
+        s.maxPosition = std::max(outerMaxPosition, s.maxPosition);
+        return tree;
+      }
+
+      /** Grows the seed of a left recursive rule until it stops consuming more input */
+      static std::shared_ptr<SyntaxTree> parseLeftRecursion(State &s) {
+        auto begin = s.position;
+        if (auto growing = s.findGrowing(rule().get(), begin)) {
+          if (growing->seed) {
+            s.position = growing->seed->end;
+            return growing->seed;
+          }
+          auto failed = std::make_shared<SyntaxTree>(rule(), s.string, begin);
+          failed->active = false;
+          failed->recursive = true;
+          return failed;
+        }
+
+        auto index = s.growing.size();
+        s.growing.push_back(State::Growing{rule().get(), begin, nullptr});
+        std::shared_ptr<SyntaxTree> result;
+        while (true) {
+          s.position = begin;
+          auto tree = parseBody(s);
+          if (!tree->valid || (result && tree->end <= result->end)) {
+            break;
+          }
+          result = s.growing[index].seed = tree;
+        }
+        s.growing.pop_back();
+
+        if (result) {
+          s.position = result->end;
+          return result;
+        }
+        s.position = begin;
+        auto failed = std::make_shared<SyntaxTree>(rule(), s.string, begin);
+        failed->active = false;
+        return failed;
+      }
+    };
+
+    /**
+     * Parses `str` starting with the rule type `Start`. If it cannot be parsed completely, it is
+     * parsed a second time to locate the error, like `Parser::parseAndGetError`. Only the `depth`
+     * of the limits applies.
+     */
+    template <class Start>
+    Parser::Result parse(std::string_view str, const ParseLimits &limits = ParseLimits()) {
+      State state(str, limits.depth);
+      auto result = Start::parseRule(state);
+      if (result->valid && result->end == str.size()) {
+        return Parser::Result{result, result, {}};
+      }
+
+      State errors(str, limits.depth);
+      errors.trackErrors = true;
+      result = Start::parseRule(errors);
+      if (result->valid && errors.errorPosition <= result->end) {
+        errors.expect(result->end, EndOfFile::expectation());
+      }
+      Parser::Result parsed{result, result, {}};
+      if (errors.errorGeneration > 0 && errors.errorPosition >= result->begin) {
+        auto rule = errors.errorRule ? errors.errorRule : result->rule;
+        auto begin = errors.errorRule ? errors.errorBegin : result->begin;
+        parsed.error = std::make_shared<SyntaxTree>(rule, str, begin);
+        parsed.error->end = errors.errorPosition;
+        for (auto &expected : errors.expected) {
+          if (std::find(parsed.expected.begin(), parsed.expected.end(), expected)
+              == parsed.expected.end()) {
+            parsed.expected.push_back(expected);
+          }
+        }
+      }
+      return parsed;
+    }
+
+    /** Counterpart of `Program` for compile-time grammars */
+    template <class Start, class R = void, typename... Args> struct Program {
+      using Expression = typename Interpreter<R, Args...>::Expression;
+
+      Interpreter<R, Args...> interpreter;
+      /** only the `depth` applies */
+      ParseLimits limits;
+
+      template <class Rule>
+      void setEvaluator(const typename Interpreter<R, Args...>::Callback &callback) {
+        interpreter.setEvaluator(Rule::rule(), callback);
+      }
+
+      std::shared_ptr<SyntaxTree> parse(const std::string_view &str) const {
+        return static_grammar::parse<Start>(str, limits).syntax;
+      }
+
+      Expression interpret(const std::shared_ptr<SyntaxTree> &tree) const {
+        if (!tree->valid) {
+          throw SyntaxError(tree);
+        }
+        return interpreter.interpret(tree);
+      }
+
+      R run(const std::string_view &str, Args &&...args) const {
+        auto parsed = static_grammar::parse<Start>(str, limits);
+        if (!parsed.syntax->valid || parsed.syntax->end < str.size()) {
+          throw SyntaxError(parsed.error, parsed.expected);
+        }
+        return interpret(parsed.syntax).evaluate(std::forward<Args>(args)...);
+      }
+    };
+
+  }  // namespace static_grammar
+
+}  // namespace peg_parser
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace peg_parser {
+
+  /**
+   * Positions of a few structural bytes of an input, such as line breaks and brackets, found in a
+   * single pass comparing 16 bytes at a time where SSE2 is available. Used before parsing a batch
+   * to split it into independent records and to reject unbalanced brackets without parsing.
+   */
+  class StructuralIndex {
+  public:
+    static constexpr size_t npos = std::string_view::npos;
+
+    /**
+     * Indexes the occurrences of `bytes` in `input`, which must outlive the index. Throws
+     * `std::length_error` above 4 GiB.
+     */
+    explicit StructuralIndex(std::string_view input, std::string_view bytes = "\n");
+
+    std::string_view input() const { return text; }
+
+    /** positions of the indexed bytes in increasing order */
+    const std::vector<uint32_t> &positions() const { return indexed; }
+
+    /** Splits the input at the indexed `separator`s, which must have been indexed */
+    std::vector<std::string_view> split(char separator = '\n') const;
+
+    /**
+     * Returns the position of the first `close` within `[begin, end)` that has not been opened
+     * before or, if there is none, of the first `open` that is never closed. Returns `npos` if
+     * the brackets are balanced. Both bytes must have been indexed.
+     */
+    size_t findUnbalanced(char open, char close, size_t begin = 0, size_t end = npos) const;
+
+  private:
+    std::string_view text;
+    std::vector<uint32_t> indexed;
+  };
+
+}  // namespace peg_parser
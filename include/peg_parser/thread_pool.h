@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace peg_parser {
+
+  /**
+   * Worker threads with a queue of tasks each. A worker runs the tasks it added itself last in
+   * first out, while idle workers steal the oldest tasks of the others. Threads waiting for a
+   * `Group` run queued tasks in the meantime, so tasks may wait for tasks they added.
+   */
+  class ThreadPool {
+  public:
+    using Task = std::function<void()>;
+
+    /** Tasks that are waited for together */
+    class Group {
+    public:
+      explicit Group(ThreadPool &pool) : pool(pool) {}
+      Group(const Group &) = delete;
+      Group &operator=(const Group &) = delete;
+      /** Waits for the remaining tasks, ignoring their errors */
+      ~Group();
+
+      void run(Task task);
+
+      /**
+       * Runs queued tasks until all tasks have finished, or blocks once none are queued anymore.
+       * Rethrows the first error of a task.
+       */
+      void wait();
+
+    private:
+      ThreadPool &pool;
+      std::atomic<size_t> pending{0};
+      std::mutex mutex;
+      /** notified once `pending` drops to zero */
+      std::condition_variable finished;
+      std::exception_ptr error;
+    };
+
+    /** Starts `threads` workers, one per hardware thread if 0 */
+    explicit ThreadPool(size_t threads = 0);
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+    ~ThreadPool();
+
+    size_t size() const { return workers.size(); }
+
+  private:
+    struct Queue {
+      std::mutex mutex;
+      std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    /** number of tasks in all queues */
+    std::atomic<size_t> queued{0};
+    /** queue of the next task added by a thread outside of the pool */
+    std::atomic<size_t> nextQueue{0};
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void push(Task task);
+    /** Runs a single queued task, returns false if there is none */
+    bool runQueued();
+    void work(size_t index);
+  };
+
+}  // namespace peg_parser
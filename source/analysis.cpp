@@ -0,0 +1,232 @@
+#include <peg_parser/analysis.h>
+
+#include <algorithm>
+#include <deque>
+#include <set>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace peg_parser::grammar;
+using Symbol = Node::Symbol;
+
+namespace {
+
+  /**  alternative to `std::get` that works on iOS < 11 */
+  template <class T, class V> const T &pget(const V &v) {
+    if (auto r = std::get_if<T>(&v)) {
+      return *r;
+    } else {
+      throw std::runtime_error("corrupted grammar node");
+    }
+  }
+
+  std::shared_ptr<Rule> getRule(const Node &node) {
+    if (node.symbol == Symbol::RULE) {
+      return pget<std::shared_ptr<Rule>>(node.data);
+    }
+    if (node.symbol == Symbol::WEAK_RULE) {
+      return pget<std::weak_ptr<Rule>>(node.data).lock();
+    }
+    return nullptr;
+  }
+
+  /** Nodes parsed as part of `node`, for precedence nodes the operand and the operators */
+  std::vector<Node::Shared> children(const Node &node) {
+    if (auto list = std::get_if<std::vector<Node::Shared>>(&node.data)) {
+      return *list;
+    }
+    if (auto child = std::get_if<Node::Shared>(&node.data)) {
+      return {*child};
+    }
+    if (auto table = std::get_if<Node::OperatorTable>(&node.data)) {
+      std::vector<Node::Shared> result{table->operand};
+      for (auto &op : table->operators) {
+        result.push_back(op.pattern);
+      }
+      return result;
+    }
+    return {};
+  }
+
+  class Analyzer {
+  private:
+    Analysis &analysis;
+    std::unordered_map<const Rule *, size_t> indices;
+    /** rules each rule may call before consuming any input */
+    std::vector<std::vector<size_t>> leftCalls;
+
+    void collectRules(const Node &node) {
+      if (auto rule = getRule(node)) {
+        if (indices.emplace(rule.get(), analysis.rules.size()).second) {
+          analysis.rules.push_back(rule);
+        }
+        return;
+      }
+      for (auto &child : children(node)) {
+        collectRules(*child);
+      }
+    }
+
+    bool isNullable(const Node &node) const {
+      switch (node.symbol) {
+        case Symbol::WORD:
+          return pget<std::string>(node.data).empty();
+        case Symbol::ANY:
+        case Symbol::RANGE:
+        case Symbol::CHARACTER_SET:
+        case Symbol::ERROR:
+          return false;
+        case Symbol::SEQUENCE: {
+          auto &list = pget<std::vector<Node::Shared>>(node.data);
+          return std::all_of(list.begin(), list.end(),
+                             [this](auto &child) { return isNullable(*child); });
+        }
+        case Symbol::CHOICE: {
+          auto &list = pget<std::vector<Node::Shared>>(node.data);
+          return std::any_of(list.begin(), list.end(),
+                             [this](auto &child) { return isNullable(*child); });
+        }
+        case Symbol::ONE_OR_MORE:
+          return isNullable(*pget<Node::Shared>(node.data));
+        case Symbol::RULE:
+        case Symbol::WEAK_RULE: {
+          auto rule = getRule(node);
+          return rule && analysis.nullable.count(rule.get());
+        }
+        case Symbol::PRECEDENCE:
+          return isNullable(*pget<Node::OperatorTable>(node.data).operand);
+        default:
+          // empty, end of file, filters, predicates and optional repetitions
+          return true;
+      }
+    }
+
+    void addLeftCalls(const Node &node, std::vector<size_t> &calls) const {
+      if (auto rule = getRule(node)) {
+        calls.push_back(indices.at(rule.get()));
+        return;
+      }
+      if (node.symbol == Symbol::SEQUENCE) {
+        // following nodes begin at the same position while the previous ones are nullable
+        for (auto &child : pget<std::vector<Node::Shared>>(node.data)) {
+          addLeftCalls(*child, calls);
+          if (!isNullable(*child)) {
+            break;
+          }
+        }
+        return;
+      }
+      if (node.symbol == Symbol::PRECEDENCE) {
+        auto &table = pget<Node::OperatorTable>(node.data);
+        addLeftCalls(*table.operand, calls);
+        if (isNullable(*table.operand)) {
+          for (auto &op : table.operators) {
+            addLeftCalls(*op.pattern, calls);
+          }
+        }
+        return;
+      }
+      for (auto &child : children(node)) {
+        addLeftCalls(*child, calls);
+      }
+    }
+
+    /** Returns the shortest cycle of left calls from `start` back to itself, if there is one */
+    std::vector<size_t> findCycle(size_t start) const {
+      std::vector<size_t> parents(leftCalls.size(), leftCalls.size());
+      std::deque<size_t> pending{start};
+      while (!pending.empty()) {
+        auto current = pending.front();
+        pending.pop_front();
+        for (auto next : leftCalls[current]) {
+          if (next == start) {
+            std::vector<size_t> cycle{start};
+            for (auto rule = current; rule != start; rule = parents[rule]) {
+              cycle.push_back(rule);
+            }
+            cycle.push_back(start);
+            std::reverse(cycle.begin(), cycle.end());
+            return cycle;
+          }
+          if (parents[next] == leftCalls.size()) {
+            parents[next] = current;
+            pending.push_back(next);
+          }
+        }
+      }
+      return {};
+    }
+
+  public:
+    Analyzer(Analysis &a, const std::shared_ptr<Rule> &start) : analysis(a) {
+      indices[start.get()] = 0;
+      analysis.rules.push_back(start);
+      for (size_t i = 0; i < analysis.rules.size(); ++i) {
+        collectRules(*analysis.rules[i]->node);
+      }
+    }
+
+    void run() {
+      auto &rules = analysis.rules;
+      for (auto changed = true; changed;) {
+        changed = false;
+        for (auto &rule : rules) {
+          if (!analysis.nullable.count(rule.get()) && isNullable(*rule->node)) {
+            analysis.nullable.insert(rule.get());
+            changed = true;
+          }
+        }
+      }
+
+      leftCalls.resize(rules.size());
+      for (size_t i = 0; i < rules.size(); ++i) {
+        addLeftCalls(*rules[i]->node, leftCalls[i]);
+      }
+
+      // cycles found from each of their rules are only reported once
+      std::set<std::vector<size_t>> reported;
+      for (size_t i = 0; i < rules.size(); ++i) {
+        auto cycle = findCycle(i);
+        if (cycle.empty()) {
+          continue;
+        }
+        analysis.leftRecursive.insert(rules[i].get());
+        cycle.pop_back();
+        std::rotate(cycle.begin(), std::min_element(cycle.begin(), cycle.end()), cycle.end());
+        if (!reported.insert(cycle).second) {
+          continue;
+        }
+        cycle.push_back(cycle.front());
+        std::vector<std::shared_ptr<Rule>> cycleRules;
+        for (auto index : cycle) {
+          cycleRules.push_back(rules[index]);
+        }
+        analysis.cycles.push_back(std::move(cycleRules));
+      }
+    }
+  };
+
+}  // namespace
+
+std::ostream &peg_parser::grammar::operator<<(std::ostream &stream, const Analysis &analysis) {
+  for (auto &cycle : analysis.cycles) {
+    stream << "left recursion: ";
+    for (size_t i = 0; i < cycle.size(); ++i) {
+      stream << cycle[i]->name << (i + 1 == cycle.size() ? "\n" : " -> ");
+    }
+  }
+  return stream;
+}
+
+Analysis peg_parser::grammar::analyze(const std::shared_ptr<Rule> &start) {
+  Analysis analysis;
+  Analyzer(analysis, start).run();
+  for (auto &rule : analysis.rules) {
+    auto leftRecursive = analysis.leftRecursive.count(rule.get()) > 0;
+    // rules may be shared by several grammars, so they are only written if changed
+    if (rule->leftRecursive != leftRecursive) {
+      rule->leftRecursive = leftRecursive;
+    }
+  }
+  return analysis;
+}
@@ -0,0 +1,654 @@
+#include <peg_parser/automaton.h>
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <unordered_set>
+
+using namespace peg_parser::grammar;
+using Symbol = Node::Symbol;
+
+namespace {
+
+  /**  alternative to `std::get` that works on iOS < 11 */
+  template <class T, class V> const T &pget(const V &v) {
+    if (auto r = std::get_if<T>(&v)) {
+      return *r;
+    } else {
+      throw std::runtime_error("corrupted grammar node");
+    }
+  }
+
+  std::shared_ptr<Rule> getRule(const Node &node) {
+    if (node.symbol == Symbol::RULE) {
+      return pget<std::shared_ptr<Rule>>(node.data);
+    }
+    if (node.symbol == Symbol::WEAK_RULE) {
+      return pget<std::weak_ptr<Rule>>(node.data).lock();
+    }
+    return nullptr;
+  }
+
+  /** Pseudo letter read at the end of the input */
+  const size_t END_OF_INPUT = 256;
+
+  const size_t UNDECIDED = std::numeric_limits<size_t>::max();
+
+  Node::CharacterSet rangeSet(const std::array<Letter, 2> &range) {
+    Node::CharacterSet set;
+    for (size_t i = 0; i < set.size(); ++i) {
+      auto c = static_cast<Letter>(i);
+      set[i] = c >= range[0] && c <= range[1];
+    }
+    return set;
+  }
+
+  /** Whether `node` may succeed without consuming input, conservative for irregular nodes */
+  bool isNullable(const Node &node) {
+    switch (node.symbol) {
+      case Symbol::WORD:
+        return pget<std::string>(node.data).empty();
+      case Symbol::ANY:
+      case Symbol::RANGE:
+      case Symbol::CHARACTER_SET:
+        return false;
+      case Symbol::SEQUENCE: {
+        auto &list = pget<std::vector<Node::Shared>>(node.data);
+        return std::all_of(list.begin(), list.end(),
+                           [](auto &child) { return isNullable(*child); });
+      }
+      case Symbol::CHOICE: {
+        auto &list = pget<std::vector<Node::Shared>>(node.data);
+        return std::any_of(list.begin(), list.end(),
+                           [](auto &child) { return isNullable(*child); });
+      }
+      case Symbol::ONE_OR_MORE:
+        return isNullable(*pget<Node::Shared>(node.data));
+      default:
+        return true;
+    }
+  }
+
+  /** Whether `node` always succeeds, conservative for irregular nodes */
+  bool isInfallible(const Node &node) {
+    switch (node.symbol) {
+      case Symbol::EMPTY:
+      case Symbol::OPTIONAL:
+      case Symbol::ZERO_OR_MORE:
+        return true;
+      case Symbol::WORD:
+        return pget<std::string>(node.data).empty();
+      case Symbol::SEQUENCE: {
+        auto &list = pget<std::vector<Node::Shared>>(node.data);
+        return std::all_of(list.begin(), list.end(),
+                           [](auto &child) { return isInfallible(*child); });
+      }
+      case Symbol::CHOICE: {
+        auto &list = pget<std::vector<Node::Shared>>(node.data);
+        return std::any_of(list.begin(), list.end(),
+                           [](auto &child) { return isInfallible(*child); });
+      }
+      default:
+        return false;
+    }
+  }
+
+  /**
+   * Whether the next letter alone decides if `node` succeeds, which is the case exactly if it is
+   * one of the letters added to `first`.
+   */
+  bool isDecided(const Node &node, Node::CharacterSet &first) {
+    switch (node.symbol) {
+      case Symbol::WORD: {
+        auto &word = pget<std::string>(node.data);
+        if (word.size() != 1) {
+          return false;
+        }
+        first[static_cast<unsigned char>(word[0])] = true;
+        return true;
+      }
+      case Symbol::ANY:
+        first.set();
+        return true;
+      case Symbol::RANGE:
+        first |= rangeSet(pget<std::array<Letter, 2>>(node.data));
+        return true;
+      case Symbol::CHARACTER_SET:
+        first |= pget<Node::CharacterSet>(node.data);
+        return true;
+      case Symbol::SEQUENCE: {
+        auto &list = pget<std::vector<Node::Shared>>(node.data);
+        return !list.empty() && isDecided(*list[0], first)
+               && std::all_of(list.begin() + 1, list.end(),
+                              [](auto &child) { return isInfallible(*child); });
+      }
+      case Symbol::CHOICE: {
+        auto &list = pget<std::vector<Node::Shared>>(node.data);
+        return std::all_of(list.begin(), list.end(),
+                           [&](auto &child) { return isDecided(*child, first); });
+      }
+      case Symbol::ONE_OR_MORE:
+        return isDecided(*pget<Node::Shared>(node.data), first);
+      default:
+        return false;
+    }
+  }
+
+  /**
+   * Instruction of a backtracking matcher. `SPLIT` continues with the next instruction and falls
+   * back to `argument` if that fails before reaching the corresponding `CUT`.
+   */
+  struct Instruction {
+    enum Operation : uint8_t { LETTER, SPLIT, CUT, JUMP, MATCH } operation;
+    /** the index of the letters, the fallback or the jump target */
+    size_t argument;
+    /** for splits decided by the next letter the index of the letters taking the first path */
+    size_t decision = UNDECIDED;
+  };
+
+  /** Translates regular nodes into instructions */
+  class Program {
+  public:
+    std::vector<Instruction> instructions;
+    std::vector<Node::CharacterSet> letters;
+
+    bool add(const Node &node) {
+      switch (node.symbol) {
+        case Symbol::WORD: {
+          for (auto c : pget<std::string>(node.data)) {
+            Node::CharacterSet set;
+            set[static_cast<unsigned char>(c)] = true;
+            if (!addEndlessLetter(set)) {
+              return false;
+            }
+          }
+          return true;
+        }
+
+        case Symbol::ANY: {
+          // unlike the other letters, the parser checks for the end of the input explicitly
+          emit(Instruction::LETTER, addLetters(Node::CharacterSet().set()));
+          return true;
+        }
+
+        case Symbol::RANGE: {
+          return addEndlessLetter(rangeSet(pget<std::array<Letter, 2>>(node.data)));
+        }
+
+        case Symbol::CHARACTER_SET: {
+          return addEndlessLetter(pget<Node::CharacterSet>(node.data));
+        }
+
+        case Symbol::EMPTY: {
+          return true;
+        }
+
+        case Symbol::SEQUENCE: {
+          for (auto &child : pget<std::vector<Node::Shared>>(node.data)) {
+            if (!add(*child)) {
+              return false;
+            }
+          }
+          return true;
+        }
+
+        case Symbol::CHOICE: {
+          auto &children = pget<std::vector<Node::Shared>>(node.data);
+          if (children.empty()) {
+            return false;
+          }
+          std::vector<size_t> jumps;
+          for (size_t i = 0; i + 1 < children.size(); ++i) {
+            auto split = addSplit(*children[i]);
+            if (!add(*children[i])) {
+              return false;
+            }
+            emit(Instruction::CUT);
+            jumps.push_back(emit(Instruction::JUMP));
+            instructions[split].argument = instructions.size();
+          }
+          if (!add(*children.back())) {
+            return false;
+          }
+          for (auto jump : jumps) {
+            instructions[jump].argument = instructions.size();
+          }
+          return true;
+        }
+
+        case Symbol::OPTIONAL: {
+          auto &child = *pget<Node::Shared>(node.data);
+          auto split = addSplit(child);
+          if (!add(child)) {
+            return false;
+          }
+          emit(Instruction::CUT);
+          instructions[split].argument = instructions.size();
+          return true;
+        }
+
+        case Symbol::ONE_OR_MORE:
+        case Symbol::ZERO_OR_MORE: {
+          auto &child = *pget<Node::Shared>(node.data);
+          // the parser would never stop repeating
+          if (isNullable(child)) {
+            return false;
+          }
+          if (node.symbol == Symbol::ONE_OR_MORE && !add(child)) {
+            return false;
+          }
+          auto split = addSplit(child);
+          if (!add(child)) {
+            return false;
+          }
+          emit(Instruction::CUT);
+          emit(Instruction::JUMP, split);
+          instructions[split].argument = instructions.size();
+          return true;
+        }
+
+        default:
+          return false;
+      }
+    }
+
+    size_t emit(Instruction::Operation operation, size_t argument = 0) {
+      instructions.push_back(Instruction{operation, argument});
+      return instructions.size() - 1;
+    }
+
+  private:
+    size_t addLetters(const Node::CharacterSet &set) {
+      letters.push_back(set);
+      return letters.size() - 1;
+    }
+
+    /** Adds a letter that must not match '\0', which the parser reads at the end of the input */
+    bool addEndlessLetter(const Node::CharacterSet &set) {
+      if (set[0]) {
+        return false;
+      }
+      emit(Instruction::LETTER, addLetters(set));
+      return true;
+    }
+
+    /** Adds a split trying `node` first, its fallback is set once known */
+    size_t addSplit(const Node &node) {
+      auto split = emit(Instruction::SPLIT);
+      Node::CharacterSet first;
+      if (isDecided(node, first)) {
+        instructions[split].decision = addLetters(first);
+      }
+      return split;
+    }
+  };
+
+  /** Split whose cut discards a thread, `depth` is the number of frames it was entered with */
+  struct Fallback {
+    size_t frame;
+    size_t depth;
+
+    bool operator==(const Fallback &other) const {
+      return frame == other.frame && depth == other.depth;
+    }
+  };
+
+  /**
+   * Path through the program. `frames` are the entered splits whose fallbacks are discarded once
+   * the thread reaches their cut, `fallbacks` the splits whose cut discards the thread.
+   */
+  struct Thread {
+    size_t instruction;
+    std::vector<size_t> frames;
+    std::vector<Fallback> fallbacks;
+
+    bool operator==(const Thread &other) const {
+      return instruction == other.instruction && frames == other.frames
+             && fallbacks == other.fallbacks;
+    }
+  };
+
+  /**
+   * Threads ordered by the parser's priority that wait for the next letter, except for the last
+   * one which may have reached the match. That match is final once no thread before it is left,
+   * until then their cuts or matches may discard it.
+   */
+  struct StateSet {
+    std::vector<Thread> threads;
+    /** whether a match was reached before reading the last letter */
+    bool matched = false;
+  };
+
+  /**
+   * Builds the automaton by running all threads in parallel in the order the parser tries them.
+   * Reaching the match discards all later threads and a cut discards the threads falling back to
+   * its split. Splits decided by the next letter only continue with the path the parser takes.
+   *
+   * A thread falling back to a split nested in the one it cuts, or to any split when matching,
+   * only survives if an earlier thread fails on a later letter. Until then its cut or match cannot
+   * discard other threads, so the node is marked as `irregular` if it would.
+   */
+  class SubsetBuilder {
+  private:
+    const Program &program;
+    size_t letter = 0;
+    /** splits whose cut has been reached, and those reached by threads that may not survive */
+    std::unordered_set<size_t> cut, tentativelyCut;
+    /** splits entered by threads that have read the letter */
+    std::unordered_set<size_t> live;
+    bool tentativelyMatched = false;
+    size_t nextFrame = 0;
+    StateSet next;
+
+    bool isDiscarded(const Thread &thread) {
+      for (auto &fallback : thread.fallbacks) {
+        if (cut.count(fallback.frame)) {
+          return true;
+        }
+      }
+      for (auto &fallback : thread.fallbacks) {
+        irregular = irregular || tentativelyCut.count(fallback.frame);
+      }
+      irregular = irregular || (next.matched && tentativelyMatched);
+      return next.matched;
+    }
+
+    /** Whether the thread falls back to a live split entered within its innermost frame */
+    bool isTentative(const Thread &thread) const {
+      for (auto &fallback : thread.fallbacks) {
+        if (fallback.depth >= thread.frames.size() && live.count(fallback.frame)
+            && !cut.count(fallback.frame)) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    bool accepts(size_t letters) const {
+      return letter != END_OF_INPUT && program.letters[letters][letter];
+    }
+
+    void addThread(Thread thread) {
+      while (!isDiscarded(thread)) {
+        auto &instruction = program.instructions[thread.instruction];
+        switch (instruction.operation) {
+          case Instruction::LETTER: {
+            if (accepts(instruction.argument)) {
+              ++thread.instruction;
+              live.insert(thread.frames.begin(), thread.frames.end());
+              next.threads.push_back(std::move(thread));
+            }
+            return;
+          }
+          case Instruction::SPLIT: {
+            if (instruction.decision != UNDECIDED) {
+              if (accepts(instruction.decision)) {
+                thread.frames.push_back(nextFrame++);
+                ++thread.instruction;
+              } else {
+                thread.instruction = instruction.argument;
+              }
+              break;
+            }
+            auto fallback = thread;
+            fallback.instruction = instruction.argument;
+            fallback.fallbacks.push_back(Fallback{nextFrame, thread.frames.size()});
+            thread.frames.push_back(nextFrame++);
+            ++thread.instruction;
+            addThread(std::move(thread));
+            return addThread(std::move(fallback));
+          }
+          case Instruction::CUT: {
+            (isTentative(thread) ? tentativelyCut : cut).insert(thread.frames.back());
+            thread.frames.pop_back();
+            ++thread.instruction;
+            break;
+          }
+          case Instruction::JUMP: {
+            thread.instruction = instruction.argument;
+            break;
+          }
+          case Instruction::MATCH: {
+            tentativelyMatched = isTentative(thread);
+            // moved past the match, so that it is kept instead of being reached again
+            ++thread.instruction;
+            next.threads.push_back(std::move(thread));
+            next.matched = true;
+            return;
+          }
+        }
+      }
+    }
+
+    /** Forgets splits that cannot be cut anymore and numbers the others by first appearance */
+    static void normalize(StateSet &set) {
+      std::map<size_t, size_t> numbers;
+      for (auto &thread : set.threads) {
+        for (auto &frame : thread.frames) {
+          frame = numbers.emplace(frame, numbers.size()).first->second;
+        }
+      }
+      for (auto &thread : set.threads) {
+        auto &fallbacks = thread.fallbacks;
+        fallbacks.erase(std::remove_if(fallbacks.begin(), fallbacks.end(),
+                                       [&](auto &f) { return !numbers.count(f.frame); }),
+                        fallbacks.end());
+        for (auto &fallback : fallbacks) {
+          fallback.frame = numbers[fallback.frame];
+        }
+      }
+      // a thread equal to an earlier one can never be the first to match
+      std::vector<Thread> unique;
+      for (auto &thread : set.threads) {
+        if (std::find(unique.begin(), unique.end(), thread) == unique.end()) {
+          unique.push_back(std::move(thread));
+        }
+      }
+      set.threads = std::move(unique);
+    }
+
+  public:
+    /** set if the parser's result cannot be determined without backtracking */
+    bool irregular = false;
+
+    explicit SubsetBuilder(const Program &p) : program(p) {}
+
+    bool hasMatched(const Thread &thread) const {
+      return thread.instruction == program.instructions.size();
+    }
+
+    /** Continues all threads until they have read `l`, which may be `END_OF_INPUT` */
+    StateSet step(const StateSet &current, size_t l) {
+      letter = l;
+      next = StateSet();
+      cut.clear();
+      tentativelyCut.clear();
+      live.clear();
+      tentativelyMatched = false;
+      // new frames are numbered after the normalized ones
+      nextFrame = 0;
+      for (auto &thread : current.threads) {
+        for (auto frame : thread.frames) {
+          nextFrame = std::max(nextFrame, frame + 1);
+        }
+      }
+      for (auto &thread : current.threads) {
+        if (!hasMatched(thread)) {
+          addThread(thread);
+        } else if (!isDiscarded(thread)) {
+          next.threads.push_back(thread);
+        }
+      }
+      normalize(next);
+      return std::move(next);
+    }
+  };
+
+  /** Key identifying equal state sets */
+  std::vector<size_t> stateKey(const StateSet &set) {
+    std::vector<size_t> key{set.matched};
+    for (auto &thread : set.threads) {
+      key.push_back(thread.instruction);
+      key.push_back(thread.frames.size());
+      key.insert(key.end(), thread.frames.begin(), thread.frames.end());
+      key.push_back(thread.fallbacks.size());
+      for (auto &fallback : thread.fallbacks) {
+        key.push_back(fallback.frame);
+        key.push_back(fallback.depth);
+      }
+    }
+    return key;
+  }
+
+  /** Merges states that cannot be told apart, keeping the empty and the start state first */
+  template <class StateIndex>
+  void minimize(std::vector<StateIndex> &transitions, std::vector<uint8_t> &flags) {
+    auto count = flags.size();
+    std::vector<size_t> classes(flags.begin(), flags.end());
+    for (size_t classCount = 0;;) {
+      // classes are numbered by their first state
+      std::map<std::vector<size_t>, size_t> signatures;
+      std::vector<size_t> refined(count);
+      for (size_t state = 0; state < count; ++state) {
+        std::vector<size_t> signature{classes[state]};
+        for (size_t letter = 0; letter < 256; ++letter) {
+          signature.push_back(classes[transitions[state * 256 + letter]]);
+        }
+        refined[state] = signatures.emplace(std::move(signature), signatures.size()).first->second;
+      }
+      classes = std::move(refined);
+      if (signatures.size() == classCount) {
+        break;
+      }
+      classCount = signatures.size();
+    }
+    // nothing is ever matched
+    if (classes[1] == 0) {
+      return;
+    }
+    auto classCount = *std::max_element(classes.begin(), classes.end()) + 1;
+    std::vector<StateIndex> mergedTransitions(classCount * 256);
+    std::vector<uint8_t> mergedFlags(classCount);
+    for (size_t state = count; state-- > 0;) {
+      for (size_t letter = 0; letter < 256; ++letter) {
+        auto target = classes[transitions[state * 256 + letter]];
+        mergedTransitions[classes[state] * 256 + letter] = StateIndex(target);
+      }
+      mergedFlags[classes[state]] = flags[state];
+    }
+    transitions = std::move(mergedTransitions);
+    flags = std::move(mergedFlags);
+  }
+
+  void collectRules(const Node &node, std::unordered_set<Rule *> &visited,
+                    std::vector<std::shared_ptr<Rule>> &rules) {
+    if (auto rule = getRule(node)) {
+      if (visited.insert(rule.get()).second) {
+        rules.push_back(rule);
+      }
+      return;
+    }
+    if (auto list = std::get_if<std::vector<Node::Shared>>(&node.data)) {
+      for (auto &child : *list) {
+        collectRules(*child, visited, rules);
+      }
+    } else if (auto child = std::get_if<Node::Shared>(&node.data)) {
+      collectRules(**child, visited, rules);
+    } else if (auto table = std::get_if<Node::OperatorTable>(&node.data)) {
+      collectRules(*table->operand, visited, rules);
+      for (auto &op : table->operators) {
+        collectRules(*op.pattern, visited, rules);
+      }
+    }
+  }
+
+}  // namespace
+
+std::shared_ptr<const Automaton> Automaton::compile(const Node &node, size_t maxStates) {
+  Program program;
+  if (!program.add(node)) {
+    return nullptr;
+  }
+  program.emit(Instruction::MATCH);
+  maxStates = std::min<size_t>(maxStates, std::numeric_limits<StateIndex>::max());
+
+  SubsetBuilder builder(program);
+  // state 0 never matches and state 1 is the start
+  std::vector<StateSet> sets(2);
+  sets[1].threads.push_back(Thread{0, {}, {}});
+  std::map<std::vector<size_t>, size_t> indices{{stateKey(sets[0]), 0}, {stateKey(sets[1]), 1}};
+  auto automaton = std::make_shared<Automaton>();
+  for (size_t current = 0; current < sets.size(); ++current) {
+    automaton->transitions.resize(sets.size() * 256);
+    for (size_t letter = 0; letter < 256; ++letter) {
+      auto next = builder.step(sets[current], letter);
+      auto [it, inserted] = indices.emplace(stateKey(next), sets.size());
+      if (inserted) {
+        if (sets.size() >= maxStates) {
+          return nullptr;
+        }
+        sets.push_back(std::move(next));
+      }
+      automaton->transitions[current * 256 + letter] = StateIndex(it->second);
+    }
+    auto atEnd = builder.step(sets[current], END_OF_INPUT);
+    if (builder.irregular) {
+      return nullptr;
+    }
+
+    auto &set = sets[current];
+    uint8_t flags = 0;
+    if (set.matched) {
+      flags |= MATCHED;
+    }
+    if (set.threads.empty() || builder.hasMatched(set.threads.front())) {
+      flags |= FINAL;
+    }
+    if (atEnd.matched) {
+      flags |= MATCHED_AT_END;
+    } else if (!atEnd.threads.empty()) {
+      flags |= PENDING;
+    }
+    automaton->flags.push_back(flags);
+  }
+  minimize(automaton->transitions, automaton->flags);
+  return automaton;
+}
+
+size_t Automaton::match(std::string_view string, size_t position) const {
+  size_t state = 1;
+  auto end = npos;
+  for (; position < string.size(); ++position) {
+    state = transitions[state * 256 + static_cast<unsigned char>(string[position])];
+    if (flags[state] & MATCHED) {
+      end = position;
+    }
+    if (flags[state] & FINAL) {
+      return flags[state] & PENDING ? end : npos;
+    }
+  }
+  if (flags[state] & MATCHED_AT_END) {
+    return position;
+  }
+  return flags[state] & PENDING ? end : npos;
+}
+
+size_t peg_parser::grammar::compileAutomata(const std::shared_ptr<Rule> &start,
+                                            size_t maxStates) {
+  std::unordered_set<Rule *> visited{start.get()};
+  std::vector<std::shared_ptr<Rule>> rules{start};
+  for (size_t i = 0; i < rules.size(); ++i) {
+    collectRules(*rules[i]->node, visited, rules);
+  }
+  size_t compiled = 0;
+  for (auto &rule : rules) {
+    auto automaton = Automaton::compile(*rule->node, maxStates);
+    compiled += automaton != nullptr;
+    // rules may be shared by several grammars, so they are only written if changed
+    if (automaton || rule->automaton) {
+      rule->automaton = std::move(automaton);
+    }
+  }
+  return compiled;
+}
@@ -0,0 +1,93 @@
+#include <peg_parser/compact_tree.h>
+
+#include <limits>
+
+using namespace peg_parser;
+
+namespace {
+
+  size_t countNodes(const SyntaxTree &tree) {
+    size_t count = 1;
+    for (auto &inner : tree.inner) {
+      count += countNodes(*inner);
+    }
+    return count;
+  }
+
+}  // namespace
+
+CompactSyntaxTree::CompactSyntaxTree(const SyntaxTree &tree) : fullString(tree.fullString) {
+  if (fullString.size() > std::numeric_limits<Index>::max()) {
+    throw std::length_error("input too large for compact syntax tree");
+  }
+  auto count = countNodes(tree);
+  for (auto array : {&ruleIds, &begins, &ends, &childCounts, &nextSiblings}) {
+    array->reserve(count);
+  }
+  std::unordered_map<grammar::Rule *, Index> ruleIndices;
+  add(tree, ruleIndices);
+}
+
+void CompactSyntaxTree::add(const SyntaxTree &tree,
+                            std::unordered_map<grammar::Rule *, Index> &ruleIndices) {
+  if (ruleIds.size() >= std::numeric_limits<Index>::max()) {
+    throw std::length_error("too many nodes for compact syntax tree");
+  }
+  auto [it, inserted] = ruleIndices.emplace(tree.rule.get(), Index(rules.size()));
+  if (inserted) {
+    rules.push_back(tree.rule);
+  }
+
+  auto index = ruleIds.size();
+  ruleIds.push_back(it->second);
+  begins.push_back(Index(tree.begin));
+  ends.push_back(Index(tree.end));
+  childCounts.push_back(Index(tree.inner.size()));
+  nextSiblings.push_back(0);
+
+  for (auto &inner : tree.inner) {
+    add(*inner, ruleIndices);
+  }
+  nextSiblings[index] = Index(ruleIds.size());
+}
+
+std::shared_ptr<SyntaxTree> CompactSyntaxTree::expand(const Cursor &cursor) const {
+  auto tree = std::make_shared<SyntaxTree>(cursor.rule(), fullString, cursor.begin());
+  tree->end = cursor.end();
+  tree->valid = true;
+  tree->active = false;
+  auto count = cursor.size();
+  tree->inner.reserve(count);
+  if (count > 0) {
+    for (auto child = cursor.firstChild();; child = child.nextSibling()) {
+      tree->inner.push_back(expand(child));
+      if (tree->inner.size() == count) {
+        break;
+      }
+    }
+  }
+  return tree;
+}
+
+size_t CompactSyntaxTree::memoryUsage() const {
+  return sizeof(*this) + rules.capacity() * sizeof(rules[0])
+         + (ruleIds.capacity() + begins.capacity() + ends.capacity() + childCounts.capacity()
+            + nextSiblings.capacity())
+               * sizeof(Index);
+}
+
+std::ostream &peg_parser::operator<<(std::ostream &stream,
+                                     const CompactSyntaxTree::Cursor &cursor) {
+  stream << cursor.rule()->name << '(';
+  auto count = cursor.size();
+  if (count == 0) {
+    stream << '\'' << cursor.view() << '\'';
+  } else {
+    auto child = cursor.firstChild();
+    for (size_t i = 0; i < count; ++i, child = child.nextSibling()) {
+      stream << child << (i + 1 == count ? "" : ", ");
+    }
+  }
+  stream << ')';
+  return stream;
+}
@@ -2,6 +2,8 @@
 #include <peg_parser/grammar.h>
 #include <peg_parser/interpreter.h>
 
+#include <algorithm>
+
 using namespace peg_parser::grammar;
 
 namespace {
@@ -117,6 +119,48 @@ std::ostream &peg_parser::grammar::operator<<(std::ostream &stream, const Node &
       stream << "<Filter>";
       break;
     }
+
+    case Node::Symbol::CHARACTER_SET: {
+      auto &set = pget<Node::CharacterSet>(node.data);
+      stream << "[";
+      for (size_t i = 0; i < set.size(); ++i) {
+        if (!set[i]) {
+          continue;
+        }
+        auto end = i;
+        while (end + 1 < set.size() && set[end + 1]) {
+          ++end;
+        }
+        stream << Letter(i);
+        if (end > i) {
+          stream << "-" << Letter(end);
+        }
+        i = end;
+      }
+      stream << "]";
+      break;
+    }
+
+    case Node::Symbol::PRECEDENCE: {
+      // operators of equal precedence and associativity are listed as one level
+      auto &table = pget<Node::OperatorTable>(node.data);
+      auto operators = table.operators;
+      std::stable_sort(operators.begin(), operators.end(),
+                       [](auto &a, auto &b) { return a.precedence < b.precedence; });
+      stream << "{" << *table.operand;
+      for (auto [i, op] : easy_iterator::enumerate(operators)) {
+        auto &previous = operators[i > 0 ? i - 1 : 0];
+        if (i == 0 || previous.precedence != op.precedence
+            || previous.rightAssociative != op.rightAssociative) {
+          stream << "; " << (op.rightAssociative ? "right" : "left") << ": ";
+        } else {
+          stream << ", ";
+        }
+        stream << op.rule->name << " " << *op.pattern;
+      }
+      stream << "}";
+      break;
+    }
   }
 
   return stream;
@@ -15,6 +15,14 @@ const char *SyntaxError::what() const noexcept {
   if (buffer.size() == 0) {
     buffer = "syntax error at character " + std::to_string(syntax->end + 1) + " while parsing "
              + syntax->rule->name;
+    for (size_t i = 0; i < expected.size(); ++i) {
+      if (i == 0) {
+        buffer += expected.size() == 1 ? ", expected " : ", expected one of ";
+      } else {
+        buffer += ", ";
+      }
+      buffer += expected[i];
+    }
   }
   return buffer.c_str();
 }
@@ -0,0 +1,75 @@
+#include <peg_parser/lexer.h>
+
+#include <limits>
+#include <stdexcept>
+
+using namespace peg_parser::grammar;
+
+std::shared_ptr<const Lexer> Lexer::create(const std::vector<std::shared_ptr<Rule>> &tokens,
+                                           const std::shared_ptr<Rule> &separator) {
+  auto lexer = std::make_shared<Lexer>();
+  auto rules = tokens;
+  if (separator) {
+    rules.push_back(separator);
+    lexer->hasSeparator = true;
+  }
+  for (auto &rule : rules) {
+    auto automaton = rule->automaton ? rule->automaton : Automaton::compile(*rule->node);
+    if (!automaton) {
+      throw std::invalid_argument("token rule " + rule->name + " is not regular");
+    }
+    lexer->rules.push_back(rule.get());
+    lexer->automata.push_back(std::move(automaton));
+    lexer->owners.push_back(rule);
+  }
+  for (auto &rule : rules) {
+    rule->lexer = lexer;
+  }
+  return lexer;
+}
+
+void Lexer::tokenize(std::string_view string, std::vector<Token> &tokens) const {
+  if (string.size() > std::numeric_limits<uint32_t>::max()) {
+    throw std::length_error("input too long to tokenize");
+  }
+  tokens.clear();
+  auto separator = hasSeparator ? automata.size() - 1 : automata.size();
+  for (size_t position = 0; position < string.size();) {
+    auto end = position;
+    size_t rule = 0;
+    for (size_t i = 0; i < automata.size(); ++i) {
+      auto match = automata[i]->match(string, position);
+      if (match != Automaton::npos && match > end) {
+        end = match;
+        rule = i;
+      }
+    }
+    if (end == position) {
+      ++position;
+      continue;
+    }
+    if (rule == separator && !tokens.empty() && tokens.back().rule == separator
+        && tokens.back().end == position) {
+      tokens.back().end = uint32_t(end);
+    } else {
+      tokens.push_back(Token{uint32_t(position), uint32_t(end), uint32_t(rule)});
+    }
+    position = end;
+  }
+}
+
+std::vector<Token> Lexer::tokenize(std::string_view string) const {
+  std::vector<Token> tokens;
+  tokenize(string, tokens);
+  return tokens;
+}
+
+void Lexer::release() const {
+  for (auto &owner : owners) {
+    if (auto rule = owner.lock()) {
+      if (rule->lexer.get() == this) {
+        rule->lexer.reset();
+      }
+    }
+  }
+}
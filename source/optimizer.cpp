@@ -0,0 +1,413 @@
+#include <peg_parser/optimizer.h>
+
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace peg_parser::grammar;
+using Symbol = Node::Symbol;
+
+namespace {
+
+  /**  alternative to `std::get` that works on iOS < 11 */
+  template <class T, class V> const T &pget(const V &v) {
+    if (auto r = std::get_if<T>(&v)) {
+      return *r;
+    } else {
+      throw std::runtime_error("corrupted grammar node");
+    }
+  }
+
+  bool isUnary(Symbol symbol) {
+    switch (symbol) {
+      case Symbol::ZERO_OR_MORE:
+      case Symbol::ONE_OR_MORE:
+      case Symbol::OPTIONAL:
+      case Symbol::ALSO:
+      case Symbol::NOT:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  bool isList(Symbol symbol) { return symbol == Symbol::SEQUENCE || symbol == Symbol::CHOICE; }
+
+  /** Nodes parsed by precedence nodes, the operand followed by the operator patterns */
+  std::vector<Node::Shared> precedenceChildren(const Node &node) {
+    auto &table = pget<Node::OperatorTable>(node.data);
+    std::vector<Node::Shared> children{table.operand};
+    for (auto &op : table.operators) {
+      children.push_back(op.pattern);
+    }
+    return children;
+  }
+
+  std::shared_ptr<Rule> getRule(const Node &node) {
+    if (node.symbol == Symbol::RULE) {
+      return pget<std::shared_ptr<Rule>>(node.data);
+    }
+    if (node.symbol == Symbol::WEAK_RULE) {
+      return pget<std::weak_ptr<Rule>>(node.data).lock();
+    }
+    return nullptr;
+  }
+
+  /** Structural equality. Filters are never equal as their callbacks may have side effects. */
+  bool equal(const Node::Shared &a, const Node::Shared &b) {
+    if (a == b) {
+      return a->symbol != Symbol::FILTER;
+    }
+    if (a->symbol != b->symbol) {
+      return false;
+    }
+    switch (a->symbol) {
+      case Symbol::WORD:
+        return pget<std::string>(a->data) == pget<std::string>(b->data);
+      case Symbol::RANGE:
+        return pget<std::array<Letter, 2>>(a->data) == pget<std::array<Letter, 2>>(b->data);
+      case Symbol::CHARACTER_SET:
+        return pget<Node::CharacterSet>(a->data) == pget<Node::CharacterSet>(b->data);
+      case Symbol::SEQUENCE:
+      case Symbol::CHOICE: {
+        auto &x = pget<std::vector<Node::Shared>>(a->data);
+        auto &y = pget<std::vector<Node::Shared>>(b->data);
+        if (x.size() != y.size()) {
+          return false;
+        }
+        for (size_t i = 0; i < x.size(); ++i) {
+          if (!equal(x[i], y[i])) {
+            return false;
+          }
+        }
+        return true;
+      }
+      case Symbol::RULE:
+      case Symbol::WEAK_RULE: {
+        auto rule = getRule(*a);
+        return rule && rule == getRule(*b);
+      }
+      case Symbol::FILTER:
+      case Symbol::PRECEDENCE:
+        return false;
+      default:
+        if (isUnary(a->symbol)) {
+          return equal(pget<Node::Shared>(a->data), pget<Node::Shared>(b->data));
+        }
+        return true;
+    }
+  }
+
+  /** Nodes that consume exactly one letter */
+  bool isLetter(const Node &node) {
+    return node.symbol == Symbol::RANGE || node.symbol == Symbol::CHARACTER_SET
+           || (node.symbol == Symbol::WORD && pget<std::string>(node.data).size() == 1);
+  }
+
+  void addToSet(Node::CharacterSet &set, const Node &node) {
+    switch (node.symbol) {
+      case Symbol::WORD: {
+        set[static_cast<unsigned char>(pget<std::string>(node.data)[0])] = true;
+        break;
+      }
+      case Symbol::RANGE: {
+        auto &range = pget<std::array<Letter, 2>>(node.data);
+        auto first = static_cast<unsigned char>(range[0]);
+        auto last = static_cast<unsigned char>(range[1]);
+        for (int c = first; c <= last; ++c) {
+          set[c] = true;
+        }
+        break;
+      }
+      case Symbol::CHARACTER_SET: {
+        set |= pget<Node::CharacterSet>(node.data);
+        break;
+      }
+      default:
+        break;
+    }
+  }
+
+  /** Nodes that always succeed make all following choice alternatives unreachable */
+  bool alwaysSucceeds(const Node &node) {
+    return node.symbol == Symbol::EMPTY || node.symbol == Symbol::OPTIONAL
+           || node.symbol == Symbol::ZERO_OR_MORE;
+  }
+
+  std::vector<Node::Shared> asSequence(const Node::Shared &node) {
+    if (node->symbol == Symbol::SEQUENCE) {
+      return pget<std::vector<Node::Shared>>(node->data);
+    }
+    return {node};
+  }
+
+  class Optimizer {
+  private:
+    std::unordered_map<const Node *, Node::Shared> optimized;
+    // keeps nodes alive so that their addresses are not reused while optimizing
+    std::vector<Node::Shared> visited;
+
+    std::vector<Node::Shared> flatten(Symbol symbol, const std::vector<Node::Shared> &nodes) {
+      std::vector<Node::Shared> result;
+      for (auto &node : nodes) {
+        auto child = optimize(node);
+        if (child->symbol == symbol) {
+          auto &inner = pget<std::vector<Node::Shared>>(child->data);
+          result.insert(result.end(), inner.begin(), inner.end());
+        } else {
+          result.push_back(child);
+        }
+      }
+      return result;
+    }
+
+    Node::Shared optimizeSequence(const std::vector<Node::Shared> &nodes) {
+      std::vector<Node::Shared> result;
+      for (auto &node : flatten(Symbol::SEQUENCE, nodes)) {
+        if (node->symbol == Symbol::EMPTY) {
+          continue;
+        }
+        if (node->symbol == Symbol::ERROR) {
+          return node;
+        }
+        if (!result.empty()) {
+          auto &previous = result.back();
+          if (previous->symbol == Symbol::WORD && node->symbol == Symbol::WORD) {
+            auto &word = pget<std::string>(previous->data);
+            previous = Node::Word(word + pget<std::string>(node->data));
+            continue;
+          }
+          // the second repetition can only match the empty string
+          if (previous->symbol == Symbol::ZERO_OR_MORE && equal(previous, node)) {
+            continue;
+          }
+        }
+        result.push_back(node);
+      }
+      if (result.empty()) {
+        return Node::Empty();
+      }
+      if (result.size() == 1 && result[0]->symbol != Symbol::FILTER) {
+        return result[0];
+      }
+      return Node::Sequence(result);
+    }
+
+    /** Replaces runs of adjacent alternatives with the same first element by a single sequence */
+    std::vector<Node::Shared> factorPrefixes(const std::vector<Node::Shared> &alternatives) {
+      std::vector<Node::Shared> result;
+      for (size_t i = 0; i < alternatives.size();) {
+        auto first = asSequence(alternatives[i]);
+        size_t end = i + 1;
+        while (end < alternatives.size() && equal(asSequence(alternatives[end])[0], first[0])) {
+          ++end;
+        }
+        if (end == i + 1) {
+          result.push_back(alternatives[i]);
+          ++i;
+          continue;
+        }
+
+        std::vector<std::vector<Node::Shared>> sequences;
+        for (size_t j = i; j < end; ++j) {
+          sequences.push_back(asSequence(alternatives[j]));
+        }
+        size_t prefixLength = 1;
+        while (true) {
+          bool common = true;
+          for (auto &sequence : sequences) {
+            if (sequence.size() <= prefixLength
+                || !equal(sequence[prefixLength], first[prefixLength])) {
+              common = false;
+              break;
+            }
+          }
+          if (!common) {
+            break;
+          }
+          ++prefixLength;
+        }
+
+        std::vector<Node::Shared> remainders;
+        for (auto &sequence : sequences) {
+          remainders.push_back(Node::Sequence(
+              std::vector<Node::Shared>(sequence.begin() + prefixLength, sequence.end())));
+        }
+        std::vector<Node::Shared> factored(first.begin(), first.begin() + prefixLength);
+        factored.push_back(Node::Choice(remainders));
+        result.push_back(optimize(Node::Sequence(factored)));
+        i = end;
+      }
+      return result;
+    }
+
+    Node::Shared optimizeChoice(const std::vector<Node::Shared> &nodes) {
+      std::vector<Node::Shared> alternatives;
+      for (auto &node : flatten(Symbol::CHOICE, nodes)) {
+        if (node->symbol == Symbol::ERROR) {
+          continue;
+        }
+        if (!alternatives.empty() && isLetter(*node) && isLetter(*alternatives.back())) {
+          Node::CharacterSet set;
+          addToSet(set, *alternatives.back());
+          addToSet(set, *node);
+          alternatives.back() = Node::Set(set);
+          continue;
+        }
+        alternatives.push_back(node);
+        if (alwaysSucceeds(*node)) {
+          break;
+        }
+      }
+
+      auto factored = factorPrefixes(alternatives);
+      if (factored.size() != alternatives.size()) {
+        return optimizeChoice(factored);
+      }
+      if (alternatives.empty()) {
+        return Node::Error();
+      }
+      if (alternatives.size() > 1 && alternatives.back()->symbol == Symbol::EMPTY) {
+        alternatives.pop_back();
+        return Node::Optional(optimizeChoice(alternatives));
+      }
+      if (alternatives.size() == 1) {
+        return alternatives[0];
+      }
+      return Node::Choice(alternatives);
+    }
+
+    Node::Shared optimizeUnary(const Node::Shared &node) {
+      auto &data = pget<Node::Shared>(node->data);
+      auto child = optimize(data);
+      if (node->symbol == Symbol::OPTIONAL && alwaysSucceeds(*child)) {
+        return child;
+      }
+      if (child == data) {
+        return node;
+      }
+      switch (node->symbol) {
+        case Symbol::ZERO_OR_MORE:
+          return Node::ZeroOrMore(child);
+        case Symbol::ONE_OR_MORE:
+          return Node::OneOrMore(child);
+        case Symbol::OPTIONAL:
+          return Node::Optional(child);
+        case Symbol::ALSO:
+          return Node::Also(child);
+        default:
+          return Node::Not(child);
+      }
+    }
+
+    Node::Shared optimizePrecedence(const Node::Shared &node) {
+      auto table = pget<Node::OperatorTable>(node->data);
+      auto operand = optimize(table.operand);
+      auto changed = operand != table.operand;
+      table.operand = operand;
+      for (auto &op : table.operators) {
+        auto pattern = optimize(op.pattern);
+        changed |= pattern != op.pattern;
+        op.pattern = pattern;
+      }
+      return changed ? Node::Precedence(table.operand, table.operators) : node;
+    }
+
+  public:
+    Node::Shared optimize(const Node::Shared &node) {
+      auto it = optimized.find(node.get());
+      if (it != optimized.end()) {
+        return it->second;
+      }
+
+      Node::Shared result = node;
+      if (node->symbol == Symbol::WORD && pget<std::string>(node->data).empty()) {
+        result = Node::Empty();
+      } else if (node->symbol == Symbol::SEQUENCE) {
+        result = optimizeSequence(pget<std::vector<Node::Shared>>(node->data));
+      } else if (node->symbol == Symbol::CHOICE) {
+        result = optimizeChoice(pget<std::vector<Node::Shared>>(node->data));
+      } else if (isUnary(node->symbol)) {
+        result = optimizeUnary(node);
+      } else if (node->symbol == Symbol::PRECEDENCE) {
+        result = optimizePrecedence(node);
+      }
+
+      optimized[node.get()] = result;
+      optimized[result.get()] = result;
+      visited.push_back(node);
+      return result;
+    }
+  };
+
+  void countNodes(const Node::Shared &node, std::unordered_set<const Node *> &visited) {
+    if (!visited.insert(node.get()).second) {
+      return;
+    }
+    if (isList(node->symbol)) {
+      for (auto &child : pget<std::vector<Node::Shared>>(node->data)) {
+        countNodes(child, visited);
+      }
+    } else if (isUnary(node->symbol)) {
+      countNodes(pget<Node::Shared>(node->data), visited);
+    } else if (node->symbol == Symbol::PRECEDENCE) {
+      for (auto &child : precedenceChildren(*node)) {
+        countNodes(child, visited);
+      }
+    }
+  }
+
+  void collectRules(const Node::Shared &node, std::vector<std::shared_ptr<Rule>> &rules,
+                    std::unordered_set<const Rule *> &visited) {
+    if (auto rule = getRule(*node)) {
+      if (visited.insert(rule.get()).second) {
+        rules.push_back(rule);
+      }
+    } else if (isList(node->symbol)) {
+      for (auto &child : pget<std::vector<Node::Shared>>(node->data)) {
+        collectRules(child, rules, visited);
+      }
+    } else if (isUnary(node->symbol)) {
+      collectRules(pget<Node::Shared>(node->data), rules, visited);
+    } else if (node->symbol == Symbol::PRECEDENCE) {
+      for (auto &child : precedenceChildren(*node)) {
+        collectRules(child, rules, visited);
+      }
+    }
+  }
+
+}  // namespace
+
+std::ostream &peg_parser::grammar::operator<<(std::ostream &stream,
+                                              const OptimizationStatistics &statistics) {
+  stream << "optimized " << statistics.rules << " rules: " << statistics.nodesBefore << " -> "
+         << statistics.nodesAfter << " nodes";
+  return stream;
+}
+
+Node::Shared peg_parser::grammar::optimize(const Node::Shared &node) {
+  return Optimizer().optimize(node);
+}
+
+OptimizationStatistics peg_parser::grammar::optimize(const std::shared_ptr<Rule> &start) {
+  std::vector<std::shared_ptr<Rule>> rules{start};
+  std::unordered_set<const Rule *> visited{start.get()};
+  for (size_t i = 0; i < rules.size(); ++i) {
+    collectRules(rules[i]->node, rules, visited);
+  }
+
+  OptimizationStatistics statistics;
+  statistics.rules = rules.size();
+  std::unordered_set<const Node *> before, after;
+  Optimizer optimizer;
+  for (auto &rule : rules) {
+    countNodes(rule->node, before);
+  }
+  for (auto &rule : rules) {
+    rule->node = optimizer.optimize(rule->node);
+    countNodes(rule->node, after);
+  }
+  statistics.nodesBefore = before.size();
+  statistics.nodesAfter = after.size();
+  return statistics;
+}
@@ -1,10 +1,17 @@
 
 #include <easy_iterator.h>
+#include <peg_parser/automaton.h>
+#include <peg_parser/lexer.h>
 #include <peg_parser/parser.h>
 
 #include <algorithm>
+#include <chrono>
+#include <future>
+#include <iterator>
+#include <optional>
 #include <sstream>
 #include <stack>
+#include <thread>
 #include <tuple>
 
 // Macros for debugging parsers
@@ -87,21 +94,248 @@ namespace {
     return stream.str();
   }
 
+  /**
+   * Furthest failure of a parse. Only used when re-parsing a failed input, so successful parses
+   * never pay for error reporting. Expectations refer to grammar nodes and rules and are only
+   * converted to strings once parsing is complete.
+   */
+  struct ErrorTracker {
+    struct Expected {
+      const grammar::Node *node;
+      const grammar::Rule *rule;
+    };
+
+    size_t position = 0;
+    std::shared_ptr<SyntaxTree> context;
+    std::vector<Expected> expected;
+    /** incremented whenever `position` moves, invalidates indices into `expected` */
+    size_t generation = 0;
+    /** expectations inside of predicates are not reported */
+    size_t silenced = 0;
+
+    void fail(size_t p, const std::vector<std::shared_ptr<SyntaxTree>> &stack, Expected e) {
+      if (silenced > 0 || p < position) {
+        return;
+      }
+      if (p > position || generation == 0) {
+        position = p;
+        expected.clear();
+        ++generation;
+        setContext(stack);
+      }
+      expected.push_back(e);
+    }
+
+    /**
+     * Replaces everything expected inside of a rule failing at `position` by the rule itself.
+     * Hidden rules, such as separators, are not reported at all. Not used for the start rule.
+     */
+    void failRule(const grammar::Rule &rule, const std::vector<std::shared_ptr<SyntaxTree>> &stack,
+                  size_t previousGeneration, size_t previousCount) {
+      if (generation == previousGeneration) {
+        if (expected.size() == previousCount) {
+          return;
+        }
+        expected.resize(previousCount);
+      } else {
+        expected.clear();
+      }
+      if (!rule.hidden) {
+        setContext(stack);
+        expected.push_back(Expected{nullptr, &rule});
+      }
+    }
+
+    void setContext(const std::vector<std::shared_ptr<SyntaxTree>> &stack) {
+      context.reset();
+      for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
+        if (!(*it)->rule->hidden) {
+          context = *it;
+          break;
+        }
+      }
+    }
+  };
+
+  /** Resources used by a parse, throws once they exceed the `ParseLimits` */
+  class Budget {
+  private:
+    ParseLimits limits;
+    size_t steps = 0;
+    size_t syntaxTrees = 0;
+    size_t cacheEntries = 0;
+    size_t memory = 0;
+    std::chrono::steady_clock::time_point deadline;
+    bool hasDeadline;
+
+    void allocate(size_t bytes) {
+      memory += bytes;
+      if (memory > limits.memory) {
+        throw Parser::LimitError(Parser::LimitError::MEMORY, limits.memory);
+      }
+    }
+
+  public:
+    explicit Budget(const ParseLimits &l = ParseLimits())
+        : limits(l), hasDeadline(l.time != std::chrono::steady_clock::duration::max()) {
+      if (hasDeadline) {
+        deadline = std::chrono::steady_clock::now() + limits.time;
+      }
+    }
+
+    size_t maxDepth() const { return limits.depth; }
+    size_t stepCount() const { return steps; }
+
+    void step() {
+      if (++steps > limits.steps) {
+        throw Parser::LimitError(Parser::LimitError::STEPS, limits.steps);
+      }
+      // reading the clock is much more expensive than a step
+      if (hasDeadline && steps % 4096 == 0 && std::chrono::steady_clock::now() > deadline) {
+        auto time = std::chrono::duration_cast<std::chrono::microseconds>(limits.time);
+        throw Parser::LimitError(Parser::LimitError::TIME, size_t(time.count()));
+      }
+    }
+
+    void addSyntaxTree() {
+      if (++syntaxTrees > limits.syntaxTrees) {
+        throw Parser::LimitError(Parser::LimitError::SYNTAX_TREES, limits.syntaxTrees);
+      }
+      // the tree, its shared control block and its entry in the parent tree
+      allocate(sizeof(SyntaxTree) + 2 * sizeof(std::shared_ptr<SyntaxTree>));
+    }
+
+    void addCacheEntry(size_t bytes) {
+      if (++cacheEntries > limits.cacheEntries) {
+        throw Parser::LimitError(Parser::LimitError::CACHE_ENTRIES, limits.cacheEntries);
+      }
+      allocate(bytes);
+    }
+  };
+
+  struct Frame;
+
   class State {
   public:
+    using CacheKey = std::tuple<size_t, grammar::Rule *>;
+
+    /** Cached result of a rule parsed without a syntax tree */
+    struct Match {
+      enum Status { ACTIVE, FAILED, MATCHED } status;
+      size_t end;
+      bool recursive;
+    };
+
+    /**
+     * Rule parsed without a syntax tree. `frame` is its index in `frames` and `depth` the size of
+     * `stack` when it was entered.
+     */
+    struct TreelessRule {
+      size_t frame;
+      size_t begin;
+      size_t depth;
+    };
+
     std::string_view string;
+    ErrorTracker *errors = nullptr;
+    std::vector<Parser::Error> *recoveredErrors = nullptr;
+    /** if set, only the rules in `captures->trees` create syntax trees */
+    const Parser::Captures *captures = nullptr;
+    /** if set, no rule creates a syntax tree */
+    bool recognizeOnly = false;
+    /** if set, committed syntax trees are passed to the handler and removed */
+    Parser::EventHandler *events = nullptr;
 
   private:
-    size_t position;
-    using CacheKey = std::tuple<size_t, grammar::Rule *>;
-    using Cache = std::unordered_map<CacheKey, std::shared_ptr<SyntaxTree>, TupleHasher<CacheKey>>;
-    Cache cache;
-    std::shared_ptr<SyntaxTree> errorTree;
+    size_t position = 0;
+    /** lexer that split the input into `tokens`, set once a token rule has been called */
+    const grammar::Lexer *lexer = nullptr;
+    std::vector<grammar::Token> tokens;
+    /** index of the last token found */
+    size_t tokenIndex = 0;
+    /** cached syntax trees by their beginning */
+    std::unordered_map<size_t, std::vector<std::shared_ptr<SyntaxTree>>> cache;
+    size_t cacheSize = 0;
+
+  public:
+    /** number of backtracking positions that have not been released */
+    size_t openSaves = 0;
+    /** number of rules in `stack` that have been entered by `events` */
+    size_t enteredDepth = 0;
+    /** the parser will not backtrack before this position anymore */
+    size_t committedPosition = 0;
+    size_t nextCachePrune = 1024;
+
+    void emit(const SyntaxTree &tree) {
+      events->enter(*tree.rule, tree.begin);
+      emitInner(tree);
+    }
+
+    void emitInner(const SyntaxTree &tree) {
+      for (auto &inner : tree.inner) {
+        emit(*inner);
+      }
+      events->exit(*tree.rule, tree.begin, tree.end);
+    }
+
+    /** Drops cached trees the parser cannot return to */
+    void pruneCache() {
+      for (auto it = cache.begin(); it != cache.end();) {
+        if (it->first < committedPosition) {
+          cacheSize -= it->second.size();
+          it = cache.erase(it);
+        } else {
+          ++it;
+        }
+      }
+      nextCachePrune = std::max<size_t>(1024, 2 * cacheSize);
+    }
 
   public:
-    size_t maxPosition;
+    size_t maxPosition = 0;
+    std::unordered_map<CacheKey, Match, TupleHasher<CacheKey>> matches;
+    /**
+     * keys added to `matches` within left recursive rules, used to invalidate them when growing
+     * the rules
+     */
+    std::vector<CacheKey> matchLog;
+    /** number of left recursive rules without syntax tree being parsed */
+    size_t leftRecursions = 0;
+    std::vector<TreelessRule> treelessRules;
+    /** explicit stack of the nodes and rules being parsed */
+    std::vector<Frame> frames;
+
+    /**
+     * Operand of a precedence node that has not been combined with the following one yet.
+     * `innerBegin` and `opInnerBegin` are indices in the inner trees of the current rule.
+     */
+    struct Operation {
+      size_t begin;
+      size_t innerBegin;
+      /** index of the following operator */
+      size_t op;
+      /** end of the operand, where the following operator begins */
+      size_t opBegin;
+      size_t opInnerBegin;
+    };
+
+    /** pending operations of the precedence nodes being parsed */
+    std::vector<Operation> operations;
+    Budget budget;
+
+    State() {}
+    State(const std::string_view &s, const ParseLimits &limits) { start(s, limits); }
 
-    State(const std::string_view &s, size_t c = 0) : string(s), position(c), maxPosition(c) {}
+    void start(const std::string_view &s, const ParseLimits &limits) {
+      string = s;
+      budget = Budget(limits);
+    }
+
+    /**
+     * Resets the state after a parse. Allocated memory is kept, including the cache entries of
+     * the positions of short inputs.
+     */
+    void clear();
 
     grammar::Letter current() { return position < string.size() ? string[position] : '\0'; }
 
@@ -126,14 +360,53 @@ namespace {
 
     size_t getPosition() { return position; }
 
+    /** Returns the token of `l` beginning at the current position, if there is one */
+    const grammar::Token *findToken(const grammar::Lexer &l) {
+      if (lexer != &l) {
+        lexer = &l;
+        l.tokenize(string, tokens);
+        tokenIndex = 0;
+      }
+      // the parser mostly moves forward, so the current and the next token are checked first
+      for (auto index : {tokenIndex, tokenIndex + 1}) {
+        if (index < tokens.size() && tokens[index].begin == position) {
+          tokenIndex = index;
+          return &tokens[index];
+        }
+      }
+      auto it = std::lower_bound(tokens.begin(), tokens.end(), position,
+                                 [](auto &token, size_t p) { return token.begin < p; });
+      if (it == tokens.end() || it->begin != position) {
+        return nullptr;
+      }
+      tokenIndex = size_t(it - tokens.begin());
+      return &*it;
+    }
+
     struct Saved {
       size_t position;
       size_t innerCount;
+      bool backtracking;
     };
 
-    Saved save() { return Saved{position, stack.size() > 0 ? stack.back()->inner.size() : 0}; }
+    /**
+     * Saves the current position. Backtracking positions may still be restored after inner
+     * rules have succeeded and must be released by either `load` or `release`.
+     */
+    Saved save(bool backtracking = true) {
+      openSaves += backtracking;
+      return Saved{position, stack.size() > 0 ? stack.back()->inner.size() : 0, backtracking};
+    }
+
+    void release(const Saved &s) {
+      openSaves -= s.backtracking;
+      if (events && s.backtracking && openSaves == 0) {
+        commitInnerSyntaxTrees();
+      }
+    }
 
     void load(const Saved &s) {
+      openSaves -= s.backtracking;
       if (stack.size() > 0) {
         stack.back()->end = getPosition();
         stack.back()->inner.resize(s.innerCount);
@@ -144,159 +417,264 @@ namespace {
     bool isAtEnd() { return position == string.size(); }
 
     std::shared_ptr<SyntaxTree> getCached(const std::shared_ptr<grammar::Rule> &rule) {
-      auto it = cache.find(std::make_pair(position, rule.get()));
-      if (it != cache.end()) return it->second;
+      auto it = cache.find(position);
+      if (it != cache.end()) {
+        for (auto &tree : it->second) {
+          if (tree->rule == rule) {
+            return tree;
+          }
+        }
+      }
       return std::shared_ptr<SyntaxTree>();
     }
 
     void addToCache(const std::shared_ptr<SyntaxTree> &tree) {
-      cache[std::make_pair(tree->begin, tree->rule.get())] = tree;
+      auto &trees = cache[tree->begin];
+      for (auto &cached : trees) {
+        if (cached->rule == tree->rule) {
+          cached = tree;
+          return;
+        }
+      }
+      budget.addCacheEntry(sizeof(tree));
+      trees.push_back(tree);
+      ++cacheSize;
+      if (events && cacheSize >= nextCachePrune) {
+        pruneCache();
+      }
     }
 
-    const Cache &getCache() { return cache; }
+    /** number of left recursions currently being grown */
+    size_t growing = 0;
+    /** trees cached at the beginning of each growing left recursion, restored once grown */
+    std::vector<std::vector<std::shared_ptr<SyntaxTree>>> growingCaches;
 
-    void removeFromCache(const std::shared_ptr<SyntaxTree> &tree) {
-      auto it = cache.find(std::make_pair(tree->begin, tree->rule.get()));
+    /** Removes and returns the cached trees beginning at `p` */
+    std::vector<std::shared_ptr<SyntaxTree>> takeCached(size_t p) {
+      std::vector<std::shared_ptr<SyntaxTree>> trees;
+      auto it = cache.find(p);
       if (it != cache.end()) {
+        trees = std::move(it->second);
+        cacheSize -= trees.size();
         cache.erase(it);
       }
+      return trees;
+    }
+
+    /** Replaces the cached trees beginning at `p` by ones taken by `takeCached` */
+    void restoreCached(size_t p, std::vector<std::shared_ptr<SyntaxTree>> trees) {
+      auto &cached = cache[p];
+      cacheSize = cacheSize - cached.size() + trees.size();
+      cached = std::move(trees);
     }
 
     void addInnerSyntaxTree(const std::shared_ptr<SyntaxTree> &tree) {
-      if (stack.size() > 0 && !tree->rule->hidden) {
-        stack.back()->inner.push_back(tree);
+      if (stack.size() > 0 && !tree->rule->hidden && !tree->recovered) {
+        auto &inner = stack.back()->inner;
+        if (!captures || captures->captured.count(tree->rule.get())) {
+          inner.push_back(tree);
+        } else {
+          // rules that are not captured only contain captured rules
+          inner.insert(inner.end(), tree->inner.begin(), tree->inner.end());
+        }
       }
     }
 
-    std::vector<std::shared_ptr<SyntaxTree>> stack;
-
-    std::shared_ptr<SyntaxTree> getErrorTree() { return errorTree; }
-
-    void trackError(const std::shared_ptr<SyntaxTree> &tree) {
-      if (!tree) {
+    /**
+     * Passes the inner trees of the innermost rule to `events`, if no rule in `stack` can fail or
+     * be replaced by a left recursion anymore. Called after an inner rule succeeded or the last
+     * backtracking position was released.
+     */
+    void commitInnerSyntaxTrees() {
+      if (stack.empty()) {
         return;
       }
-      if (tree->length() > 0 && !tree->rule->hidden) {
-        if (errorTree) {
-          if (tree->end >= errorTree->end) {
-            errorTree = tree;
-          }
+      // only the last inner tree may have been entered, as entered rules are always committed
+      auto entered = enteredDepth > stack.size();
+      if (entered) {
+        enteredDepth = stack.size();
+      }
+      if (openSaves > 0 || growing > 0 || position <= stack.back()->begin) {
+        return;
+      }
+      for (auto &tree : stack) {
+        if (tree->recursive || tree->rule->hidden) {
+          return;
+        }
+      }
+      for (; enteredDepth < stack.size(); ++enteredDepth) {
+        events->enter(*stack[enteredDepth]->rule, stack[enteredDepth]->begin);
+      }
+      auto &inner = stack.back()->inner;
+      for (size_t i = 0; i < inner.size(); ++i) {
+        if (entered && i + 1 == inner.size()) {
+          emitInner(*inner[i]);
         } else {
-          errorTree = tree;
+          emit(*inner[i]);
         }
       }
+      inner.clear();
+      committedPosition = position;
     }
-  };
 
-  bool parse(const std::shared_ptr<grammar::Node> &node, State &state);
-
-  std::shared_ptr<SyntaxTree> parseRule(const std::shared_ptr<grammar::Rule> &rule, State &state,
-                                        bool useCache = true) {
-    PARSER_TRACE("enter rule " << rule->name);
-    INCREASE_INDENT;
+    bool createsSyntaxTree(const grammar::Rule &rule) const {
+      if (recognizeOnly) {
+        return false;
+      }
+      return !captures || captures->trees.count(&rule);
+    }
 
-    if (useCache && rule->cacheable) {
-      auto cached = state.getCached(rule);
+    std::vector<std::shared_ptr<SyntaxTree>> stack;
 
-      if (cached) {
-        PARSER_TRACE("cached");
-        if (cached->valid) {
-          state.addInnerSyntaxTree(cached);
-          state.advance();
-          state.setPosition(cached->end);
-        } else {
-          PARSER_TRACE("failed");
-          if (cached->active && !cached->recursive) {
-            PARSER_TRACE("found left recursion");
-            cached->recursive = true;
-          }
-        }
-        DECREASE_INDENT;
-        PARSER_TRACE("exit rule " << rule->name);
-        return cached;
+    void fail(const grammar::Node &node) {
+      if (errors) {
+        errors->fail(position, stack, ErrorTracker::Expected{&node, nullptr});
       }
     }
 
-    auto syntaxTree = std::make_shared<SyntaxTree>(rule, state.string, state.getPosition());
-
-    if (useCache) {
-      state.addToCache(syntaxTree);
+    void fail(const grammar::Rule &rule) {
+      if (errors && !rule.hidden) {
+        errors->fail(position, stack, ErrorTracker::Expected{nullptr, &rule});
+      }
     }
+  };
 
-    auto saved = state.save();
-    state.stack.push_back(syntaxTree);
-    syntaxTree->valid = parse(rule->node, state);
-    syntaxTree->end = state.getPosition();
-    syntaxTree->active = false;
-    state.stack.pop_back();
+  std::string expectationToString(const ErrorTracker::Expected &expected) {
+    if (expected.rule) {
+      return expected.rule->name;
+    }
+    if (!expected.node || expected.node->symbol == grammar::Node::Symbol::END_OF_FILE) {
+      return "end of input";
+    }
+    if (expected.node->symbol == grammar::Node::Symbol::ANY) {
+      return "any character";
+    }
+    return streamToString(*expected.node);
+  }
 
-    if (syntaxTree->valid) {
-      if (useCache && syntaxTree->recursive) {
-        PARSER_TRACE("enter left recursion: " << rule->name);
-        while (true) {
-          State recursionState(state.string, syntaxTree->begin);
-          recursionState.trackError(state.getErrorTree());
-          // Copy the cache except the currect position to the recursion state
-          // TODO: keeping the current state and modifying the cache in place is
-          // probably much more efficient.
-          for (auto &cached : state.getCache()) {
-            if (std::get<0>(cached.first) != syntaxTree->begin) {
-              recursionState.addToCache(cached.second);
-            }
-          }
-          recursionState.addToCache(syntaxTree);
-          auto tmp = parseRule(rule, recursionState, false);
-          state.trackError(recursionState.getErrorTree());
-          if (tmp->valid && tmp->end > syntaxTree->end) {
-            PARSER_TRACE("parsed left recursion");
-            syntaxTree = tmp;
-            if (useCache) {
-              state.addToCache(syntaxTree);
-            }
-            state.setPosition(tmp->end);
-          } else {
-            break;
-          }
+  /** Creates the error for the furthest failure or, if there is none, `fallback` */
+  Parser::Error createError(const ErrorTracker &errors,
+                            const std::shared_ptr<SyntaxTree> &fallback) {
+    Parser::Error error{fallback, {}};
+    if (errors.generation > 0 && errors.position >= fallback->begin) {
+      auto context = errors.context ? errors.context : fallback;
+      error.syntax = std::make_shared<SyntaxTree>(context->rule, fallback->fullString,
+                                                  context->begin);
+      error.syntax->end = errors.position;
+      for (auto &expected : errors.expected) {
+        auto name = expectationToString(expected);
+        if (std::find(error.expected.begin(), error.expected.end(), name)
+            == error.expected.end()) {
+          error.expected.push_back(name);
         }
-        PARSER_TRACE("exit left recursion");
       }
+    }
+    return error;
+  }
 
-      state.addInnerSyntaxTree(syntaxTree);
-    } else {
-      state.trackError(syntaxTree);
-      state.load(saved);
+  /** Removes the matches at `position` added after `logSize` from the cache */
+  void invalidateMatches(State &state, size_t logSize, size_t position,
+                         const grammar::Rule *except) {
+    for (auto i = logSize; i < state.matchLog.size(); ++i) {
+      auto &key = state.matchLog[i];
+      if (std::get<0>(key) == position && std::get<1>(key) != except) {
+        state.matches.erase(key);
+      }
     }
+    state.matchLog.resize(logSize);
+  }
 
-    DECREASE_INDENT;
-    PARSER_TRACE("exit rule " << rule->name);
+  /**
+   * Grammar node or rule on the explicit parser stack. `stage` is the point to continue at once
+   * the current child has been parsed, stage 0 enters the node.
+   */
+  struct Frame {
+    enum Type : uint8_t { NODE, RULE, TREELESS_RULE } type;
+    uint8_t stage = 0;
+    /** rules are looked up in and added to the cache */
+    bool useCache = true;
+    const grammar::Node *node = nullptr;
+    std::shared_ptr<grammar::Rule> rule;
+    std::shared_ptr<SyntaxTree> tree;
+    State::Saved saved{0, 0, false};
+    /** index of the current child */
+    size_t index = 0;
+    size_t errorGeneration = 0;
+    size_t errorCount = 0;
+    /** error tracker disabled during recovery */
+    ErrorTracker *errors = nullptr;
+    State::Match *match = nullptr;
+    size_t logSize = 0;
+    /** end of the current seed of a left recursion without syntax tree */
+    size_t end = 0;
+
+    explicit Frame(const grammar::Node *n) : type(NODE), node(n) {}
+    Frame(Type t, std::shared_ptr<grammar::Rule> r, bool c = true)
+        : type(t), useCache(c), rule(std::move(r)) {}
+  };
 
-    return syntaxTree;
+  void State::clear() {
+    string = std::string_view();
+    errors = nullptr;
+    recoveredErrors = nullptr;
+    captures = nullptr;
+    recognizeOnly = false;
+    events = nullptr;
+    position = 0;
+    lexer = nullptr;
+    tokens.clear();
+    tokenIndex = 0;
+    maxPosition = 0;
+    // positions of short inputs are likely to be used again, so only their trees are released
+    if (cache.size() > 4096) {
+      cache.clear();
+    } else {
+      for (auto &trees : cache) {
+        trees.second.clear();
+      }
+    }
+    cacheSize = 0;
+    openSaves = 0;
+    enteredDepth = 0;
+    committedPosition = 0;
+    nextCachePrune = 1024;
+    growing = 0;
+    growingCaches.clear();
+    matches.clear();
+    matchLog.clear();
+    leftRecursions = 0;
+    treelessRules.clear();
+    frames.clear();
+    operations.clear();
+    stack.clear();
+    budget = Budget();
   }
 
-  bool parse(const std::shared_ptr<grammar::Node> &node, State &state) {
-    using Node = peg_parser::grammar::Node;
-    using Symbol = Node::Symbol;
-
-    PARSER_TRACE("parsing " << *node);
+  /** Parses nodes that do not contain other nodes or rules */
+  bool parseTerminal(const grammar::Node::Shared &node, State &state) {
+    using Symbol = grammar::Node::Symbol;
 
     auto c = state.current();
     switch (node->symbol) {
-      case peg_parser::grammar::Node::Symbol::WORD: {
+      case Symbol::WORD: {
         auto saved = state.save();
         for (auto c : pget<std::string>(node->data)) {
           if (state.current() != c) {
             state.load(saved);
+            state.fail(*node);
             PARSER_TRACE("failed");
             return false;
           }
           state.advance();
         }
+        state.release(saved);
         return true;
       }
 
-      case peg_parser::grammar::Node::Symbol::ANY: {
+      case Symbol::ANY: {
         if (state.isAtEnd()) {
           PARSER_TRACE("failed");
+          state.fail(*node);
           return false;
         } else {
           state.advance();
@@ -311,103 +689,54 @@ namespace {
           return true;
         } else {
           PARSER_TRACE("failed");
+          state.fail(*node);
           return false;
         }
       }
 
-      case Symbol::SEQUENCE: {
-        auto saved = state.save();
-        for (auto n : pget<std::vector<grammar::Node::Shared>>(node->data)) {
-          if (!parse(n, state)) {
-            state.load(saved);
-            return false;
-          }
-        }
-        return true;
-      }
-
-      case Symbol::CHOICE: {
-        for (auto n : pget<std::vector<grammar::Node::Shared>>(node->data)) {
-          if (parse(n, state)) {
-            return true;
-          }
-        }
-        return false;
-      }
-
-      case Symbol::ZERO_OR_MORE: {
-        auto data = pget<Node::Shared>(node->data);
-        while (parse(data, state)) {
-        }
-        return true;
-      }
-
-      case peg_parser::grammar::Node::Symbol::ONE_OR_MORE: {
-        const auto &data = pget<Node::Shared>(node->data);
-        if (!parse(data, state)) {
+      case Symbol::CHARACTER_SET: {
+        auto &set = pget<grammar::Node::CharacterSet>(node->data);
+        if (set[static_cast<unsigned char>(c)]) {
+          state.advance();
+          return true;
+        } else {
+          PARSER_TRACE("failed");
+          state.fail(*node);
           return false;
         }
-        while (parse(data, state)) {
-        }
-        return true;
-      }
-
-      case peg_parser::grammar::Node::Symbol::OPTIONAL: {
-        const auto &data = pget<Node::Shared>(node->data);
-        parse(data, state);
-        return true;
-      }
-
-      case peg_parser::grammar::Node::Symbol::ALSO: {
-        const auto &data = pget<Node::Shared>(node->data);
-        auto saved = state.save();
-        auto result = parse(data, state);
-        state.load(saved);
-        return result;
-      }
-
-      case peg_parser::grammar::Node::Symbol::NOT: {
-        const auto &data = pget<Node::Shared>(node->data);
-        auto saved = state.save();
-        auto result = parse(data, state);
-        state.load(saved);
-        return !result;
       }
 
-      case peg_parser::grammar::Node::Symbol::ERROR: {
+      case Symbol::ERROR: {
         return false;
       }
 
-      case peg_parser::grammar::Node::Symbol::EMPTY: {
+      case Symbol::EMPTY: {
         return true;
       }
 
-      case peg_parser::grammar::Node::Symbol::RULE: {
-        const auto &rule = pget<std::shared_ptr<grammar::Rule>>(node->data);
-        return parseRule(rule, state)->valid;
-      }
-
-      case peg_parser::grammar::Node::Symbol::WEAK_RULE: {
-        const auto &data = pget<std::weak_ptr<grammar::Rule>>(node->data);
-        if (auto rule = data.lock()) {
-          return parseRule(rule, state)->valid;
-        } else {
-          throw Parser::GrammarError(Parser::GrammarError::INVALID_RULE, node);
-        }
-      }
-
-      case peg_parser::grammar::Node::Symbol::END_OF_FILE: {
+      case Symbol::END_OF_FILE: {
         auto res = state.isAtEnd();
         if (!res) {
           PARSER_TRACE("failed");
+          state.fail(*node);
         }
         return res;
       }
 
-      case peg_parser::grammar::Node::Symbol::FILTER: {
+      case Symbol::FILTER: {
         const auto &callback = pget<grammar::Node::FilterCallback>(node->data);
         bool res;
-        if (state.stack.size() > 0) {
+        if (!state.treelessRules.empty()
+            && state.treelessRules.back().depth == state.stack.size()) {
+          // the current rule has no syntax tree, so the filter gets one without inner trees
+          auto &current = state.treelessRules.back();
+          state.budget.addSyntaxTree();
+          auto tree = std::make_shared<SyntaxTree>(state.frames[current.frame].rule, state.string,
+                                                   current.begin);
+          tree->end = state.getPosition();
+          res = callback(tree);
+          state.setPosition(tree->end);
+        } else if (state.stack.size() > 0) {
           auto tree = state.stack.back();
           tree->end = state.getPosition();
           res = callback(tree);
@@ -420,57 +749,1272 @@ namespace {
         }
         return res;
       }
+
+      default:
+        break;
     }
 
     throw Parser::GrammarError(Parser::GrammarError::UNKNOWN_SYMBOL, node);
   }
 
-}  // namespace
+  /**
+   * Parses rules using the explicit stack `State::frames` instead of recursion, so the nesting
+   * depth of the input is only limited by `ParseLimits::depth` and never by the C++ stack.
+   */
+  class Executor {
+  private:
+    State &state;
+    std::vector<Frame> &frames;
+    /** result of the last parsed node */
+    bool result = false;
+    /** syntax tree of the last parsed rule */
+    std::shared_ptr<SyntaxTree> tree;
+    size_t depth = 0;
+    /** number of frames below the rule being run */
+    size_t base = 0;
 
-SyntaxTree::SyntaxTree(const std::shared_ptr<grammar::Rule> &r, std::string_view s, size_t p)
-    : rule(r), fullString(s), begin(p), end(p), valid(false), active(true) {}
+  public:
+    explicit Executor(State &s) : state(s), frames(s.frames) {}
 
-const char *peg_parser::Parser::GrammarError::what() const noexcept {
-  if (buffer.size() == 0) {
-    std::string typeName;
-    switch (type) {
-      case UNKNOWN_SYMBOL:
-        typeName = "UNKNOWN_SYMBOL";
-        break;
-      case INVALID_RULE:
-        typeName = "INVALID_RULE";
-        break;
+    std::shared_ptr<SyntaxTree> parseRule(const std::shared_ptr<grammar::Rule> &rule) {
+      enter(Frame::RULE, rule);
+      resume();
+      return tree;
     }
-    buffer = "internal error in grammar node (" + typeName + "): " + streamToString(*node);
-  }
-  return buffer.c_str();
-}
 
-Parser::Parser(const std::shared_ptr<grammar::Rule> &g) : grammar(g) {}
+    bool recognizeRule(const std::shared_ptr<grammar::Rule> &rule) {
+      enter(Frame::TREELESS_RULE, rule);
+      resume();
+      return result;
+    }
 
-Parser::Result Parser::parseAndGetError(const std::string_view &str,
-                                        std::shared_ptr<grammar::Rule> grammar) {
-  State state(str);
-  PARSER_TRACE("Begin parsing of: '" << str << "'");
-  auto result = parseRule(grammar, state);
-  auto error = state.getErrorTree();
-  if (!error) {
-    error = result;
-  }
-  return Parser::Result{result, error};
-}
+    /** Begins to parse `rule`, which is continued by `resume` */
+    void enter(Frame::Type type, const std::shared_ptr<grammar::Rule> &rule) {
+      base = frames.size();
+      pushRule(type, rule);
+    }
 
-std::shared_ptr<SyntaxTree> Parser::parse(const std::string_view &str,
-                                          std::shared_ptr<grammar::Rule> grammar) {
-  return parseAndGetError(str, grammar).syntax;
-}
+    /**
+     * Continues the rule until it has been parsed or the step count reaches `steps`, checked
+     * between frames. Returns true once the rule has been parsed.
+     */
+    bool resume(size_t steps = std::numeric_limits<size_t>::max()) {
+      while (frames.size() > base) {
+        if (state.budget.stepCount() >= steps) {
+          return false;
+        }
+        auto &top = frames.back();
+        switch (top.type) {
+          case Frame::NODE:
+            parseNode(top);
+            break;
+          case Frame::RULE:
+            parseRule(top);
+            break;
+          case Frame::TREELESS_RULE:
+            parseTreelessRule(top);
+            break;
+        }
+      }
+      return true;
+    }
 
-std::shared_ptr<SyntaxTree> Parser::parse(const std::string_view &str) const {
-  return parse(str, grammar);
-}
+    /** syntax tree of the rule parsed by `resume` */
+    const std::shared_ptr<SyntaxTree> &parsedTree() const { return tree; }
 
-Parser::Result Parser::parseAndGetError(const std::string_view &str) const {
-  return parseAndGetError(str, grammar);
+  private:
+    void pushRule(Frame::Type type, std::shared_ptr<grammar::Rule> rule, bool useCache = true) {
+      if (++depth > state.budget.maxDepth()) {
+        throw Parser::LimitError(Parser::LimitError::DEPTH, state.budget.maxDepth());
+      }
+      frames.emplace_back(type, std::move(rule), useCache);
+    }
+
+    void finish(bool r) {
+      auto &frame = frames.back();
+      if (frame.type != Frame::NODE) {
+        --depth;
+        if (frame.type == Frame::RULE) {
+          tree = std::move(frame.tree);
+        }
+      }
+      result = r;
+      frames.pop_back();
+    }
+
+    /** Parses `node` right away if it is a terminal and otherwise pushes it to the stack */
+    void call(const grammar::Node::Shared &node) {
+      using Symbol = grammar::Node::Symbol;
+
+      PARSER_TRACE("parsing " << *node);
+      state.budget.step();
+      switch (node->symbol) {
+        case Symbol::SEQUENCE:
+        case Symbol::CHOICE:
+        case Symbol::ZERO_OR_MORE:
+        case Symbol::ONE_OR_MORE:
+        case Symbol::OPTIONAL:
+        case Symbol::ALSO:
+        case Symbol::NOT:
+        case Symbol::PRECEDENCE: {
+          frames.emplace_back(node.get());
+          return;
+        }
+
+        case Symbol::RULE: {
+          callRule(pget<std::shared_ptr<grammar::Rule>>(node->data));
+          return;
+        }
+
+        case Symbol::WEAK_RULE: {
+          const auto &data = pget<std::weak_ptr<grammar::Rule>>(node->data);
+          if (auto rule = data.lock()) {
+            callRule(std::move(rule));
+            return;
+          } else {
+            throw Parser::GrammarError(Parser::GrammarError::INVALID_RULE, node);
+          }
+        }
+
+        default: {
+          result = parseTerminal(node, state);
+          return;
+        }
+      }
+    }
+
+    /** Calls `node` and returns true if it has been parsed right away */
+    bool callNow(const grammar::Node::Shared &node) {
+      auto size = frames.size();
+      call(node);
+      return frames.size() == size;
+    }
+
+    /**
+     * Parses the node of `rule`, right away by its token or by its automaton unless errors are
+     * reported
+     */
+    void callRuleNode(const grammar::Rule &rule) {
+      if (rule.lexer) {
+        state.budget.step();
+        return matchToken(rule);
+      }
+      if (!rule.automaton || state.errors) {
+        return call(rule.node);
+      }
+      state.budget.step();
+      auto end = rule.automaton->match(state.string, state.getPosition());
+      result = end != grammar::Automaton::npos;
+      if (result) {
+        state.advance(end - state.getPosition());
+      }
+    }
+
+    /** Matches the token rule `rule`, splitting the input into tokens on its first call */
+    void matchToken(const grammar::Rule &rule) {
+      auto token = state.findToken(*rule.lexer);
+      result = token && rule.lexer->getRule(*token) == &rule;
+      if (result) {
+        state.advance(token->end - state.getPosition());
+      } else {
+        state.fail(rule);
+      }
+    }
+
+    /** Parses a token rule right away, it is not cached as finding its token is cheaper */
+    void callToken(std::shared_ptr<grammar::Rule> rule) {
+      auto begin = state.getPosition();
+      matchToken(*rule);
+      if (!result || !state.createsSyntaxTree(*rule)) {
+        return;
+      }
+      state.budget.addSyntaxTree();
+      auto syntaxTree = std::make_shared<SyntaxTree>(rule, state.string, begin);
+      syntaxTree->end = state.getPosition();
+      syntaxTree->valid = true;
+      syntaxTree->active = false;
+      state.addInnerSyntaxTree(syntaxTree);
+      if (state.events) {
+        state.commitInnerSyntaxTrees();
+      }
+    }
+
+    void callRule(std::shared_ptr<grammar::Rule> rule) {
+      if (rule->lexer) {
+        return callToken(std::move(rule));
+      }
+      auto type = state.createsSyntaxTree(*rule) ? Frame::RULE : Frame::TREELESS_RULE;
+      pushRule(type, std::move(rule));
+    }
+
+    void parseNode(Frame &frame) {
+      using Symbol = grammar::Node::Symbol;
+      using Node = grammar::Node;
+
+      auto &node = *frame.node;
+      switch (node.symbol) {
+        case Symbol::SEQUENCE: {
+          auto &children = pget<std::vector<Node::Shared>>(node.data);
+          if (frame.stage == 0) {
+            frame.saved = state.save();
+            frame.stage = 1;
+          } else if (!result) {
+            state.load(frame.saved);
+            return finish(false);
+          } else {
+            ++frame.index;
+          }
+          for (; frame.index < children.size(); ++frame.index) {
+            if (!callNow(children[frame.index])) {
+              return;
+            }
+            if (!result) {
+              state.load(frame.saved);
+              return finish(false);
+            }
+          }
+          state.release(frame.saved);
+          return finish(true);
+        }
+
+        case Symbol::CHOICE: {
+          auto &children = pget<std::vector<Node::Shared>>(node.data);
+          if (frame.stage == 0) {
+            frame.stage = 1;
+          } else if (result) {
+            return finish(true);
+          } else {
+            ++frame.index;
+          }
+          for (; frame.index < children.size(); ++frame.index) {
+            if (!callNow(children[frame.index])) {
+              return;
+            }
+            if (result) {
+              return finish(true);
+            }
+          }
+          return finish(false);
+        }
+
+        case Symbol::ZERO_OR_MORE: {
+          if (frame.stage == 0 || result) {
+            frame.stage = 1;
+            do {
+              if (!callNow(pget<Node::Shared>(node.data))) {
+                return;
+              }
+            } while (result);
+          }
+          return finish(true);
+        }
+
+        case Symbol::ONE_OR_MORE: {
+          if (frame.stage == 0) {
+            frame.stage = 1;
+            return call(pget<Node::Shared>(node.data));
+          }
+          if (result) {
+            frame.stage = 2;
+            return call(pget<Node::Shared>(node.data));
+          }
+          return finish(frame.stage == 2);
+        }
+
+        case Symbol::OPTIONAL: {
+          if (frame.stage == 0) {
+            frame.stage = 1;
+            return call(pget<Node::Shared>(node.data));
+          }
+          return finish(true);
+        }
+
+        case Symbol::ALSO: {
+          if (frame.stage == 0) {
+            frame.saved = state.save();
+            frame.stage = 1;
+            return call(pget<Node::Shared>(node.data));
+          }
+          state.load(frame.saved);
+          return finish(result);
+        }
+
+        case Symbol::NOT: {
+          if (frame.stage == 0) {
+            frame.saved = state.save();
+            if (state.errors) {
+              ++state.errors->silenced;
+            }
+            frame.stage = 1;
+            return call(pget<Node::Shared>(node.data));
+          }
+          if (state.errors) {
+            --state.errors->silenced;
+          }
+          state.load(frame.saved);
+          return finish(!result);
+        }
+
+        case Symbol::PRECEDENCE: {
+          return parsePrecedence(frame, pget<Node::OperatorTable>(node.data));
+        }
+
+        default:
+          throw std::runtime_error("corrupted grammar node");
+      }
+    }
+
+    /** Inner trees of the innermost rule, or null if it does not create a syntax tree */
+    std::vector<std::shared_ptr<SyntaxTree>> *innerTrees() {
+      if (state.stack.empty()
+          || (!state.treelessRules.empty()
+              && state.treelessRules.back().depth == state.stack.size())) {
+        return nullptr;
+      }
+      return &state.stack.back()->inner;
+    }
+
+    enum PrecedenceStage : uint8_t { OPERAND = 1, OPERATOR };
+
+    /**
+     * Parses operands and operators alternately, keeping the operands whose operation may still
+     * bind to a later operand in `State::operations`. `frame.index` is the operator being tried
+     * and `frame.logSize` the number of operations of enclosing precedence nodes.
+     */
+    void parsePrecedence(Frame &frame, const grammar::Node::OperatorTable &table) {
+      auto &operations = state.operations;
+      switch (frame.stage) {
+        case 0: {
+          frame.saved = state.save();
+          frame.logSize = operations.size();
+          return callOperand(frame, table);
+        }
+
+        case OPERAND: {
+          if (!result) {
+            operations.pop_back();
+            if (operations.size() == frame.logSize) {
+              state.load(frame.saved);
+              return finish(false);
+            }
+            // the expression ends before the last operator
+            state.setPosition(operations.back().opBegin);
+            if (auto inner = innerTrees()) {
+              inner->resize(operations.back().opInnerBegin);
+            }
+            return finishPrecedence(frame, table);
+          }
+          frame.index = 0;
+          frame.stage = OPERATOR;
+          break;
+        }
+
+        case OPERATOR: {
+          if (result) {
+            return applyOperator(frame, table);
+          }
+          state.setPosition(operations.back().opBegin);
+          ++frame.index;
+          break;
+        }
+      }
+
+      for (; frame.index < table.operators.size(); ++frame.index) {
+        auto inner = innerTrees();
+        operations.back().opBegin = state.getPosition();
+        operations.back().opInnerBegin = inner ? inner->size() : 0;
+        if (!callNow(table.operators[frame.index].pattern)) {
+          return;
+        }
+        if (result) {
+          return applyOperator(frame, table);
+        }
+        state.setPosition(operations.back().opBegin);
+      }
+      finishPrecedence(frame, table);
+    }
+
+    void callOperand(Frame &frame, const grammar::Node::OperatorTable &table) {
+      auto inner = innerTrees();
+      state.operations.push_back(
+          State::Operation{state.getPosition(), inner ? inner->size() : 0, 0, 0, 0});
+      frame.stage = OPERAND;
+      call(table.operand);
+    }
+
+    /** Combines the pending operations binding at least as tightly as the parsed operator */
+    void applyOperator(Frame &frame, const grammar::Node::OperatorTable &table) {
+      auto &op = table.operators[frame.index];
+      auto &operations = state.operations;
+      while (operations.size() - frame.logSize > 1) {
+        auto &previous = table.operators[operations[operations.size() - 2].op];
+        if (previous.precedence < op.precedence
+            || (previous.precedence == op.precedence && op.rightAssociative)) {
+          break;
+        }
+        reduceOperation(table);
+      }
+      operations.back().op = frame.index;
+      callOperand(frame, table);
+    }
+
+    void finishPrecedence(Frame &frame, const grammar::Node::OperatorTable &table) {
+      auto &operations = state.operations;
+      auto inner = innerTrees();
+      operations.back().opBegin = state.getPosition();
+      operations.back().opInnerBegin = inner ? inner->size() : 0;
+      while (operations.size() - frame.logSize > 1) {
+        reduceOperation(table);
+      }
+      operations.pop_back();
+      state.release(frame.saved);
+      finish(true);
+    }
+
+    /** Combines the last two operands into the syntax tree of the operator between them */
+    void reduceOperation(const grammar::Node::OperatorTable &table) {
+      auto &operations = state.operations;
+      auto right = operations.back();
+      operations.pop_back();
+      auto &left = operations.back();
+      auto &rule = table.operators[left.op].rule;
+      auto inner = innerTrees();
+      size_t added = 0, removed = 0;
+      if (inner && (!state.captures || state.captures->captured.count(rule.get()))) {
+        auto first = inner->begin() + left.innerBegin;
+        auto last = inner->begin() + right.opInnerBegin;
+        removed = last - first;
+        if (rule->hidden) {
+          inner->erase(first, last);
+        } else {
+          state.budget.addSyntaxTree();
+          auto tree = std::make_shared<SyntaxTree>(rule, state.string, left.begin);
+          tree->end = right.opBegin;
+          tree->valid = true;
+          tree->active = false;
+          tree->inner.assign(std::make_move_iterator(first), std::make_move_iterator(last));
+          inner->insert(inner->erase(first, last), std::move(tree));
+          added = 1;
+        }
+      }
+      left.op = right.op;
+      left.opBegin = right.opBegin;
+      left.opInnerBegin = right.opInnerBegin + added - removed;
+    }
+
+    enum RuleStage : uint8_t { ENTER, PARSED, GROWN, RECOVERING };
+
+    void parseRule(Frame &frame) {
+      auto &rule = frame.rule;
+      switch (frame.stage) {
+        case ENTER: {
+          PARSER_TRACE("enter rule " << rule->name);
+          if (frame.useCache && rule->cacheable) {
+            if (auto cached = state.getCached(rule)) {
+              PARSER_TRACE("cached");
+              if (cached->valid) {
+                state.addInnerSyntaxTree(cached);
+                state.advance();
+                state.setPosition(cached->end);
+                if (state.events) {
+                  state.commitInnerSyntaxTrees();
+                }
+              } else {
+                PARSER_TRACE("failed");
+                if (cached->active && !cached->recursive) {
+                  PARSER_TRACE("found left recursion");
+                  cached->recursive = true;
+                }
+              }
+              auto valid = cached->valid;
+              frame.tree = std::move(cached);
+              return finish(valid);
+            }
+          }
+
+          state.budget.addSyntaxTree();
+          frame.tree = std::make_shared<SyntaxTree>(rule, state.string, state.getPosition());
+          // the active tree in the cache detects left recursion, other rules are cached once parsed
+          if (frame.useCache && rule->leftRecursive) {
+            state.addToCache(frame.tree);
+          }
+          frame.saved = state.save(false);
+          if (state.errors) {
+            frame.errorGeneration = state.errors->generation;
+            frame.errorCount = state.errors->expected.size();
+          }
+          state.stack.push_back(frame.tree);
+          frame.stage = PARSED;
+          return callRuleNode(*rule);
+        }
+
+        case PARSED: {
+          auto &syntaxTree = *frame.tree;
+          syntaxTree.valid = result;
+          syntaxTree.end = state.getPosition();
+          syntaxTree.active = false;
+          state.stack.pop_back();
+          if (frame.useCache && !rule->leftRecursive) {
+            state.addToCache(frame.tree);
+          }
+          if (!syntaxTree.valid) {
+            return fail(frame);
+          }
+          if (!frame.useCache || !syntaxTree.recursive) {
+            return succeed(frame);
+          }
+          PARSER_TRACE("enter left recursion: " << rule->name);
+          // grow the seed in place, trees at the same position may depend on the previous seed
+          state.growingCaches.push_back(state.takeCached(syntaxTree.begin));
+          ++state.growing;
+          return grow(frame);
+        }
+
+        case GROWN: {
+          if (!state.stack.empty()) {
+            state.stack.back()->inner.resize(frame.saved.innerCount);
+          }
+          if (result && tree->end > frame.tree->end) {
+            PARSER_TRACE("parsed left recursion");
+            frame.tree = std::move(tree);
+            return grow(frame);
+          }
+          --state.growing;
+          state.restoreCached(frame.tree->begin, std::move(state.growingCaches.back()));
+          state.growingCaches.pop_back();
+          state.addToCache(frame.tree);
+          state.setPosition(frame.tree->end);
+          PARSER_TRACE("exit left recursion");
+          return succeed(frame);
+        }
+
+        case RECOVERING: {
+          if (!result && !state.isAtEnd()) {
+            state.advance();
+            return call(rule->recovery);
+          }
+          return recovered(frame);
+        }
+      }
+    }
+
+    /** Parses the rule of `frame` again with its current seed */
+    void grow(Frame &frame) {
+      auto begin = frame.tree->begin;
+      state.takeCached(begin);
+      state.addToCache(frame.tree);
+      state.setPosition(begin);
+      frame.stage = GROWN;
+      pushRule(Frame::RULE, frame.rule, false);
+    }
+
+    void succeed(Frame &frame) {
+      state.addInnerSyntaxTree(frame.tree);
+      if (state.events) {
+        state.commitInnerSyntaxTrees();
+      }
+      PARSER_TRACE("exit rule " << frame.rule->name);
+      finish(true);
+    }
+
+    void fail(Frame &frame) {
+      auto &rule = *frame.rule;
+      auto errors = state.errors;
+      if (errors && errors->silenced == 0 && errors->position == frame.tree->begin
+          && !state.stack.empty() && !rule.recovery) {
+        errors->failRule(rule, state.stack, frame.errorGeneration, frame.errorCount);
+      }
+      state.load(frame.saved);
+
+      // skip to the next synchronization point
+      if (rule.recovery && errors && state.recoveredErrors
+          && state.getPosition() < state.string.size()) {
+        PARSER_TRACE("recovering " << rule.name);
+        frame.errors = errors;
+        state.errors = nullptr;
+        state.stack.push_back(frame.tree);
+        frame.stage = RECOVERING;
+        return call(rule.recovery);
+      }
+      PARSER_TRACE("exit rule " << rule.name);
+      finish(false);
+    }
+
+    /** Records the error of the failed rule after skipping to the synchronization point */
+    void recovered(Frame &frame) {
+      auto &syntaxTree = *frame.tree;
+      state.stack.pop_back();
+      state.errors = frame.errors;
+      if (state.getPosition() == syntaxTree.begin) {
+        return finish(false);
+      }
+      auto failed = std::make_shared<SyntaxTree>(syntaxTree.rule, state.string, syntaxTree.begin);
+      state.recoveredErrors->push_back(createError(*state.errors, failed));
+      *state.errors = ErrorTracker();
+      syntaxTree.inner.clear();
+      syntaxTree.end = state.getPosition();
+      syntaxTree.valid = true;
+      syntaxTree.recovered = true;
+      finish(true);
+    }
+
+    /** Counterpart of `parseRule` that does not create any syntax tree */
+    void parseTreelessRule(Frame &frame) {
+      auto &rule = frame.rule;
+      auto begin = frame.saved.position;
+      switch (frame.stage) {
+        case ENTER: {
+          PARSER_TRACE("enter rule " << rule->name << " without syntax tree");
+          begin = state.getPosition();
+          if (rule->cacheable) {
+            auto key = State::CacheKey(begin, rule.get());
+            auto [it, inserted]
+                = state.matches.emplace(key, State::Match{State::Match::ACTIVE, 0, false});
+            if (!inserted) {
+              auto &cached = it->second;
+              if (cached.status == State::Match::MATCHED) {
+                state.setPosition(cached.end);
+                return finish(true);
+              }
+              if (cached.status == State::Match::ACTIVE) {
+                PARSER_TRACE("found left recursion");
+                cached.recursive = true;
+              }
+              return finish(false);
+            }
+            state.budget.addCacheEntry(sizeof(*it) + sizeof(key) + 2 * sizeof(void *));
+            frame.match = &it->second;
+            if (state.leftRecursions > 0) {
+              state.matchLog.push_back(key);
+            }
+            frame.logSize = state.matchLog.size();
+            state.leftRecursions += rule->leftRecursive;
+          }
+          frame.saved = state.save(false);
+          state.treelessRules.push_back(
+              State::TreelessRule{frames.size() - 1, begin, state.stack.size()});
+          frame.stage = PARSED;
+          return callRuleNode(*rule);
+        }
+
+        case PARSED: {
+          state.treelessRules.pop_back();
+          auto match = frame.match;
+          if (!match) {
+            if (!result) {
+              state.load(frame.saved);
+            }
+            return finish(result);
+          }
+          if (result && match->recursive) {
+            PARSER_TRACE("enter left recursion: " << rule->name);
+            // matches at `begin` may depend on the previous seed and are recomputed for every step
+            frame.end = state.getPosition();
+            return growTreeless(frame);
+          }
+          if (result) {
+            *match = State::Match{State::Match::MATCHED, state.getPosition(), false};
+          } else {
+            match->status = State::Match::FAILED;
+            state.load(frame.saved);
+          }
+          state.leftRecursions -= rule->leftRecursive;
+          return finish(result);
+        }
+
+        case GROWN: {
+          state.treelessRules.pop_back();
+          if (result && state.getPosition() > frame.end) {
+            frame.end = state.getPosition();
+            return growTreeless(frame);
+          }
+          invalidateMatches(state, frame.logSize, begin, rule.get());
+          state.setPosition(frame.end);
+          state.leftRecursions -= rule->leftRecursive;
+          PARSER_TRACE("exit left recursion");
+          return finish(true);
+        }
+      }
+    }
+
+    void growTreeless(Frame &frame) {
+      auto begin = frame.saved.position;
+      invalidateMatches(state, frame.logSize, begin, frame.rule.get());
+      *frame.match = State::Match{State::Match::MATCHED, frame.end, true};
+      state.setPosition(begin);
+      state.treelessRules.push_back(
+          State::TreelessRule{frames.size() - 1, begin, state.stack.size()});
+      frame.stage = GROWN;
+      call(frame.rule->node);
+    }
+  };
+
+  std::shared_ptr<SyntaxTree> parseRule(const std::shared_ptr<grammar::Rule> &rule, State &state) {
+    return Executor(state).parseRule(rule);
+  }
+
+  bool recognizeRule(const std::shared_ptr<grammar::Rule> &rule, State &state) {
+    return Executor(state).recognizeRule(rule);
+  }
+
+}  // namespace
+
+SyntaxTree::SyntaxTree(const std::shared_ptr<grammar::Rule> &r, std::string_view s, size_t p)
+    : rule(r), fullString(s), begin(p), end(p), valid(false), active(true) {}
+
+SyntaxTree::~SyntaxTree() {
+  // inner trees only referenced by this tree are released iteratively instead of recursively
+  std::vector<std::shared_ptr<SyntaxTree>> released;
+  auto release = [&](std::vector<std::shared_ptr<SyntaxTree>> &trees) {
+    for (auto &tree : trees) {
+      if (tree.use_count() == 1 && !tree->inner.empty()) {
+        released.push_back(std::move(tree));
+      }
+    }
+  };
+  release(inner);
+  while (!released.empty()) {
+    auto tree = std::move(released.back());
+    released.pop_back();
+    release(tree->inner);
+  }
+}
+
+const char *peg_parser::Parser::GrammarError::what() const noexcept {
+  if (buffer.size() == 0) {
+    std::string typeName;
+    switch (type) {
+      case UNKNOWN_SYMBOL:
+        typeName = "UNKNOWN_SYMBOL";
+        break;
+      case INVALID_RULE:
+        typeName = "INVALID_RULE";
+        break;
+    }
+    buffer = "internal error in grammar node (" + typeName + "): " + streamToString(*node);
+  }
+  return buffer.c_str();
+}
+
+const char *peg_parser::Parser::LimitError::what() const noexcept {
+  if (buffer.size() == 0) {
+    std::string typeName;
+    switch (type) {
+      case DEPTH:
+        typeName = "nested rules";
+        break;
+      case STEPS:
+        typeName = "steps";
+        break;
+      case SYNTAX_TREES:
+        typeName = "syntax trees";
+        break;
+      case CACHE_ENTRIES:
+        typeName = "cache entries";
+        break;
+      case MEMORY:
+        typeName = "bytes";
+        break;
+      case TIME:
+        typeName = "microseconds";
+        break;
+    }
+    buffer = "parse limit exceeded: more than " + std::to_string(limit) + " " + typeName;
+  }
+  return buffer.c_str();
+}
+
+Parser::Parser(const std::shared_ptr<grammar::Rule> &g) : grammar(g) {}
+
+namespace {
+
+  /** Adds an error for input that could not be parsed completely to `errors` */
+  Parser::Error createIncompleteError(ErrorTracker &errors, State &state,
+                                      const std::shared_ptr<SyntaxTree> &result) {
+    if (result->valid && errors.position <= result->end) {
+      errors.fail(result->end, state.stack, ErrorTracker::Expected{nullptr, nullptr});
+    }
+    return createError(errors, result);
+  }
+
+}  // namespace
+
+namespace {
+
+  /**
+   * Parses `str` and, if it cannot be parsed completely, parses it a second time to locate the
+   * error. `state` must be unused and is cleared again.
+   */
+  Parser::Result parseAndLocateError(State &state, const std::string_view &str,
+                                     const std::shared_ptr<grammar::Rule> &grammar,
+                                     const ParseLimits &limits) {
+    state.start(str, limits);
+    PARSER_TRACE("Begin parsing of: '" << str << "'");
+    auto result = parseRule(grammar, state);
+    state.clear();
+    if (result->valid && result->end == str.size()) {
+      return Parser::Result{result, result, {}};
+    }
+
+    // parse again, this time recording the furthest failure
+    ErrorTracker errors;
+    state.start(str, limits);
+    state.errors = &errors;
+    PARSER_TRACE("Begin parsing of: '" << str << "' to find errors");
+    result = parseRule(grammar, state);
+    auto error = createIncompleteError(errors, state, result);
+    state.clear();
+    return Parser::Result{result, error.syntax, std::move(error.expected)};
+  }
+
+}  // namespace
+
+Parser::Result Parser::parseAndGetError(const std::string_view &str,
+                                        std::shared_ptr<grammar::Rule> grammar,
+                                        const ParseLimits &limits) {
+  State state;
+  return parseAndLocateError(state, str, grammar, limits);
+}
+
+Parser::RecoveryResult Parser::parseWithRecovery(const std::string_view &str,
+                                                 std::shared_ptr<grammar::Rule> grammar,
+                                                 const ParseLimits &limits) {
+  RecoveryResult parsed;
+  ErrorTracker errors;
+  State state(str, limits);
+  state.errors = &errors;
+  state.recoveredErrors = &parsed.errors;
+  PARSER_TRACE("Begin parsing of: '" << str << "' with error recovery");
+  parsed.syntax = parseRule(grammar, state);
+  if (!parsed.syntax->valid || parsed.syntax->end < str.size()) {
+    parsed.errors.push_back(createIncompleteError(errors, state, parsed.syntax));
+  }
+  return parsed;
+}
+
+std::shared_ptr<SyntaxTree> Parser::parse(const std::string_view &str,
+                                          std::shared_ptr<grammar::Rule> grammar,
+                                          const ParseLimits &limits) {
+  State state(str, limits);
+  PARSER_TRACE("Begin parsing of: '" << str << "'");
+  return parseRule(grammar, state);
+}
+
+std::shared_ptr<SyntaxTree> Parser::parse(const std::string_view &str) const {
+  return parse(str, grammar, limits);
+}
+
+Parser::Result Parser::parseAndGetError(const std::string_view &str) const {
+  return parseAndGetError(str, grammar, limits);
+}
+
+Parser::RecoveryResult Parser::parseWithRecovery(const std::string_view &str) const {
+  return parseWithRecovery(str, grammar, limits);
+}
+
+Parser::Match Parser::recognize(const std::string_view &str, std::shared_ptr<grammar::Rule> grammar,
+                                const ParseLimits &limits) {
+  State state(str, limits);
+  state.recognizeOnly = true;
+  PARSER_TRACE("Begin recognizing: '" << str << "'");
+  auto valid = recognizeRule(grammar, state);
+  return Match{valid, state.getPosition()};
+}
+
+Parser::Match Parser::recognize(const std::string_view &str) const {
+  return recognize(str, grammar, limits);
+}
+
+std::shared_ptr<SyntaxTree> Parser::parse(const std::string_view &str,
+                                          std::shared_ptr<grammar::Rule> grammar,
+                                          const Captures &captures, const ParseLimits &limits) {
+  State state(str, limits);
+  state.captures = &captures;
+  PARSER_TRACE("Begin parsing of: '" << str << "' with captures");
+  return parseRule(grammar, state);
+}
+
+std::shared_ptr<SyntaxTree> Parser::parse(const std::string_view &str,
+                                          const Captures &captures) const {
+  return parse(str, grammar, captures, limits);
+}
+
+Parser::Match Parser::parse(const std::string_view &str, std::shared_ptr<grammar::Rule> grammar,
+                            EventHandler &events, const ParseLimits &limits) {
+  State state(str, limits);
+  state.events = &events;
+  PARSER_TRACE("Begin parsing of: '" << str << "' with events");
+  auto result = parseRule(grammar, state);
+  if (result->valid && !grammar->hidden) {
+    if (state.enteredDepth > 0) {
+      state.emitInner(*result);
+    } else {
+      state.emit(*result);
+    }
+  }
+  return Match{result->valid, result->end};
+}
+
+Parser::Match Parser::parse(const std::string_view &str, EventHandler &events) const {
+  return parse(str, grammar, events, limits);
+}
+
+namespace {
+
+  /** Items of a repetition parsed one after another, see `Parser::parseParallel` */
+  struct Chunk {
+    size_t begin;
+    /** trees of the rule wrapping the repeated node, one per item */
+    std::vector<std::shared_ptr<SyntaxTree>> items;
+    size_t end;
+    /** whether the repetition ends at `end` */
+    bool stopped = false;
+    /** set if the chunk could not be parsed, its items must be parsed again */
+    bool failed = false;
+
+    explicit Chunk(size_t b) : begin(b), end(b) {}
+  };
+
+  /** Adds the items beginning before `limit` to `chunk` */
+  void parseItems(State &state, const std::shared_ptr<grammar::Rule> &item, size_t limit,
+                  Chunk &chunk) {
+    while (!chunk.stopped && chunk.end < limit) {
+      state.setPosition(chunk.end);
+      auto tree = parseRule(item, state);
+      if (!tree->valid || tree->end == chunk.end) {
+        chunk.stopped = true;
+      } else {
+        chunk.end = tree->end;
+        chunk.items.push_back(std::move(tree));
+      }
+    }
+  }
+
+  /**
+   * Appends the items of `chunk` from the end of `parsed` onwards to `parsed`. Returns false if
+   * no item of the chunk begins there.
+   */
+  bool splice(Chunk &parsed, const Chunk &chunk) {
+    if (chunk.failed || parsed.end < chunk.begin || parsed.end > chunk.end) {
+      return false;
+    }
+    auto it = std::lower_bound(chunk.items.begin(), chunk.items.end(), parsed.end,
+                               [](auto &tree, size_t p) { return tree->begin < p; });
+    if (it == chunk.items.end() ? parsed.end != chunk.end : (*it)->begin != parsed.end) {
+      return false;
+    }
+    parsed.items.insert(parsed.items.end(), it, chunk.items.end());
+    parsed.end = chunk.end;
+    parsed.stopped = chunk.stopped;
+    return true;
+  }
+
+  /** Positions behind matches of `boundary` at least `length` bytes apart, starting with 0 */
+  std::vector<size_t> findSplits(const std::string_view &str, const grammar::Node::Shared &boundary,
+                                 size_t length, const ParseLimits &limits) {
+    auto rule = grammar::makeRule("Boundary", boundary);
+    rule->hidden = true;
+    State state(str, limits);
+    state.recognizeOnly = true;
+    std::vector<size_t> splits{0};
+    for (auto target = length; target < str.size(); target = splits.back() + length) {
+      auto position = target;
+      for (; position < str.size(); ++position) {
+        state.setPosition(position);
+        if (recognizeRule(rule, state)) {
+          break;
+        }
+      }
+      if (position == str.size() || state.getPosition() >= str.size()) {
+        break;
+      }
+      splits.push_back(state.getPosition());
+    }
+    return splits;
+  }
+
+}  // namespace
+
+std::shared_ptr<SyntaxTree> Parser::parseParallel(const std::string_view &str,
+                                                  std::shared_ptr<grammar::Rule> grammar,
+                                                  const Chunking &chunking,
+                                                  const ParseLimits &limits) {
+  if (grammar->node->symbol != grammar::Node::Symbol::ZERO_OR_MORE) {
+    throw std::invalid_argument("rule " + grammar->name + " is not a repetition");
+  }
+  if (!chunking.boundary) {
+    throw std::invalid_argument("no boundary to split the input at");
+  }
+  auto item = grammar::makeRule(grammar->name, pget<grammar::Node::Shared>(grammar->node->data));
+  item->cacheable = false;
+  item->leftRecursive = grammar->leftRecursive;
+
+  size_t threads = chunking.threads > 0 ? chunking.threads : std::thread::hardware_concurrency();
+  threads = std::max<size_t>(threads, 1);
+  auto length = std::max<size_t>({chunking.minLength, str.size() / threads, 1});
+  std::vector<Chunk> chunks;
+  for (auto split : findSplits(str, chunking.boundary, length, limits)) {
+    chunks.emplace_back(split);
+  }
+  auto limitOf = [&](size_t index) {
+    return index + 1 < chunks.size() ? chunks[index + 1].begin : str.size() + 1;
+  };
+
+  // each chunk is parsed as if an item began at its split
+  std::vector<std::future<void>> tasks;
+  for (size_t index = 1; index < chunks.size(); ++index) {
+    tasks.push_back(std::async(std::launch::async, [&, index]() {
+      try {
+        State state(str, limits);
+        parseItems(state, item, limitOf(index), chunks[index]);
+      } catch (...) {
+        // the error may be caused by a misaligned split, so the chunk is parsed again
+        chunks[index] = Chunk(chunks[index].begin);
+        chunks[index].failed = true;
+      }
+    }));
+  }
+  State state(str, limits);
+  Chunk parsed(0);
+  parseItems(state, item, limitOf(0), parsed);
+  for (auto &task : tasks) {
+    task.get();
+  }
+
+  // join the chunks, parsing the items between splits that do not align with the previous item
+  for (size_t index = 1; index < chunks.size() && !parsed.stopped; ++index) {
+    auto limit = limitOf(index);
+    while (!parsed.stopped && parsed.end < limit && !splice(parsed, chunks[index])) {
+      parseItems(state, item, parsed.end + 1, parsed);
+    }
+  }
+
+  auto tree = std::make_shared<SyntaxTree>(grammar, str, 0);
+  tree->valid = true;
+  tree->end = parsed.end;
+  for (auto &parsedItem : parsed.items) {
+    tree->inner.insert(tree->inner.end(), parsedItem->inner.begin(), parsedItem->inner.end());
+  }
+  return tree;
+}
+
+std::shared_ptr<SyntaxTree> Parser::parseParallel(const std::string_view &str,
+                                                  const Chunking &chunking) const {
+  return parseParallel(str, grammar, chunking, limits);
+}
+
+struct Parser::Resumable::Process {
+  enum Stage { PARSING, LOCATING_ERROR, FINISHED, FAILED } stage = PARSING;
+  std::string_view string;
+  std::shared_ptr<grammar::Rule> grammar;
+  ParseLimits limits;
+  State state;
+  ErrorTracker errors;
+  std::optional<Executor> executor;
+  Result result;
+
+  Process(const std::string_view &s, std::shared_ptr<grammar::Rule> g, const ParseLimits &l)
+      : string(s), grammar(std::move(g)), limits(l) {
+    state.start(string, limits);
+    PARSER_TRACE("Begin resumable parsing of: '" << string << "'");
+    executor.emplace(state).enter(Frame::RULE, grammar);
+  }
+
+  bool resume(size_t steps) {
+    if (stage == FINISHED || stage == FAILED) {
+      return true;
+    }
+    auto used = state.budget.stepCount();
+    auto limit = steps < std::numeric_limits<size_t>::max() - used
+                     ? used + steps
+                     : std::numeric_limits<size_t>::max();
+    if (!executor->resume(limit)) {
+      return false;
+    }
+    auto tree = executor->parsedTree();
+    if (stage == PARSING) {
+      state.clear();
+      if (tree->valid && tree->end == string.size()) {
+        result = Result{tree, tree, {}};
+        stage = FINISHED;
+        return true;
+      }
+      // parse again, this time recording the furthest failure
+      state.start(string, limits);
+      state.errors = &errors;
+      executor.emplace(state).enter(Frame::RULE, grammar);
+      stage = LOCATING_ERROR;
+      return false;
+    }
+    auto error = createIncompleteError(errors, state, tree);
+    state.clear();
+    result = Result{tree, error.syntax, std::move(error.expected)};
+    stage = FINISHED;
+    return true;
+  }
+};
+
+Parser::Resumable::Resumable(std::unique_ptr<Process> p) : process(std::move(p)) {}
+
+Parser::Resumable::Resumable(Resumable &&) = default;
+
+Parser::Resumable &Parser::Resumable::operator=(Resumable &&) = default;
+
+Parser::Resumable::~Resumable() {}
+
+bool Parser::Resumable::resume(size_t steps) {
+  try {
+    return process->resume(steps);
+  } catch (...) {
+    process->stage = Process::FAILED;
+    process->state.clear();
+    throw;
+  }
+}
+
+bool Parser::Resumable::finished() const {
+  return process->stage == Process::FINISHED || process->stage == Process::FAILED;
+}
+
+std::string_view Parser::Resumable::input() const { return process->string; }
+
+const Parser::Result &Parser::Resumable::result() const {
+  if (process->stage != Process::FINISHED) {
+    throw std::logic_error("resumable parse has not finished");
+  }
+  return process->result;
+}
+
+Parser::Resumable Parser::start(const std::string_view &str,
+                                std::shared_ptr<grammar::Rule> grammar,
+                                const ParseLimits &limits) {
+  return Resumable(std::make_unique<Resumable::Process>(str, std::move(grammar), limits));
+}
+
+Parser::Resumable Parser::start(const std::string_view &str) const {
+  return start(str, grammar, limits);
+}
+
+struct Parser::Context::Storage {
+  State state;
+  bool used = false;
+
+  /** Lends the state to a single parse and clears it afterwards */
+  class Lease {
+  private:
+    Storage &storage;
+
+  public:
+    explicit Lease(Storage &s) : storage(s) {
+      if (storage.used) {
+        throw std::logic_error("parser context used by several parses at once");
+      }
+      storage.used = true;
+    }
+
+    ~Lease() {
+      storage.state.clear();
+      storage.used = false;
+    }
+
+    State &state() { return storage.state; }
+  };
+};
+
+Parser::Context::Context() : storage(std::make_unique<Storage>()) {}
+
+Parser::Context::~Context() {}
+
+std::shared_ptr<SyntaxTree> Parser::parse(const std::string_view &str,
+                                          std::shared_ptr<grammar::Rule> grammar,
+                                          Context &context, const ParseLimits &limits) {
+  Context::Storage::Lease lease(*context.storage);
+  auto &state = lease.state();
+  state.start(str, limits);
+  PARSER_TRACE("Begin parsing of: '" << str << "' with a context");
+  return parseRule(grammar, state);
+}
+
+std::shared_ptr<SyntaxTree> Parser::parse(const std::string_view &str, Context &context) const {
+  return parse(str, grammar, context, limits);
+}
+
+Parser::Result Parser::parseAndGetError(const std::string_view &str,
+                                        std::shared_ptr<grammar::Rule> grammar,
+                                        Context &context, const ParseLimits &limits) {
+  Context::Storage::Lease lease(*context.storage);
+  return parseAndLocateError(lease.state(), str, grammar, limits);
+}
+
+Parser::Result Parser::parseAndGetError(const std::string_view &str, Context &context) const {
+  return parseAndGetError(str, grammar, context, limits);
+}
+
+Parser::Captures Parser::createCaptures(
+    const std::shared_ptr<grammar::Rule> &grammar,
+    const std::vector<std::shared_ptr<grammar::Rule>> &rules) {
+  // find the rules referenced by each reachable rule
+  std::unordered_map<const grammar::Rule *, std::vector<const grammar::Rule *>> referencedBy;
+  std::vector<const grammar::Rule *> pending{grammar.get()};
+  std::unordered_set<const grammar::Rule *> reachable{grammar.get()};
+  while (!pending.empty()) {
+    auto rule = pending.back();
+    pending.pop_back();
+    auto addReference = [&](const grammar::Rule *referenced) {
+      if (referenced) {
+        referencedBy[referenced].push_back(rule);
+        if (reachable.insert(referenced).second) {
+          pending.push_back(referenced);
+        }
+      }
+    };
+    std::vector<const grammar::Node *> nodes{rule->node.get()};
+    while (!nodes.empty()) {
+      auto node = nodes.back();
+      nodes.pop_back();
+      if (auto children = std::get_if<std::vector<grammar::Node::Shared>>(&node->data)) {
+        for (auto &child : *children) {
+          nodes.push_back(child.get());
+        }
+      } else if (auto child = std::get_if<grammar::Node::Shared>(&node->data)) {
+        nodes.push_back(child->get());
+      } else if (auto strong = std::get_if<std::shared_ptr<grammar::Rule>>(&node->data)) {
+        addReference(strong->get());
+      } else if (auto weak = std::get_if<std::weak_ptr<grammar::Rule>>(&node->data)) {
+        addReference(weak->lock().get());
+      } else if (auto table = std::get_if<grammar::Node::OperatorTable>(&node->data)) {
+        // operations are added to the rule containing the precedence node
+        nodes.push_back(table->operand.get());
+        for (auto &op : table->operators) {
+          nodes.push_back(op.pattern.get());
+          addReference(op.rule.get());
+        }
+      }
+    }
+  }
+
+  // rules that may contain captured rules need a syntax tree as well
+  Captures captures;
+  for (auto &rule : rules) {
+    captures.captured.insert(rule.get());
+    pending.push_back(rule.get());
+  }
+  while (!pending.empty()) {
+    auto rule = pending.back();
+    pending.pop_back();
+    if (captures.trees.insert(rule).second) {
+      auto it = referencedBy.find(rule);
+      if (it != referencedBy.end()) {
+        pending.insert(pending.end(), it->second.begin(), it->second.end());
+      }
+    }
+  }
+  return captures;
+}
+
+Parser::Captures Parser::createCaptures(
+    const std::vector<std::shared_ptr<grammar::Rule>> &rules) const {
+  return createCaptures(grammar, rules);
 }
 
 std::ostream &peg_parser::operator<<(std::ostream &stream, const SyntaxTree &tree) {
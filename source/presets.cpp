@@ -1,6 +1,15 @@
+#include <peg_parser/analysis.h>
+#include <peg_parser/automaton.h>
+#include <peg_parser/optimizer.h>
 #include <peg_parser/presets.h>
 
+#include <array>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 
 using namespace peg_parser;
 using namespace peg_parser::presets;
@@ -10,7 +19,7 @@ Program<int> presets::createIntegerProgram() {
   Program<int> program;
   auto pattern = GN::Sequence({GN::Optional(GN::Word("-")), GN::OneOrMore(GN::Range('0', '9'))});
   program.parser.grammar = program.interpreter.makeRule(
-      "Number", pattern, [](auto e) { return std::stoi(e.string()); });
+      "Number", pattern, [](auto e) { return parseNumber<int>(e.view()); });
   return program;
 }
 
@@ -30,14 +39,14 @@ namespace {
 Program<float> presets::createFloatProgram() {
   Program<float> program;
   program.parser.grammar = program.interpreter.makeRule(
-      "Float", createFloatGrammar(), [](auto e) { return std::stof(e.string()); });
+      "Float", createFloatGrammar(), [](auto e) { return parseNumber<float>(e.view()); });
   return program;
 }
 
 Program<double> presets::createDoubleProgram() {
   Program<double> program;
   program.parser.grammar = program.interpreter.makeRule(
-      "Float", createFloatGrammar(), [](auto e) { return std::stod(e.string()); });
+      "Float", createFloatGrammar(), [](auto e) { return parseNumber<double>(e.view()); });
   return program;
 }
 
@@ -46,7 +55,7 @@ Program<int> presets::createHexProgram() {
   auto pattern = GN::Sequence(
       {GN::OneOrMore(GN::Choice({GN::Range('0', '9'), GN::Range('a', 'f'), GN::Range('A', 'F')}))});
   program.parser.grammar = program.interpreter.makeRule(
-      "Hex", pattern, [](auto e) { return std::stoi(e.string(), 0, 16); });
+      "Hex", pattern, [](auto e) { return parseNumber<int>(e.view(), 16); });
   return program;
 }
 
@@ -88,30 +97,123 @@ Program<char> presets::createCharacterProgram(const std::function<char(char)> es
   return program;
 }
 
-Program<std::string> presets::createStringProgram(const std::string &open,
-                                                  const std::string &close) {
-  Program<std::string> program;
+namespace {
+
+  using EscapeTable = std::array<char, 256>;
+
+  EscapeTable createEscapeTable(const std::function<char(char)> &escapeCodeCallback) {
+    EscapeTable table;
+    for (size_t i = 0; i < table.size(); ++i) {
+      table[i] = escapeCodeCallback(char(i));
+    }
+    return table;
+  }
+
+  bool isHexDigit(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+  }
 
-  auto characterProgram = createCharacterProgram();
+  /** Matches the same strings as the character program without creating inner rules */
+  grammar::Node::Shared createStringGrammar(const std::string &open, const std::string &close) {
+    auto backslash = GN::Word("\\");
+    auto hexDigit = GN::Choice({GN::Range('0', '9'), GN::Range('a', 'f'), GN::Range('A', 'F')});
+    auto character = GN::Choice({GN::Sequence({backslash, GN::OneOrMore(hexDigit)}),
+                                 GN::Sequence({backslash, GN::Any()}), GN::Any()});
+    return GN::Sequence({GN::Word(open),
+                         GN::ZeroOrMore(GN::Sequence({GN::Not(GN::Word(close)), character})),
+                         GN::Word(close)});
+  }
+
+  /**
+   * Returns `content` itself if it contains no escape sequences. Otherwise decodes it in a single
+   * pass into `buffer` and returns a view of the buffer.
+   */
+  std::string_view decodeString(std::string_view content, const EscapeTable &escapes,
+                                std::string &buffer) {
+    auto next = content.find('\\');
+    if (next == std::string_view::npos) {
+      return content;
+    }
+    buffer.clear();
+    buffer.reserve(content.size());
+    size_t position = 0;
+    while (next != std::string_view::npos) {
+      buffer.append(content.data() + position, next - position);
+      position = next + 1;
+      auto end = position;
+      while (end < content.size() && isHexDigit(content[end])) {
+        ++end;
+      }
+      if (end > position) {
+        buffer += char(0 + parseNumber<int>(content.substr(position, end - position), 16));
+        position = end;
+      } else {
+        buffer += escapes[static_cast<unsigned char>(content[position])];
+        ++position;
+      }
+      next = content.find('\\', position);
+    }
+    buffer.append(content.data() + position, content.size() - position);
+    return buffer;
+  }
 
-  auto pattern
-      = GN::Sequence({GN::Word(open),
-                      GN::ZeroOrMore(GN::Sequence(
-                          {GN::Not(GN::Word(close)), GN::Rule(characterProgram.parser.grammar)})),
-                      GN::Word(close)});
+}  // namespace
 
+Program<std::string> presets::createStringProgram(
+    const std::string &open, const std::string &close,
+    const std::function<char(char)> escapeCodeCallback) {
+  Program<std::string> program;
   program.parser.grammar = program.interpreter.makeRule(
-      "String", pattern, [interpreter = characterProgram.interpreter](auto e) {
-        std::string res;
-        for (auto c : e) {
-          res += c.evaluateBy(interpreter);
+      "String", createStringGrammar(open, close),
+      [open = open.size(), close = close.size(),
+       escapes = createEscapeTable(escapeCodeCallback)](auto e) {
+        std::string buffer;
+        auto content = e.view().substr(open, e.length() - open - close);
+        auto decoded = decodeString(content, escapes, buffer);
+        if (decoded.data() == buffer.data()) {
+          return buffer;
         }
-        return res;
+        return std::string(decoded);
       });
+  return program;
+}
 
+Program<std::string_view, std::string &> presets::createStringViewProgram(
+    const std::string &open, const std::string &close,
+    const std::function<char(char)> escapeCodeCallback) {
+  Program<std::string_view, std::string &> program;
+  program.parser.grammar = program.interpreter.makeRule(
+      "String", createStringGrammar(open, close),
+      [open = open.size(), close = close.size(),
+       escapes = createEscapeTable(escapeCodeCallback)](auto e, std::string &buffer) {
+        auto content = e.view().substr(open, e.length() - open - close);
+        return decodeString(content, escapes, buffer);
+      });
   return program;
 }
 
+namespace {
+
+  /** Rule referenced by a node returned by a `RuleGetter`, which may add separators around it */
+  std::shared_ptr<grammar::Rule> referencedRule(const GN::Shared &node) {
+    if (auto rule = std::get_if<std::shared_ptr<grammar::Rule>>(&node->data)) {
+      return *rule;
+    }
+    if (auto rule = std::get_if<std::weak_ptr<grammar::Rule>>(&node->data)) {
+      return rule->lock();
+    }
+    if (node->symbol == GN::Symbol::SEQUENCE) {
+      for (auto &child : std::get<std::vector<GN::Shared>>(node->data)) {
+        if (auto rule = referencedRule(child)) {
+          return rule;
+        }
+      }
+    }
+    return nullptr;
+  }
+
+}  // namespace
+
 GrammarProgram presets::createPEGProgram() {
   GrammarProgram program;
 
@@ -123,7 +225,7 @@ GrammarProgram presets::createPEGProgram() {
     return GN::Sequence({whitespace, node, whitespace});
   };
 
-  auto stringProgram = createStringProgram("'", "'");
+  auto stringProgram = createStringViewProgram("'", "'");
 
   auto expressionRule = program.interpreter.makeRule(
       "Expression", GN::Empty(), [](auto e, auto &g) { return e[0].evaluate(g); });
@@ -172,11 +274,12 @@ GrammarProgram presets::createPEGProgram() {
   auto word = GN::Rule(
       program.interpreter.makeRule("Word", stringProgram.parser.grammar,
                                    [interpreter = stringProgram.interpreter](auto e, auto &) {
-                                     auto word = e[0].evaluateBy(interpreter);
+                                     std::string buffer;
+                                     auto word = interpreter.evaluate(e[0].syntax(), buffer);
                                      if (word.size() == 0) {
                                        return GN::Empty();
                                      } else {
-                                       return GN::Word(e[0].evaluateBy(interpreter));
+                                       return GN::Word(std::string(word));
                                      }
                                    }));
 
@@ -188,6 +291,35 @@ GrammarProgram presets::createPEGProgram() {
 
   auto brackets = GN::Sequence({GN::Word("("), expression, GN::Word(")")});
 
+  // {Operand; left: Add '+', Subtract '-'; right: Power '^'} with increasing precedence
+  auto associativity
+      = GN::Rule(makeRule("Associativity", GN::Choice({GN::Word("left"), GN::Word("right")})));
+  auto binaryOperator = GN::Rule(makeRule("Operator", GN::Sequence({whitespace, rule, atomic})));
+  auto level = withWhitespace(GN::Rule(makeRule(
+      "Level",
+      GN::Sequence({associativity, whitespace, GN::Word(":"), binaryOperator,
+                    GN::ZeroOrMore(GN::Sequence({GN::Word(","), binaryOperator}))}))));
+  auto precedence = GN::Rule(program.interpreter.makeRule(
+      "Precedence",
+      GN::Sequence({GN::Word("{"), expression,
+                    GN::OneOrMore(GN::Sequence({GN::Word(";"), level})), GN::Word("}")}),
+      [](auto e, auto &g) {
+        std::vector<GN::Operator> operators;
+        for (size_t i = 1; i < e.size(); ++i) {
+          auto level = e[i];
+          auto rightAssociative = level[0].view() == "right";
+          for (size_t j = 1; j < level.size(); ++j) {
+            auto rule = referencedRule(level[j][0].evaluate(g));
+            if (!rule) {
+              throw std::runtime_error("operator without rule");
+            }
+            operators.push_back(
+                GN::Operator{rule, level[j][1].evaluate(g), unsigned(i), rightAssociative});
+          }
+        }
+        return GN::Precedence(e[0].evaluate(g), operators);
+      }));
+
   auto andPredicate = GN::Rule(
       program.interpreter.makeRule("AndPredicate", GN::Sequence({GN::Word("&"), atomic}),
                                    [](auto e, auto &g) { return GN::Also(e[0].evaluate(g)); }));
@@ -197,7 +329,8 @@ GrammarProgram presets::createPEGProgram() {
                                    [](auto e, auto &g) { return GN::Not(e[0].evaluate(g)); }));
 
   atomicRule->node = withWhitespace(
-      GN::Choice({andPredicate, notPredicate, word, brackets, endOfFile, any, select, rule}));
+      GN::Choice({andPredicate, notPredicate, word, brackets, precedence, endOfFile, any, select,
+                  rule}));
 
   auto predicate
       = GN::Rule(makeRule("Predicate", GN::Choice({GN::Word("+"), GN::Word("*"), GN::Word("?")})));
@@ -252,6 +385,91 @@ GrammarProgram presets::createPEGProgram() {
       "FullExpression", GN::Sequence({GN::Rule(expressionRule), GN::EndOfFile()}),
       [](auto e, auto &g) { return e[0].evaluate(g); });
   program.parser.grammar = fullExpression;
+  grammar::optimize(fullExpression);
+  grammar::analyze(fullExpression);
+  grammar::compileAutomata(fullExpression);
+
+  return program;
+}
 
+const GrammarProgram &presets::getPEGProgram() {
+  static const GrammarProgram program = createPEGProgram();
   return program;
 }
+
+namespace {
+
+  /** the oldest cached expressions are dropped once there are more */
+  constexpr size_t maxCachedPEGExpressions = 4096;
+
+  struct CachedPEGExpression {
+    /** owns the text viewed by the syntax tree */
+    std::shared_ptr<const std::string> grammar;
+    std::shared_ptr<SyntaxTree> syntax;
+  };
+
+  struct PEGExpressionCache {
+    std::mutex mutex;
+    /** keyed by views of the cached grammar text */
+    std::unordered_map<std::string_view, CachedPEGExpression> results;
+    /** keys in the order they were added */
+    std::deque<std::string_view> order;
+  };
+
+  PEGExpressionCache &getPEGExpressionCache() {
+    static PEGExpressionCache cache;
+    return cache;
+  }
+
+  void setFullString(SyntaxTree &tree, std::string_view fullString) {
+    tree.fullString = fullString;
+    for (auto &inner : tree.inner) {
+      setFullString(*inner, fullString);
+    }
+  }
+
+}  // namespace
+
+grammar::Node::Shared presets::parsePEGExpression(const std::string_view &grammar,
+                                                  RuleGetter getRule) {
+  auto &program = getPEGProgram();
+  auto &cache = getPEGExpressionCache();
+  CachedPEGExpression cached;
+
+  {
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    auto it = cache.results.find(grammar);
+    if (it != cache.results.end()) {
+      cached = it->second;
+    }
+  }
+
+  if (!cached.syntax) {
+    // parsed without holding the lock, failures are not cached
+    auto parsed = program.parser.parseAndGetError(grammar);
+    if (!parsed.syntax->valid || parsed.syntax->end < parsed.syntax->fullString.size()) {
+      throw SyntaxError(parsed.error, parsed.expected);
+    }
+    cached.grammar = std::make_shared<const std::string>(grammar);
+    cached.syntax = parsed.syntax;
+    setFullString(*cached.syntax, *cached.grammar);
+
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    if (cache.results.emplace(*cached.grammar, cached).second) {
+      cache.order.push_back(*cached.grammar);
+      if (cache.order.size() > maxCachedPEGExpressions) {
+        cache.results.erase(cache.order.front());
+        cache.order.pop_front();
+      }
+    }
+  }
+
+  return program.interpret(cached.syntax).evaluate(getRule);
+}
+
+void presets::clearPEGExpressionCache() {
+  auto &cache = getPEGExpressionCache();
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  cache.results.clear();
+  cache.order.clear();
+}
@@ -0,0 +1,487 @@
+#include <peg_parser/serialization.h>
+
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#if defined(_WIN32) && !defined(PEG_PARSER_NO_MMAP)
+#  define PEG_PARSER_NO_MMAP
+#endif
+
+#ifndef PEG_PARSER_NO_MMAP
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+using namespace peg_parser;
+using namespace peg_parser::serialization;
+using Node = grammar::Node;
+using Symbol = Node::Symbol;
+
+namespace {
+
+  /**  alternative to `std::get` that works on iOS < 11 */
+  template <class T, class V> const T &pget(const V &v) {
+    if (auto r = std::get_if<T>(&v)) {
+      return *r;
+    } else {
+      throw std::runtime_error("corrupted grammar node");
+    }
+  }
+
+  const std::string_view MAGIC = "PEGG";
+  const size_t VERSION = 2;
+
+  /**
+   * rules without `NOT_LEFT_RECURSIVE` are loaded as possibly left recursive, which is always
+   * safe
+   */
+  enum RuleFlags : uint8_t { HIDDEN = 1, CACHEABLE = 2, NAMED = 4, NOT_LEFT_RECURSIVE = 8 };
+
+  class Writer {
+  public:
+    std::string data;
+
+    void writeByte(uint8_t value) { data += char(value); }
+
+    // LEB128
+    void writeNumber(size_t value) {
+      do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        writeByte(value ? byte | 0x80 : byte);
+      } while (value);
+    }
+
+    void writeString(std::string_view str) {
+      writeNumber(str.size());
+      data += str;
+    }
+  };
+
+  class Reader {
+  private:
+    std::string_view data;
+    size_t position = 0;
+
+  public:
+    Reader(std::string_view d) : data(d) {}
+
+    uint8_t readByte() {
+      if (position >= data.size()) {
+        throw SerializationError("unexpected end of grammar data");
+      }
+      return uint8_t(data[position++]);
+    }
+
+    size_t readNumber() {
+      size_t value = 0;
+      for (unsigned shift = 0; shift < sizeof(size_t) * 8; shift += 7) {
+        auto byte = readByte();
+        value |= size_t(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+          return value;
+        }
+      }
+      throw SerializationError("corrupted grammar data");
+    }
+
+    /** Reads an element count, each element occupies at least one byte */
+    size_t readCount() {
+      auto count = readNumber();
+      if (count > data.size() - position) {
+        throw SerializationError("corrupted grammar data");
+      }
+      return count;
+    }
+
+    std::string_view readString() {
+      auto size = readNumber();
+      if (size > data.size() - position) {
+        throw SerializationError("unexpected end of grammar data");
+      }
+      auto result = data.substr(position, size);
+      position += size;
+      return result;
+    }
+  };
+
+  class Encoder {
+  private:
+    Writer nodes;
+    std::unordered_map<const Node *, size_t> nodeIds;
+    std::unordered_map<const grammar::Rule *, size_t> ruleIds;
+    std::vector<std::shared_ptr<grammar::Rule>> rules;
+    std::unordered_set<const grammar::Rule *> named;
+
+  public:
+    Encoder(const Grammar &grammar) {
+      for (auto &rule : grammar.rules) {
+        named.insert(rule.get());
+        getRuleId(rule);
+      }
+    }
+
+    size_t getRuleId(const std::shared_ptr<grammar::Rule> &rule) {
+      auto it = ruleIds.find(rule.get());
+      if (it != ruleIds.end()) {
+        return it->second;
+      }
+      auto id = rules.size();
+      ruleIds[rule.get()] = id;
+      rules.push_back(rule);
+      return id;
+    }
+
+    /** Encodes the node after its children so that ids only reference previous nodes */
+    size_t getNodeId(const Node::Shared &node) {
+      auto it = nodeIds.find(node.get());
+      if (it != nodeIds.end()) {
+        return it->second;
+      }
+
+      std::vector<size_t> children;
+      switch (node->symbol) {
+        case Symbol::SEQUENCE:
+        case Symbol::CHOICE: {
+          for (auto &child : pget<std::vector<Node::Shared>>(node->data)) {
+            children.push_back(getNodeId(child));
+          }
+          break;
+        }
+        case Symbol::ZERO_OR_MORE:
+        case Symbol::ONE_OR_MORE:
+        case Symbol::OPTIONAL:
+        case Symbol::ALSO:
+        case Symbol::NOT: {
+          children.push_back(getNodeId(pget<Node::Shared>(node->data)));
+          break;
+        }
+        case Symbol::PRECEDENCE: {
+          auto &table = pget<Node::OperatorTable>(node->data);
+          children.push_back(getNodeId(table.operand));
+          for (auto &op : table.operators) {
+            children.push_back(getNodeId(op.pattern));
+          }
+          break;
+        }
+        default:
+          break;
+      }
+
+      nodes.writeByte(uint8_t(node->symbol));
+      switch (node->symbol) {
+        case Symbol::WORD: {
+          nodes.writeString(pget<std::string>(node->data));
+          break;
+        }
+        case Symbol::RANGE: {
+          auto &range = pget<std::array<grammar::Letter, 2>>(node->data);
+          nodes.writeByte(uint8_t(range[0]));
+          nodes.writeByte(uint8_t(range[1]));
+          break;
+        }
+        case Symbol::CHARACTER_SET: {
+          auto &set = pget<Node::CharacterSet>(node->data);
+          for (size_t bit = 0; bit < set.size(); bit += 8) {
+            uint8_t byte = 0;
+            for (size_t j = 0; j < 8; ++j) {
+              byte |= set[bit + j] << j;
+            }
+            nodes.writeByte(byte);
+          }
+          break;
+        }
+        case Symbol::SEQUENCE:
+        case Symbol::CHOICE: {
+          nodes.writeNumber(children.size());
+          for (auto child : children) {
+            nodes.writeNumber(child);
+          }
+          break;
+        }
+        case Symbol::ZERO_OR_MORE:
+        case Symbol::ONE_OR_MORE:
+        case Symbol::OPTIONAL:
+        case Symbol::ALSO:
+        case Symbol::NOT: {
+          nodes.writeNumber(children[0]);
+          break;
+        }
+        case Symbol::RULE: {
+          nodes.writeNumber(getRuleId(pget<std::shared_ptr<grammar::Rule>>(node->data)));
+          break;
+        }
+        case Symbol::WEAK_RULE: {
+          if (auto rule = pget<std::weak_ptr<grammar::Rule>>(node->data).lock()) {
+            nodes.writeNumber(getRuleId(rule));
+          } else {
+            throw SerializationError("cannot serialize deleted rule");
+          }
+          break;
+        }
+        case Symbol::PRECEDENCE: {
+          auto &operators = pget<Node::OperatorTable>(node->data).operators;
+          nodes.writeNumber(children[0]);
+          nodes.writeNumber(operators.size());
+          for (size_t i = 0; i < operators.size(); ++i) {
+            nodes.writeNumber(getRuleId(operators[i].rule));
+            nodes.writeNumber(children[i + 1]);
+            nodes.writeNumber(operators[i].precedence);
+            nodes.writeByte(operators[i].rightAssociative);
+          }
+          break;
+        }
+        case Symbol::FILTER: {
+          throw SerializationError("cannot serialize filter node");
+        }
+        case Symbol::ANY:
+        case Symbol::EMPTY:
+        case Symbol::ERROR:
+        case Symbol::END_OF_FILE:
+          break;
+        default:
+          throw SerializationError("cannot serialize unknown grammar node");
+      }
+
+      auto id = nodeIds.size();
+      nodeIds[node.get()] = id;
+      return id;
+    }
+
+    std::string encode(const Grammar &grammar) {
+      auto startId = grammar.start ? getRuleId(grammar.start) + 1 : 0;
+      auto separatorId = grammar.separator ? getNodeId(grammar.separator) + 1 : 0;
+
+      // rules can be discovered while encoding the nodes of previous rules
+      std::vector<size_t> ruleNodes, recoveryNodes;
+      for (size_t i = 0; i < rules.size(); ++i) {
+        ruleNodes.push_back(getNodeId(rules[i]->node));
+        recoveryNodes.push_back(rules[i]->recovery ? getNodeId(rules[i]->recovery) + 1 : 0);
+      }
+
+      Writer writer;
+      writer.data += MAGIC;
+      writer.writeNumber(VERSION);
+      writer.writeNumber(rules.size());
+      for (auto &rule : rules) {
+        writer.writeString(rule->name);
+        writer.writeByte((rule->hidden ? HIDDEN : 0) | (rule->cacheable ? CACHEABLE : 0)
+                         | (named.count(rule.get()) ? NAMED : 0)
+                         | (rule->leftRecursive ? 0 : NOT_LEFT_RECURSIVE));
+      }
+      writer.writeNumber(nodeIds.size());
+      writer.data += nodes.data;
+      for (size_t i = 0; i < rules.size(); ++i) {
+        writer.writeNumber(ruleNodes[i]);
+        writer.writeNumber(recoveryNodes[i]);
+      }
+      writer.writeNumber(startId);
+      writer.writeNumber(separatorId);
+      return writer.data;
+    }
+  };
+
+  Grammar decode(std::string_view data, const NamedRuleGetter &getRule) {
+    if (data.substr(0, MAGIC.size()) != MAGIC) {
+      throw SerializationError("invalid grammar data");
+    }
+    Reader reader(data.substr(MAGIC.size()));
+    if (reader.readNumber() != VERSION) {
+      throw SerializationError("unsupported grammar data version");
+    }
+
+    Grammar grammar;
+    std::vector<std::shared_ptr<grammar::Rule>> rules(reader.readCount());
+    for (auto &rule : rules) {
+      auto name = reader.readString();
+      auto flags = reader.readByte();
+      if (flags & NAMED) {
+        rule = getRule ? getRule(name) : grammar::makeRule(name, Node::Error());
+        grammar.rules.push_back(rule);
+      } else {
+        rule = grammar::makeRule(name, Node::Error());
+        grammar.internalRules.push_back(rule);
+      }
+      rule->hidden = flags & HIDDEN;
+      rule->cacheable = flags & CACHEABLE;
+      rule->leftRecursive = !(flags & NOT_LEFT_RECURSIVE);
+    }
+
+    auto getRuleById = [&](size_t id) {
+      if (id >= rules.size()) {
+        throw SerializationError("corrupted grammar data");
+      }
+      return rules[id];
+    };
+
+    std::vector<Node::Shared> nodes(reader.readCount());
+    auto getNodeById = [&](size_t id, size_t current) {
+      if (id >= current) {
+        throw SerializationError("corrupted grammar data");
+      }
+      return nodes[id];
+    };
+
+    for (size_t i = 0; i < nodes.size(); ++i) {
+      auto symbol = Symbol(reader.readByte());
+      switch (symbol) {
+        case Symbol::WORD: {
+          nodes[i] = Node::Word(std::string(reader.readString()));
+          break;
+        }
+        case Symbol::ANY: {
+          nodes[i] = Node::Any();
+          break;
+        }
+        case Symbol::RANGE: {
+          auto a = grammar::Letter(reader.readByte());
+          auto b = grammar::Letter(reader.readByte());
+          nodes[i] = Node::Range(a, b);
+          break;
+        }
+        case Symbol::CHARACTER_SET: {
+          Node::CharacterSet set;
+          for (size_t bit = 0; bit < set.size(); bit += 8) {
+            auto byte = reader.readByte();
+            for (size_t j = 0; j < 8; ++j) {
+              set[bit + j] = (byte >> j) & 1;
+            }
+          }
+          nodes[i] = Node::Set(set);
+          break;
+        }
+        case Symbol::SEQUENCE:
+        case Symbol::CHOICE: {
+          std::vector<Node::Shared> children(reader.readCount());
+          for (auto &child : children) {
+            child = getNodeById(reader.readNumber(), i);
+          }
+          nodes[i] = symbol == Symbol::SEQUENCE ? Node::Sequence(children) : Node::Choice(children);
+          break;
+        }
+        case Symbol::ZERO_OR_MORE: {
+          nodes[i] = Node::ZeroOrMore(getNodeById(reader.readNumber(), i));
+          break;
+        }
+        case Symbol::ONE_OR_MORE: {
+          nodes[i] = Node::OneOrMore(getNodeById(reader.readNumber(), i));
+          break;
+        }
+        case Symbol::OPTIONAL: {
+          nodes[i] = Node::Optional(getNodeById(reader.readNumber(), i));
+          break;
+        }
+        case Symbol::ALSO: {
+          nodes[i] = Node::Also(getNodeById(reader.readNumber(), i));
+          break;
+        }
+        case Symbol::NOT: {
+          nodes[i] = Node::Not(getNodeById(reader.readNumber(), i));
+          break;
+        }
+        case Symbol::EMPTY: {
+          nodes[i] = Node::Empty();
+          break;
+        }
+        case Symbol::ERROR: {
+          nodes[i] = Node::Error();
+          break;
+        }
+        case Symbol::RULE: {
+          nodes[i] = Node::Rule(getRuleById(reader.readNumber()));
+          break;
+        }
+        case Symbol::WEAK_RULE: {
+          nodes[i] = Node::WeakRule(getRuleById(reader.readNumber()));
+          break;
+        }
+        case Symbol::END_OF_FILE: {
+          nodes[i] = Node::EndOfFile();
+          break;
+        }
+        case Symbol::PRECEDENCE: {
+          auto operand = getNodeById(reader.readNumber(), i);
+          std::vector<Node::Operator> operators(reader.readCount());
+          for (auto &op : operators) {
+            op.rule = getRuleById(reader.readNumber());
+            op.pattern = getNodeById(reader.readNumber(), i);
+            op.precedence = unsigned(reader.readNumber());
+            op.rightAssociative = reader.readByte();
+          }
+          nodes[i] = Node::Precedence(operand, operators);
+          break;
+        }
+        default:
+          throw SerializationError("corrupted grammar data");
+      }
+    }
+
+    for (auto &rule : rules) {
+      rule->node = getNodeById(reader.readNumber(), nodes.size());
+      // named rules may be reused with an automaton compiled for their previous node
+      rule->automaton.reset();
+      if (auto recovery = reader.readNumber()) {
+        rule->recovery = getNodeById(recovery - 1, nodes.size());
+      } else {
+        rule->recovery.reset();
+      }
+    }
+    if (auto start = reader.readNumber()) {
+      grammar.start = getRuleById(start - 1);
+    }
+    if (auto separator = reader.readNumber()) {
+      grammar.separator = getNodeById(separator - 1, nodes.size());
+    }
+    return grammar;
+  }
+
+}  // namespace
+
+std::string serialization::save(const Grammar &grammar) {
+  return Encoder(grammar).encode(grammar);
+}
+
+Grammar serialization::load(std::string_view data, const NamedRuleGetter &getRule) {
+  return decode(data, getRule);
+}
+
+Grammar serialization::loadFile(const std::string &path, const NamedRuleGetter &getRule) {
+#ifdef PEG_PARSER_NO_MMAP
+  std::ifstream stream(path, std::ios::binary);
+  if (!stream) {
+    throw SerializationError("cannot open grammar file " + path);
+  }
+  std::string data((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+  return decode(data, getRule);
+#else
+  auto file = ::open(path.c_str(), O_RDONLY);
+  if (file < 0) {
+    throw SerializationError("cannot open grammar file " + path);
+  }
+  struct stat info;
+  if (::fstat(file, &info) != 0 || info.st_size == 0) {
+    ::close(file);
+    throw SerializationError("cannot read grammar file " + path);
+  }
+  auto size = size_t(info.st_size);
+  auto mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+  ::close(file);
+  if (mapped == MAP_FAILED) {
+    throw SerializationError("cannot map grammar file " + path);
+  }
+  try {
+    auto grammar = decode(std::string_view(static_cast<const char *>(mapped), size), getRule);
+    ::munmap(mapped, size);
+    return grammar;
+  } catch (...) {
+    ::munmap(mapped, size);
+    throw;
+  }
+#endif
+}
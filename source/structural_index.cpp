@@ -0,0 +1,105 @@
+#include <peg_parser/structural_index.h>
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define PEG_PARSER_SSE2
+#endif
+
+#if defined(_MSC_VER)
+#  include <intrin.h>
+#endif
+
+using namespace peg_parser;
+
+namespace {
+
+  unsigned countTrailingZeros(uint32_t mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return unsigned(index);
+#else
+    return unsigned(__builtin_ctz(mask));
+#endif
+  }
+
+  /** Adds the positions of the bytes in `table` from `begin` to `end` one by one */
+  void indexBytes(std::string_view input, size_t begin, const std::array<bool, 256> &table,
+                  std::vector<uint32_t> &positions) {
+    for (auto position = begin; position < input.size(); ++position) {
+      if (table[static_cast<unsigned char>(input[position])]) {
+        positions.push_back(uint32_t(position));
+      }
+    }
+  }
+
+}  // namespace
+
+StructuralIndex::StructuralIndex(std::string_view input, std::string_view bytes) : text(input) {
+  if (input.size() > std::numeric_limits<uint32_t>::max()) {
+    throw std::length_error("input too long to index");
+  }
+  std::array<bool, 256> table{};
+  for (auto byte : bytes) {
+    table[static_cast<unsigned char>(byte)] = true;
+  }
+  size_t position = 0;
+#ifdef PEG_PARSER_SSE2
+  std::string needles;
+  for (size_t byte = 0; byte < table.size(); ++byte) {
+    if (table[byte]) {
+      needles += static_cast<char>(byte);
+    }
+  }
+  for (; position + 16 <= input.size(); position += 16) {
+    auto block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input.data() + position));
+    auto matches = _mm_setzero_si128();
+    for (auto needle : needles) {
+      matches = _mm_or_si128(matches, _mm_cmpeq_epi8(block, _mm_set1_epi8(needle)));
+    }
+    for (auto mask = uint32_t(_mm_movemask_epi8(matches)); mask != 0; mask &= mask - 1) {
+      indexed.push_back(uint32_t(position + countTrailingZeros(mask)));
+    }
+  }
+#endif
+  indexBytes(input, position, table, indexed);
+}
+
+std::vector<std::string_view> StructuralIndex::split(char separator) const {
+  std::vector<std::string_view> records;
+  size_t begin = 0;
+  for (auto position : indexed) {
+    if (text[position] == separator) {
+      records.push_back(text.substr(begin, position - begin));
+      begin = position + 1;
+    }
+  }
+  records.push_back(text.substr(begin));
+  return records;
+}
+
+size_t StructuralIndex::findUnbalanced(char open, char close, size_t begin, size_t end) const {
+  end = std::min(end, text.size());
+  auto first = std::lower_bound(indexed.begin(), indexed.end(), begin);
+  auto last = std::lower_bound(first, indexed.end(), end);
+  size_t depth = 0, outermost = npos;
+  for (auto it = first; it != last; ++it) {
+    if (text[*it] == open) {
+      if (depth++ == 0) {
+        outermost = *it;
+      }
+    } else if (text[*it] == close) {
+      if (depth == 0) {
+        return *it;
+      }
+      --depth;
+    }
+  }
+  return depth == 0 ? npos : outermost;
+}
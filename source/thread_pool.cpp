@@ -0,0 +1,132 @@
+#include <peg_parser/thread_pool.h>
+
+#include <algorithm>
+#include <utility>
+
+using namespace peg_parser;
+
+namespace {
+
+  /** pool and queue of the current worker thread */
+  thread_local const ThreadPool *currentPool = nullptr;
+  thread_local size_t currentQueue = 0;
+
+}  // namespace
+
+ThreadPool::Group::~Group() {
+  try {
+    wait();
+  } catch (...) {
+  }
+}
+
+void ThreadPool::Group::run(Task task) {
+  ++pending;
+  pool.push([this, task = std::move(task)]() mutable {
+    std::exception_ptr failure;
+    try {
+      task();
+    } catch (...) {
+      failure = std::current_exception();
+    }
+    task = nullptr;
+    // the group may be destroyed as soon as the lock is released after the last task
+    std::lock_guard<std::mutex> lock(mutex);
+    if (failure && !error) {
+      error = failure;
+    }
+    if (--pending == 0) {
+      finished.notify_all();
+    }
+  });
+}
+
+void ThreadPool::Group::wait() {
+  // helps with queued tasks, then sleeps until the remaining ones running elsewhere are done
+  while (pending > 0 && pool.runQueued()) {
+  }
+  std::unique_lock<std::mutex> lock(mutex);
+  finished.wait(lock, [this]() { return pending == 0; });
+  if (error) {
+    std::rethrow_exception(std::exchange(error, nullptr));
+  }
+}
+
+ThreadPool::ThreadPool(size_t threads) {
+  if (threads == 0) {
+    threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  }
+  for (size_t i = 0; i < threads; ++i) {
+    queues.push_back(std::make_unique<Queue>());
+  }
+  for (size_t i = 0; i < threads; ++i) {
+    workers.emplace_back([this, i]() { work(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::push(Task task) {
+  auto index = currentPool == this ? currentQueue : nextQueue++ % queues.size();
+  {
+    std::lock_guard<std::mutex> lock(queues[index]->mutex);
+    queues[index]->tasks.push_back(std::move(task));
+  }
+  ++queued;
+  // locking ensures that a worker about to sleep sees the task or receives the notification
+  { std::lock_guard<std::mutex> lock(mutex); }
+  wake.notify_one();
+}
+
+bool ThreadPool::runQueued() {
+  if (queued == 0) {
+    return false;
+  }
+  auto own = currentPool == this;
+  auto first = own ? currentQueue : 0;
+  for (size_t offset = 0; offset < queues.size(); ++offset) {
+    auto &queue = *queues[(first + offset) % queues.size()];
+    Task task;
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.tasks.empty()) {
+        continue;
+      }
+      if (own && offset == 0) {
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+      } else {
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+      }
+    }
+    --queued;
+    task();
+    return true;
+  }
+  return false;
+}
+
+void ThreadPool::work(size_t index) {
+  currentPool = this;
+  currentQueue = index;
+  while (true) {
+    if (runQueued()) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    wake.wait(lock, [this]() { return stopping || queued > 0; });
+    if (stopping && queued == 0) {
+      return;
+    }
+  }
+}
@@ -0,0 +1,111 @@
+#include <peg_parser/generator.h>
+
+#include <catch2/catch.hpp>
+#include <sstream>
+
+using namespace peg_parser;
+
+namespace {
+
+  template <class T> std::string streamToString(const T &obj) {
+    std::stringstream stream;
+    stream << obj;
+    return stream.str();
+  }
+
+  void setCalculatorRules(ParserGenerator<float> &calculator) {
+    calculator.setSeparatorRule("Whitespace", "[\t ]");
+    calculator.setStart(calculator.setRule("Expression", "Sum"));
+    calculator.setRule("Sum", "Add | Subtract | Product");
+    calculator.setRule("Add", "Sum '+' Product",
+                       [](auto e) { return e[0].evaluate() + e[1].evaluate(); });
+    calculator.setRule("Subtract", "Sum '-' Product",
+                       [](auto e) { return e[0].evaluate() - e[1].evaluate(); });
+    calculator.setRule("Product", "Multiply | Atomic");
+    calculator.setRule("Multiply", "Product '*' Atomic",
+                       [](auto e) { return e[0].evaluate() * e[1].evaluate(); });
+    calculator.setRule("Atomic", "Number | '(' Sum ')'");
+    calculator.setRule("Number", "[0-9]+", [](auto e) { return e.template number<float>(); });
+  }
+
+}  // namespace
+
+TEST_CASE("Grammar analysis") {
+  ParserGenerator<float> calculator;
+  setCalculatorRules(calculator);
+  REQUIRE(calculator.getRule("Atomic")->leftRecursive);
+
+  auto analysis = calculator.analyze();
+  auto leftRecursive = [&](const std::string &name) {
+    return analysis.leftRecursive.count(calculator.getRule(name).get()) > 0;
+  };
+  REQUIRE(analysis.rules.size() == 9);
+  REQUIRE(analysis.nullable.empty());
+  REQUIRE(leftRecursive("Sum"));
+  REQUIRE(leftRecursive("Subtract"));
+  REQUIRE(leftRecursive("Multiply"));
+  REQUIRE(!leftRecursive("Expression"));
+  REQUIRE(!leftRecursive("Atomic"));
+  REQUIRE(!calculator.getRule("Atomic")->leftRecursive);
+  REQUIRE(calculator.getRule("Product")->leftRecursive);
+  REQUIRE(streamToString(analysis)
+          == "left recursion: Sum -> Add -> Sum\n"
+             "left recursion: Sum -> Subtract -> Sum\n"
+             "left recursion: Product -> Multiply -> Product\n");
+
+  REQUIRE(calculator.run("1 + 2 * 3 - 4") == 3);
+  ParserGenerator<float> unanalyzed;
+  setCalculatorRules(unanalyzed);
+  for (auto input : {"1 + 2 * (3 - 4)", "1 + 2 * (3 - 4", "(1)*2*3-4+5 * (6)", "1 ++ 2"}) {
+    REQUIRE(streamToString(*calculator.parse(input))
+            == streamToString(*unanalyzed.parse(input)));
+    REQUIRE(calculator.parser.recognize(input).end == unanalyzed.parser.recognize(input).end);
+  }
+
+  SECTION("changing the grammar") {
+    calculator.setRule("Atomic", "Atomic '!' | Number | '(' Sum ')'");
+    REQUIRE(calculator.getRule("Sum")->leftRecursive);
+    REQUIRE(calculator.getRule("Atomic")->leftRecursive);
+    REQUIRE(calculator.getRule("Number")->leftRecursive);
+    REQUIRE(calculator.run("1 + 2!") == 3);
+    REQUIRE(streamToString(calculator.analyze()).find("Atomic -> Atomic\n") != std::string::npos);
+    REQUIRE(calculator.run("1 + 2!!") == 3);
+  }
+
+  SECTION("saving the analysis") {
+    ParserGenerator<float> loaded;
+    loaded.load(calculator.save());
+    REQUIRE(!loaded.getRule("Atomic")->leftRecursive);
+    REQUIRE(loaded.getRule("Sum")->leftRecursive);
+    loaded.setRule("Number", "[0-9]+ Product?");
+    REQUIRE(loaded.getRule("Atomic")->leftRecursive);
+  }
+}
+
+TEST_CASE("Nullable left recursion") {
+  ParserGenerator<> program;
+  program.setStart(program["A"] << "B A 'a' | &C 'x' | 'a'");
+  program["B"] << "'b'?";
+  program["C"] << "A";
+  program["D"] << "{B; left: Op D}";
+  program["Op"] << "'o'";
+  program["E"] << "!D";
+  auto analysis = program.analyze();
+  auto has = [&](const auto &set, const std::string &name) {
+    return set.count(program.getRule(name).get()) > 0;
+  };
+  REQUIRE(has(analysis.nullable, "B"));
+  REQUIRE(!has(analysis.nullable, "A"));
+  REQUIRE(has(analysis.leftRecursive, "A"));
+  REQUIRE(has(analysis.leftRecursive, "C"));
+  REQUIRE(!has(analysis.leftRecursive, "B"));
+  REQUIRE(analysis.cycles.size() == 2);
+
+  program.setStart(program.getRule("E"));
+  analysis = program.analyze();
+  REQUIRE(has(analysis.nullable, "D"));
+  REQUIRE(has(analysis.nullable, "E"));
+  REQUIRE(has(analysis.leftRecursive, "D"));
+  REQUIRE(!has(analysis.leftRecursive, "E"));
+  REQUIRE(streamToString(analysis) == "left recursion: D -> D\n");
+}
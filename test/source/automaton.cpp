@@ -0,0 +1,155 @@
+#include <peg_parser/automaton.h>
+#include <peg_parser/generator.h>
+
+#include <catch2/catch.hpp>
+#include <random>
+
+using namespace peg_parser;
+using GN = grammar::Node;
+
+namespace {
+
+  /** End of the match of `rule` parsed without automaton */
+  size_t parsedEnd(const std::shared_ptr<grammar::Rule> &rule, const std::string &input) {
+    auto match = Parser::recognize(input, rule);
+    return match.valid ? match.end : grammar::Automaton::npos;
+  }
+
+  /** Checks that the automaton of `rule` agrees with the parser on all `inputs` */
+  void requireEquivalent(const std::shared_ptr<grammar::Rule> &rule,
+                         const std::vector<std::string> &inputs) {
+    auto automaton = grammar::Automaton::compile(*rule->node);
+    REQUIRE(automaton);
+    for (auto &input : inputs) {
+      CAPTURE(*rule->node, input);
+      REQUIRE(automaton->match(input, 0) == parsedEnd(rule, input));
+    }
+  }
+
+  /** All strings of up to `length` letters from `alphabet` */
+  std::vector<std::string> allStrings(const std::string &alphabet, size_t length) {
+    std::vector<std::string> strings{""};
+    for (size_t i = 0; i < strings.size(); ++i) {
+      if (strings[i].size() < length) {
+        for (auto c : alphabet) {
+          strings.push_back(strings[i] + c);
+        }
+      }
+    }
+    return strings;
+  }
+
+  GN::Shared randomNode(std::mt19937 &random, size_t depth) {
+    auto pick = [&](size_t count) {
+      return std::uniform_int_distribution<size_t>(0, count - 1)(random);
+    };
+    if (depth == 0) {
+      switch (pick(4)) {
+        case 0:
+          return GN::Word(std::string(1, "abc"[pick(3)]));
+        case 1:
+          return GN::Word(std::string("ab").substr(pick(2)) + "c");
+        case 2:
+          return GN::Range('a', "abc"[pick(3)]);
+        default:
+          return GN::Any();
+      }
+    }
+    switch (pick(6)) {
+      case 0:
+      case 1: {
+        std::vector<GN::Shared> children(2 + pick(2));
+        for (auto &child : children) {
+          child = randomNode(random, depth - 1);
+        }
+        return pick(2) ? GN::Sequence(children) : GN::Choice(children);
+      }
+      case 2:
+        return GN::Optional(randomNode(random, depth - 1));
+      case 3:
+        return GN::ZeroOrMore(randomNode(random, depth - 1));
+      case 4:
+        return GN::OneOrMore(randomNode(random, depth - 1));
+      default:
+        return randomNode(random, 0);
+    }
+  }
+
+}  // namespace
+
+TEST_CASE("Automaton") {
+  auto inputs = allStrings("abc", 6);
+
+  SECTION("ordered choices and possessive repetitions") {
+    for (auto expression :
+         {"'a' | 'ab'", "('a' | 'ab') 'c'", "'a'* 'a'", "('ab')* 'a'", "('a' 'b'?)* 'c'",
+          "(('a' 'b' | 'a') 'c' | 'a' .)", "('a' | 'b' 'c')+ 'b'?", "[a-b]* | 'c'", "''"}) {
+      ParserGenerator<> program;
+      requireEquivalent(program.setRule("Rule", expression), inputs);
+    }
+  }
+
+  SECTION("numbers") {
+    ParserGenerator<> program;
+    auto rule = program.setRule("Number", "'-'? [0-9]+ ('.' [0-9]+)?");
+    requireEquivalent(rule, allStrings("-.0x", 5));
+    auto automaton = grammar::Automaton::compile(*rule->node);
+    REQUIRE(automaton->match("x-12.5x", 1) == 6);
+    REQUIRE(automaton->match("x-12.x", 1) == 4);
+    REQUIRE(automaton->match("x-.5", 1) == grammar::Automaton::npos);
+    REQUIRE(automaton->stateCount() < 10);
+  }
+
+  SECTION("random nodes") {
+    std::mt19937 random(42);
+    size_t compiled = 0;
+    for (size_t i = 0; i < 200; ++i) {
+      auto rule = grammar::makeRule("Random", randomNode(random, 3));
+      if (grammar::Automaton::compile(*rule->node)) {
+        requireEquivalent(rule, inputs);
+        ++compiled;
+      }
+    }
+    REQUIRE(compiled > 100);
+  }
+
+  SECTION("irregular nodes") {
+    auto a = GN::Word("a");
+    for (auto node : {GN::Rule(grammar::makeRule("A", a)), GN::Not(a), GN::Also(a), GN::Error(),
+                      GN::EndOfFile(), GN::Filter([](auto &) { return true; }),
+                      GN::ZeroOrMore(GN::Optional(a)), GN::Range('\0', 'a'), GN::Choice({})}) {
+      CAPTURE(*node);
+      REQUIRE(!grammar::Automaton::compile(*node));
+    }
+    REQUIRE(!grammar::Automaton::compile(*GN::Word("abc"), 6));
+    REQUIRE(grammar::Automaton::compile(*GN::Word("abc"), 7));
+  }
+}
+
+TEST_CASE("Automata in grammars") {
+  ParserGenerator<float> calculator;
+  calculator.setSeparator(calculator["Whitespace"] << "[\t ]");
+  calculator.setStart(calculator["Expression"] << "Sum <EOF>");
+  calculator["Sum"] << "Add | Product";
+  calculator["Add"] << "Sum '+' Product" >>
+      [](auto e) { return e[0].evaluate() + e[1].evaluate(); };
+  calculator["Product"] << "Multiply | Number";
+  calculator["Multiply"] << "Product '*' Number" >>
+      [](auto e) { return e[0].evaluate() * e[1].evaluate(); };
+  calculator["Number"] << "'-'? [0-9]+ ('.' [0-9]+)?" >> [](auto e) { return stof(e.string()); };
+
+  calculator.optimize();
+  REQUIRE(calculator.getRule("Number")->automaton);
+  REQUIRE(calculator.getRule("Whitespace")->automaton);
+  REQUIRE(!calculator.getRule("Sum")->automaton);
+  REQUIRE(calculator.run("1.5 + 2 * -3") == Approx(-4.5));
+  REQUIRE(calculator.parser.recognize("1.5 + 2 * 3").valid);
+  REQUIRE(!calculator.parser.recognize("1.5 + 2 *").valid);
+  REQUIRE_THROWS_WITH(calculator.run("1 + 2."), Catch::Contains("expected [0-9]"));
+
+  calculator["Number"] << "[0-9]+" >> [](auto e) { return stof(e.string()); };
+  REQUIRE(!calculator.getRule("Number")->automaton);
+  REQUIRE(calculator.run("1 + 2 * 3") == 7);
+  REQUIRE(grammar::compileAutomata(calculator.parser.grammar) == 2);
+  REQUIRE(calculator.run("1 + 2 * 3") == 7);
+}
@@ -0,0 +1,66 @@
+#include <peg_parser/generator.h>
+
+#include <catch2/catch.hpp>
+#include <sstream>
+#include <string>
+
+using namespace peg_parser;
+
+namespace {
+  template <class T> std::string streamToString(const T &obj) {
+    std::stringstream stream;
+    stream << obj;
+    return stream.str();
+  }
+}  // namespace
+
+TEST_CASE("Compact Syntax Tree") {
+  ParserGenerator<int> program;
+  program.setSeparator(program["Whitespace"] << "[\t ]");
+  program["Number"] << "[0-9]+" >> [](auto e) { return e.template number<int>(); };
+  program["Sum"] << "Sum '+' Product | Product" >> [](auto e) {
+    return e.size() == 1 ? e[0].evaluate() : e[0].evaluate() + e[1].evaluate();
+  };
+  program["Product"] << "Product '*' Number | Number" >> [](auto e) {
+    return e.size() == 1 ? e[0].evaluate() : e[0].evaluate() * e[1].evaluate();
+  };
+  program["List"] << "Sum (',' Sum)*" >> [](auto e) {
+    int total = 0;
+    for (auto s : e) {
+      total += s.evaluate();
+    }
+    return total;
+  };
+  program.setStart(program["List"]);
+
+  std::string input = "1 + 2 * 3, 4 * 5 + 6, 7";
+  auto tree = program.parse(input);
+  REQUIRE(tree->valid);
+  CompactSyntaxTree compact(*tree);
+
+  SECTION("structure") {
+    REQUIRE(compact.string() == input);
+    REQUIRE(streamToString(compact.root()) == streamToString(*tree));
+    REQUIRE(compact.root().size() == 3);
+    REQUIRE(compact.root()[1].view() == "4 * 5 + 6");
+    REQUIRE(compact.root()[2][0][0].rule()->name == "Number");
+    REQUIRE(compact.memoryUsage() < compact.nodeCount() * sizeof(SyntaxTree));
+  }
+
+  SECTION("expand") {
+    auto expanded = compact.expand(compact.root());
+    REQUIRE(streamToString(*expanded) == streamToString(*tree));
+    REQUIRE(expanded->end == tree->end);
+  }
+
+  SECTION("interpret") {
+    REQUIRE(program.interpreter.evaluate(compact) == 7 + 26 + 7);
+    auto e = program.interpreter.interpret(compact.root());
+    REQUIRE(e.size() == 3);
+    REQUIRE(e[0].position() == 0);
+    REQUIRE(e[0].length() == 9);
+    REQUIRE(e["Sum"]);
+    REQUIRE(!e["Number"]);
+    REQUIRE(e[2].syntax()->view() == "7");
+  }
+}
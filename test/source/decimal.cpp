@@ -0,0 +1,61 @@
+#include <catch2/catch.hpp>
+#include <limits>
+#include <sstream>
+#include <string>
+
+#include "../../calculator/decimal.h"
+
+namespace {
+
+  std::string toString(Decimal value) {
+    std::stringstream stream;
+    stream << value;
+    return stream.str();
+  }
+
+}  // namespace
+
+TEST_CASE("Decimal") {
+  SECTION("parsing") {
+    REQUIRE(Decimal::parse("42") == Decimal(42LL));
+    REQUIRE(Decimal::parse("-1.5").getRaw() == -1500000);
+    REQUIRE(Decimal::parse("0.000001").getRaw() == 1);
+    REQUIRE(Decimal::parse("1.23456789").getRaw() == 1234567);
+    REQUIRE(toString(Decimal::parse("-12.340")) == "-12.34");
+    REQUIRE(toString(Decimal::parse("9223372036854.775807")) == "9223372036854.775807");
+    REQUIRE_THROWS_AS(Decimal::parse(""), std::invalid_argument);
+    REQUIRE_THROWS_AS(Decimal::parse("--1"), std::invalid_argument);
+    REQUIRE_THROWS_AS(Decimal::parse("1."), std::invalid_argument);
+    REQUIRE_THROWS_AS(Decimal::parse("1.2a"), std::invalid_argument);
+  }
+
+  SECTION("rounding") {
+    REQUIRE(toString(Decimal::parse("0.1") + Decimal::parse("0.2")) == "0.3");
+    REQUIRE(toString(Decimal(1LL) / Decimal(3LL)) == "0.333333");
+    REQUIRE(toString(Decimal(2LL) / Decimal(3LL)) == "0.666667");
+    REQUIRE(toString(Decimal(-2LL) / Decimal(3LL)) == "-0.666667");
+    REQUIRE(toString(Decimal::parse("0.000001") * Decimal::parse("0.5")) == "0.000001");
+    REQUIRE(toString(Decimal::parse("-0.000001") * Decimal::parse("0.5")) == "-0.000001");
+    REQUIRE(toString(Decimal(0.1234564)) == "0.123456");
+    REQUIRE(toString(Decimal(-0.1234565)) == "-0.123457");
+  }
+
+  SECTION("division by zero") {
+    REQUIRE_THROWS_AS(Decimal(1LL) / Decimal(), std::domain_error);
+  }
+
+  SECTION("overflow") {
+    auto large = Decimal::parse("999999999999");
+    REQUIRE_THROWS_AS(Decimal::parse("99999999999999"), std::domain_error);
+    REQUIRE_THROWS_AS(Decimal::parse("9223372036855"), std::domain_error);
+    REQUIRE_THROWS_AS(Decimal::parse("99999999999999999999"), std::domain_error);
+    REQUIRE_THROWS_AS(Decimal(9223372036855LL), std::domain_error);
+    REQUIRE_THROWS_AS(Decimal(1e13), std::domain_error);
+    REQUIRE_THROWS_AS(large * Decimal(10LL), std::domain_error);
+    REQUIRE_THROWS_AS(large / Decimal::parse("0.01"), std::domain_error);
+    REQUIRE_THROWS_AS(Decimal::parse("9223372036854") + Decimal(1LL), std::domain_error);
+    REQUIRE_THROWS_AS(Decimal::parse("-9223372036854") - Decimal(1LL), std::domain_error);
+    REQUIRE_THROWS_AS(-Decimal::fromRaw(std::numeric_limits<int64_t>::min()), std::domain_error);
+    REQUIRE(toString(large * Decimal::parse("0.1")) == "99999999999.9");
+  }
+}
@@ -0,0 +1,119 @@
+#include <peg_parser/generator.h>
+
+#include <catch2/catch.hpp>
+#include <sstream>
+
+using namespace peg_parser;
+
+namespace {
+
+  template <class T> std::string streamToString(const T &obj) {
+    std::stringstream stream;
+    stream << obj;
+    return stream.str();
+  }
+
+  void setCalculatorRules(ParserGenerator<float> &calculator) {
+    calculator.setSeparatorRule("Whitespace", "[\t ]");
+    calculator.setStart(calculator.setRule("Expression", "Sum <EOF>"));
+    calculator.setRule("Sum", "Add | Subtract | Product");
+    calculator.setRule("Add", "Sum '+' Product",
+                       [](auto e) { return e[0].evaluate() + e[1].evaluate(); });
+    calculator.setRule("Subtract", "Sum '-' Product",
+                       [](auto e) { return e[0].evaluate() - e[1].evaluate(); });
+    calculator.setRule("Product", "Multiply | Atomic");
+    calculator.setRule("Multiply", "Product '*' Atomic",
+                       [](auto e) { return e[0].evaluate() * e[1].evaluate(); });
+    calculator.setRule("Atomic", "Number | Variable | '(' Sum ')'");
+    calculator.setRule("Number", "'-'? [0-9]+ ('.' [0-9]+)?",
+                       [](auto e) { return e.template number<float>(); });
+    calculator.setRule("Variable", "[a-z] [a-z0-9]*", [](auto) { return 1.f; });
+  }
+
+  /** Number of steps `program` needs to parse `input`, see `ParseLimits::steps` */
+  template <class P> size_t requiredSteps(P &program, const std::string &input) {
+    auto parses = [&](size_t steps) {
+      program.parser.limits.steps = steps;
+      try {
+        program.parser.parse(input);
+        return true;
+      } catch (const Parser::LimitError &) {
+        return false;
+      }
+    };
+    size_t lower = 0, upper = 1;
+    while (!parses(upper)) {
+      lower = upper;
+      upper *= 2;
+    }
+    while (upper - lower > 1) {
+      auto middle = (lower + upper) / 2;
+      (parses(middle) ? upper : lower) = middle;
+    }
+    return upper;
+  }
+
+}  // namespace
+
+TEST_CASE("Lexer") {
+  ParserGenerator<float> calculator;
+  setCalculatorRules(calculator);
+  auto lexer = calculator.setTokens({"Number", "Variable"});
+  REQUIRE(calculator.getRule("Number")->lexer == lexer);
+  REQUIRE(calculator.getRule("Whitespace")->lexer == lexer);
+  REQUIRE(!calculator.getRule("Sum")->lexer);
+
+  SECTION("tokens") {
+    auto tokens = lexer->tokenize("x1 +  -2.5*(y)");
+    std::vector<std::string> names;
+    for (auto &token : tokens) {
+      names.push_back(lexer->getRule(token)->name + "@" + std::to_string(token.begin) + "-"
+                      + std::to_string(token.end));
+    }
+    REQUIRE(names
+            == std::vector<std::string>{"Variable@0-2", "Whitespace@2-3", "Whitespace@4-6",
+                                        "Number@6-10", "Variable@12-13"});
+  }
+
+  SECTION("parsing") {
+    REQUIRE(calculator.run("1 + 2 * (3 + 4)") == 15);
+    REQUIRE(calculator.run("-1.5 * x + 2") == 0.5);
+    auto tree = calculator.parse(" 12 + 3");
+    REQUIRE(streamToString(*tree)
+            == "Expression(Sum(Add(Sum(Product(Atomic(Number('12')))), "
+               "Product(Atomic(Number('3'))))))");
+    REQUIRE(tree->inner[0]->inner[0]->inner[0]->begin == 1);
+    REQUIRE(calculator.parser.recognize("1+2").valid);
+    REQUIRE(!calculator.parser.recognize("1+").valid);
+    REQUIRE_THROWS_WITH(calculator.run("1 + 2 *"), Catch::Contains("expected Atomic"));
+  }
+
+  SECTION("whole tokens") {
+    // the lexer reads a negative number, so there is no token for `Number` after the minus
+    REQUIRE(!calculator.parser.recognize("x-1").valid);
+    REQUIRE(calculator.run("x - 1") == 0);
+    calculator.unsetTokens();
+    REQUIRE(!calculator.getRule("Number")->lexer);
+    REQUIRE(calculator.run("x-1") == 0);
+  }
+
+  SECTION("steps") {
+    std::string input = "1";
+    for (size_t i = 0; i < 50; ++i) {
+      input += " + 1234567.125 * variable" + std::to_string(i);
+    }
+    ParserGenerator<float> scannerless;
+    setCalculatorRules(scannerless);
+    REQUIRE(calculator.run(input) == Approx(scannerless.run(input)));
+    // the steps of the other rules remain, but numbers and variables take a single step each
+    REQUIRE(3 * requiredSteps(calculator, input) < 2 * requiredSteps(scannerless, input));
+  }
+
+  SECTION("changing the grammar") {
+    calculator.setRule("Number", "[0-9]+", [](auto e) { return e.template number<float>(); });
+    REQUIRE(!calculator.getRule("Number")->lexer);
+    REQUIRE(!calculator.getRule("Variable")->lexer);
+    REQUIRE(calculator.run("2 * 3") == 6);
+    REQUIRE_THROWS_AS(calculator.setTokens({"Sum"}), std::invalid_argument);
+  }
+}
@@ -0,0 +1,89 @@
+#include <peg_parser/generator.h>
+#include <peg_parser/optimizer.h>
+
+#include <catch2/catch.hpp>
+#include <sstream>
+
+using namespace peg_parser;
+using GN = grammar::Node;
+
+namespace {
+
+  template <class T> std::string streamToString(const T &obj) {
+    std::stringstream stream;
+    stream << obj;
+    return stream.str();
+  }
+
+  std::string optimized(const std::string_view &expression) {
+    auto rc = [](std::string_view name) {
+      return GN::Rule(grammar::makeRule(name, GN::Empty()));
+    };
+    auto rules = std::make_shared<std::unordered_map<std::string, GN::Shared>>();
+    auto getRule = [rules, rc](std::string_view name) {
+      auto &rule = (*rules)[std::string(name)];
+      if (!rule) {
+        rule = rc(name);
+      }
+      return rule;
+    };
+    return streamToString(*grammar::optimize(presets::parsePEGExpression(expression, getRule)));
+  }
+
+}  // namespace
+
+TEST_CASE("Grammar optimizer") {
+  SECTION("nodes") {
+    REQUIRE(optimized("a (b c) (d (e))") == "(a b c d e)");
+    REQUIRE(optimized("a | (b | c) | d") == "(a | b | c | d)");
+    REQUIRE(optimized("'a' 'b' c 'd' ''") == "('ab' c 'd')");
+    REQUIRE(optimized("[a-z] | [A-Z] | '_'") == "[A-Z_a-z]");
+    REQUIRE(optimized("[abc] | d | 'e'") == "([a-c] | d | 'e')");
+    REQUIRE(optimized("a b c | a b d | a e") == "(a ((b (c | d)) | e))");
+    REQUIRE(optimized("a b | a") == "(a b?)");
+    REQUIRE(optimized("a | a b") == "a");
+    REQUIRE(optimized("a | b? | c") == "(a | b?)");
+    REQUIRE(optimized("a [] | []") == "[]");
+    REQUIRE(optimized("a* a* b") == "(a* b)");
+    REQUIRE(optimized("('')?") == "''");
+  }
+
+  SECTION("shared nodes are not modified") {
+    auto word = GN::Word("a");
+    auto sequence = GN::Sequence({GN::Sequence({word, GN::Word("b")})});
+    auto result = grammar::optimize(sequence);
+    REQUIRE(streamToString(*result) == "'ab'");
+    REQUIRE(streamToString(*sequence) == "(('a' 'b'))");
+  }
+
+  SECTION("rules") {
+    ParserGenerator<float> g;
+    g.setSeparator(g["Whitespace"] << "[\t ]");
+    g["Sum"] << "Add | Subtract | Product";
+    g["Product"] << "Multiply | Divide | Atomic";
+    g["Atomic"] << "Number | '(' Sum ')'";
+    g["Add"] << "Sum '+' Product" >> [](auto e) { return e[0].evaluate() + e[1].evaluate(); };
+    g["Subtract"] << "Sum '-' Product" >> [](auto e) { return e[0].evaluate() - e[1].evaluate(); };
+    g["Multiply"] << "Product '*' Atomic" >> [](auto e) { return e[0].evaluate() * e[1].evaluate(); };
+    g["Divide"] << "Product '/' Atomic" >> [](auto e) { return e[0].evaluate() / e[1].evaluate(); };
+    g["Number"] << "'-'? [0-9]+ ('.' [0-9]+)?" >> [](auto e) { return stof(e.string()); };
+    g.setStart(g["Sum"]);
+
+    std::vector<std::string> inputs{"42", "1 + 2 * (3+4)/ 2 - 3", "1 - 2*3/2 + 4", "1 +", "(1"};
+    std::vector<std::string> trees;
+    for (auto &input : inputs) {
+      trees.push_back(streamToString(*g.parse(input)));
+    }
+
+    auto statistics = g.optimize();
+    REQUIRE(statistics.rules == 9);
+    REQUIRE(statistics.nodesAfter < statistics.nodesBefore);
+    REQUIRE_THAT(streamToString(statistics), Catch::Matchers::StartsWith("optimized 9 rules: "));
+
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      REQUIRE(streamToString(*g.parse(inputs[i])) == trees[i]);
+    }
+    REQUIRE(g.run("1 + 2 * (3+4)/ 2 - 3") == Approx(5));
+    REQUIRE(g.optimize().nodesAfter == statistics.nodesAfter);
+  }
+}
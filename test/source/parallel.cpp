@@ -0,0 +1,89 @@
+#include <peg_parser/generator.h>
+
+#include <catch2/catch.hpp>
+#include <random>
+#include <sstream>
+
+using namespace peg_parser;
+
+namespace {
+
+  template <class T> std::string streamToString(const T &obj) {
+    std::stringstream stream;
+    stream << obj;
+    return stream.str();
+  }
+
+  /** Lines of assignments and quoted strings, which may contain line breaks themselves */
+  std::string createDocument(std::mt19937 &random, size_t lines) {
+    std::string document;
+    for (size_t i = 0; i < lines; ++i) {
+      switch (std::uniform_int_distribution<int>(0, 3)(random)) {
+        case 0:
+          document += "\"quoted\n line " + std::to_string(i) + "\n\"\n";
+          break;
+        case 1:
+          document += "\n";
+          break;
+        default:
+          document += "x" + std::to_string(i) + " = " + std::to_string(i * 7) + "\n";
+      }
+    }
+    return document;
+  }
+
+}  // namespace
+
+TEST_CASE("Parallel parsing") {
+  ParserGenerator<> program;
+  program.setSeparator(program["Whitespace"] << "[\t ]");
+  program.setStart(program["Document"] << "Item*");
+  program["Item"] << "(Assignment | String)? '\n'";
+  program["Assignment"] << "Name '=' Number";
+  program["Name"] << "[a-z] [a-z0-9]*";
+  program["Number"] << "[0-9]+";
+  program["String"] << "'\"' (!'\"' .)* '\"'";
+
+  Parser::Chunking chunking;
+  chunking.boundary = program.parseRule("'\n'");
+  chunking.threads = 4;
+  chunking.minLength = 1;
+
+  SECTION("same tree as sequential parsing") {
+    std::mt19937 random(11);
+    for (size_t lines = 0; lines < 40; ++lines) {
+      auto document = createDocument(random, lines);
+      CAPTURE(document);
+      auto expected = program.parser.parse(document);
+      auto tree = program.parser.parseParallel(document, chunking);
+      REQUIRE(tree->valid);
+      REQUIRE(tree->end == expected->end);
+      REQUIRE(streamToString(*tree) == streamToString(*expected));
+    }
+  }
+
+  SECTION("misaligned splits") {
+    // every split but the first lies within the string
+    std::string document = "\"a\nb\nc\nd\ne\nf\"\nx = 1\n";
+    auto tree = program.parser.parseParallel(document, chunking);
+    REQUIRE(tree->end == document.size());
+    REQUIRE(tree->inner.size() == 2);
+    REQUIRE(tree->inner[0]->inner[0]->rule->name == "String");
+    REQUIRE(tree->inner[1]->inner[0]->rule->name == "Assignment");
+  }
+
+  SECTION("errors") {
+    std::string document = "x = 1\ny = \nz = 3\n";
+    auto tree = program.parser.parseParallel(document, chunking);
+    REQUIRE(tree->valid);
+    REQUIRE(tree->end == 6);
+    REQUIRE(tree->inner.size() == 1);
+  }
+
+  SECTION("invalid grammars") {
+    REQUIRE_THROWS_AS(program.parser.parseParallel("x = 1\n", Parser::Chunking()),
+                      std::invalid_argument);
+    program.setStart(program["Line"] << "Item");
+    REQUIRE_THROWS_AS(program.parser.parseParallel("x = 1\n", chunking), std::invalid_argument);
+  }
+}
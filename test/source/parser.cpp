@@ -1,7 +1,10 @@
 #include <peg_parser/generator.h>
 
 #include <catch2/catch.hpp>
+#include <cmath>
+#include <memory>
 #include <numeric>
+#include <optional>
 #include <sstream>
 #include <string>
 #include <tuple>
@@ -40,6 +43,21 @@ TEST_CASE("Hex Program") {
   REQUIRE(parser.run("FA34ABC") == 0xFA34ABC);
 }
 
+TEST_CASE("Number parsing") {
+  REQUIRE(parseNumber<int>("-17") == -17);
+  REQUIRE(parseNumber<int>("ff", 16) == 0xff);
+  REQUIRE(parseNumber<long long>("101", 2) == 5);
+  REQUIRE(parseNumber<double>("1.5e3") == Approx(1500));
+  REQUIRE_THROWS_AS(parseNumber<int>("12a"), std::invalid_argument);
+  REQUIRE_THROWS_AS(parseNumber<int>(""), std::invalid_argument);
+  REQUIRE_THROWS_AS(parseNumber<int>("99999999999"), std::out_of_range);
+
+  ParserGenerator<int> program;
+  program.setStart(program.setRule("Hex", "[0-9a-f]+",
+                                   [](auto e) { return e.template number<int>(16); }));
+  REQUIRE(program.run("1f") == 0x1f);
+}
+
 TEST_CASE("Character Program") {
   auto program = presets::createCharacterProgram();
   REQUIRE(program.run("a") == 'a');
@@ -58,6 +76,20 @@ TEST_CASE("String Program") {
   REQUIRE(program.run(open + "Hello World!" + close) == "Hello World!");
   REQUIRE(program.run(open + "Hello\\nEscaped \\" + close + "!" + close)
           == "Hello\nEscaped " + close + "!");
+  REQUIRE(program.run(open + "\\41\\x" + close) == "Ax");
+}
+
+TEST_CASE("String View Program") {
+  auto program = presets::createStringViewProgram("'", "'");
+  std::string buffer;
+  std::string input = "'Hello World!'";
+  auto result = program.run(input, buffer);
+  REQUIRE(result == "Hello World!");
+  REQUIRE(result.data() == input.data() + 1);
+  REQUIRE(buffer.empty());
+  REQUIRE(program.run("'Hello\\nEscaped \\'!'", buffer) == "Hello\nEscaped '!");
+  REQUIRE(program.run("'\\\\\\0'", buffer) == std::string("\\\0", 2));
+  REQUIRE_THROWS(program.run("'unterminated", buffer));
 }
 
 TEST_CASE("PEG Parser") {
@@ -94,6 +126,41 @@ TEST_CASE("PEG Parser") {
   REQUIRE_THROWS(parser.run("42", rc));
 }
 
+TEST_CASE("Shared PEG Program") {
+  REQUIRE(&presets::getPEGProgram() == &presets::getPEGProgram());
+
+  auto rc = [](std::string_view name) {
+    return grammar::Node::Rule(grammar::makeRule(name, grammar::Node::Empty()));
+  };
+  presets::clearPEGExpressionCache();
+  auto first = presets::parsePEGExpression("a ('b' | c)*", rc);
+  auto second = presets::parsePEGExpression("a ('b' | c)*", rc);
+  REQUIRE(first != second);
+  REQUIRE(stream_to_string(*first) == "(a ('b' | c)*)");
+  REQUIRE(stream_to_string(*second) == stream_to_string(*first));
+  REQUIRE_THROWS_AS(presets::parsePEGExpression("a | ", rc), SyntaxError);
+  REQUIRE_THROWS_AS(presets::parsePEGExpression("a | ", rc), SyntaxError);
+
+  SECTION("exceeded limits are not cached") {
+    auto nested = std::string(4000, '(') + "'a'" + std::string(4000, ')');
+    REQUIRE_THROWS_AS(presets::parsePEGExpression(nested, rc), Parser::LimitError);
+    REQUIRE_THROWS_AS(presets::parsePEGExpression(nested, rc), Parser::LimitError);
+  }
+
+  SECTION("cached text outlives the argument") {
+    auto text = std::make_unique<std::string>("'x' d");
+    presets::parsePEGExpression(*text, rc);
+    text.reset();
+    REQUIRE(stream_to_string(*presets::parsePEGExpression("'x' d", rc)) == "('x' d)");
+  }
+
+  ParserGenerator<int> a, b;
+  a.setStart(a.setRule("A", "'a'+", [](auto e) { return int(e.length()); }));
+  b.setStart(b.setRule("A", "'a'+", [](auto e) { return -int(e.length()); }));
+  REQUIRE(a.run("aaa") == 3);
+  REQUIRE(b.run("aa") == -2);
+}
+
 TEST_CASE("Program with return value") {
   ParserGenerator<int> program;
   REQUIRE_THROWS_AS(program.run("aa"), SyntaxError);
@@ -109,6 +176,367 @@ TEST_CASE("Program with return value") {
   REQUIRE(count == 3);
 }
 
+TEST_CASE("Syntax errors") {
+  ParserGenerator<int> program;
+  program.setSeparator(program["Whitespace"] << "[\t ]");
+  program["Number"] << "[0-9]+";
+  program["Atomic"] << "Number | '(' Sum ')'";
+  program["Sum"] << "Sum '+' Atomic | Atomic";
+  program.setStart(program["Sum"]);
+
+  auto parsed = program.parser.parseAndGetError("1 + 2");
+  REQUIRE(parsed.syntax->valid);
+  REQUIRE(parsed.expected.empty());
+
+  parsed = program.parser.parseAndGetError("1 + ");
+  REQUIRE(parsed.syntax->end == 2);
+  REQUIRE(parsed.error->end == 4);
+  REQUIRE(parsed.expected == std::vector<std::string>{"Atomic"});
+
+  parsed = program.parser.parseAndGetError("(1 + 2");
+  REQUIRE(parsed.error->end == 6);
+  REQUIRE(parsed.expected == std::vector<std::string>{"[0-9]", "'+'", "')'"});
+
+  parsed = program.parser.parseAndGetError("1 2");
+  REQUIRE(parsed.syntax->valid);
+  REQUIRE(parsed.error->end == 2);
+  REQUIRE(parsed.expected == std::vector<std::string>{"'+'", "end of input"});
+
+  REQUIRE_THROWS_WITH(program.run("1 + +"),
+                      "syntax error at character 5 while parsing Sum, expected Atomic");
+  REQUIRE_THROWS_WITH(program.run("(1"), "syntax error at character 3 while parsing Number, "
+                                         "expected one of [0-9], '+', ')'");
+}
+
+TEST_CASE("Error recovery") {
+  ParserGenerator<int> program;
+  program.setSeparator(program["Whitespace"] << "[\t ]");
+  program["Number"] << "[0-9]+";
+  program["Sum"] << "Sum '+' Number | Number";
+  program["Line"] << "Sum '\n'";
+  program.setRecovery("Line", "'\n'");
+  program.setStart(program["Lines"] << "Line*");
+
+  auto parsed = program.parser.parseWithRecovery("1 + 2\n3 +\n+\n4\n");
+  REQUIRE(parsed.syntax->valid);
+  REQUIRE(parsed.syntax->end == parsed.syntax->fullString.size());
+  REQUIRE(parsed.syntax->inner.size() == 2);
+  REQUIRE(parsed.syntax->inner[0]->view() == "1 + 2\n");
+  REQUIRE(parsed.syntax->inner[1]->view() == "4\n");
+  REQUIRE(parsed.errors.size() == 2);
+  REQUIRE(parsed.errors[0].syntax->end == 9);
+  REQUIRE(parsed.errors[0].expected == std::vector<std::string>{"Number"});
+  REQUIRE(parsed.errors[1].syntax->end == 10);
+  REQUIRE(parsed.errors[1].expected == std::vector<std::string>{"Sum"});
+
+  parsed = program.parser.parseWithRecovery("1\n2 +");
+  REQUIRE(parsed.syntax->inner.size() == 1);
+  REQUIRE(parsed.errors.size() == 1);
+  REQUIRE(parsed.errors[0].syntax->end == 5);
+
+  parsed = program.parser.parseWithRecovery("1\n2\n");
+  REQUIRE(parsed.syntax->inner.size() == 2);
+  REQUIRE(parsed.errors.empty());
+
+  REQUIRE_THROWS_AS(program.run("1\n+\n"), SyntaxError);
+  program.load(program.save());
+  REQUIRE(program.parser.parseWithRecovery("+\n1\n").errors.size() == 1);
+}
+
+TEST_CASE("Recognize") {
+  ParserGenerator<int> program;
+  program.setSeparator(program["Whitespace"] << "[\t ]");
+  program["Number"] << "[0-9]+";
+  program["Atomic"] << "Number | '(' Sum ')'";
+  program["Product"] << "Product '*' Atomic | Atomic";
+  program["Sum"] << "Sum '+' Product | Sum '-' Product | Product";
+  program.setStart(program["Sum"]);
+
+  for (auto input : {"1", "1 + 2 * 3", "(1 + 2) * 3 - 4", "1 * (2 + 3 * (4 - 5)) + 6", "1 +",
+                     "(1 + 2", "", "1 2", "* 1"}) {
+    auto tree = program.parser.parse(input);
+    auto match = program.parser.recognize(input);
+    REQUIRE(match.valid == tree->valid);
+    if (match.valid) {
+      REQUIRE(match.end == tree->end);
+    }
+  }
+
+  SECTION("filters") {
+    ParserGenerator<> filtered;
+    filtered.setStart(filtered.setFilteredRule("Even", "[0-9]+", [](auto &tree) {
+      return tree->view().back() % 2 == 0;
+    }));
+    REQUIRE(filtered.parser.recognize("12").valid);
+    REQUIRE(!filtered.parser.recognize("13").valid);
+  }
+
+  SECTION("captures") {
+    auto captures = program.parser.createCaptures({program.getRule("Number")});
+    REQUIRE(captures.trees.count(program.getRule("Sum").get()));
+    REQUIRE(!captures.trees.count(program.getRule("Whitespace").get()));
+    auto tree = program.parser.parse("(1 + 2) * 3 - 4", captures);
+    REQUIRE(tree->valid);
+    REQUIRE(tree->rule->name == "Sum");
+    REQUIRE(tree->inner.size() == 4);
+    for (auto &inner : tree->inner) {
+      REQUIRE(inner->rule->name == "Number");
+    }
+    REQUIRE(tree->inner[2]->view() == "3");
+
+    captures = program.parser.createCaptures({program.getRule("Atomic")});
+    tree = program.parser.parse("(1 + 2) * 3", captures);
+    REQUIRE(tree->inner.size() == 2);
+    REQUIRE(tree->inner[0]->view() == "(1 + 2)");
+    REQUIRE(tree->inner[0]->inner.size() == 2);
+  }
+}
+
+namespace {
+  /** Reconstructs the output of `operator<<(std::ostream &, const SyntaxTree &)` from events */
+  struct TreePrinter : Parser::EventHandler {
+    std::string_view input;
+    std::vector<std::string> stack{""};
+    std::vector<size_t> children{0};
+
+    TreePrinter(std::string_view i) : input(i) {}
+
+    void enter(const grammar::Rule &rule, size_t) override {
+      stack.back() += children.back()++ > 0 ? ", " : "";
+      stack.push_back(rule.name + "(");
+      children.push_back(0);
+    }
+
+    void exit(const grammar::Rule &, size_t begin, size_t end) override {
+      auto tree = stack.back();
+      if (children.back() == 0) {
+        tree += "'" + std::string(input.substr(begin, end - begin)) + "'";
+      }
+      stack.pop_back();
+      children.pop_back();
+      stack.back() += tree + ")";
+    }
+  };
+}  // namespace
+
+TEST_CASE("Parse events") {
+  ParserGenerator<> program;
+  program.setSeparator(program["Whitespace"] << "[\t ]");
+  program["Number"] << "[0-9]+";
+  program["Atomic"] << "Number | '(' Sum ')'";
+  program["Product"] << "Product '*' Atomic | Atomic";
+  program["Sum"] << "Sum '+' Product | Product";
+  program["Assignment"] << "[a-z]+ '=' Sum";
+  program["Line"] << "(Assignment | Sum)? '\n'";
+  program.setStart(program["Lines"] << "Line*");
+
+  for (auto input : {"", "1\n", "1 + 2 * 3\n(4 + 5) * 6\n\na = 1\n", "1 + (2 * 3) + 4\n",
+                     "1 +\n", "1\n2", "1\n2\n(3"}) {
+    INFO(input);
+    TreePrinter printer(input);
+    auto match = program.parser.parse(input, printer);
+    auto tree = program.parser.parse(input);
+    REQUIRE(match.valid == tree->valid);
+    REQUIRE(match.end == tree->end);
+    REQUIRE(printer.stack.size() == 1);
+    REQUIRE(printer.stack[0] == stream_to_string(*tree));
+  }
+
+  SECTION("streaming") {
+    std::string input = "1\n2\n3\n4\n";
+    TreePrinter printer(input);
+    std::vector<size_t> committed;
+    program.setFilteredRule("Line", "Sum '\n'", [&](auto &) {
+      committed.push_back(printer.children[0] > 0 ? printer.children[1] : 0);
+      return true;
+    });
+    REQUIRE(program.parser.parse(input, printer).valid);
+    REQUIRE(committed == std::vector<size_t>{0, 1, 2, 3});
+  }
+
+  SECTION("left recursive start") {
+    program.setStart(program["Sum"]);
+    std::string input = "1 + 2 * (3 + 4) + 5";
+    TreePrinter printer(input);
+    REQUIRE(program.parser.parse(input, printer).valid);
+    REQUIRE(printer.stack[0] == stream_to_string(*program.parser.parse(input)));
+  }
+}
+
+TEST_CASE("Nesting limits") {
+  ParserGenerator<size_t> program;
+  program["Nested"] << "'(' Nested ')' | 'x'" >> [](auto e) {
+    return e.size() > 0 ? e[0].evaluate() + 1 : 0;
+  };
+  program.setStart(program["Nested"]);
+  auto nested = [](size_t depth) {
+    return std::string(depth, '(') + "x" + std::string(depth, ')');
+  };
+
+  REQUIRE(program.run(nested(100)) == 100);
+  REQUIRE_THROWS_AS(program.parser.parse(nested(100000)), Parser::LimitError);
+  REQUIRE_THROWS_AS(program.parser.recognize(nested(100000)), Parser::LimitError);
+  REQUIRE_THROWS_AS(program.run(nested(100000)), Parser::LimitError);
+
+  program.parser.limits.depth = 100;
+  REQUIRE_NOTHROW(program.parser.parse(nested(99)));
+  REQUIRE_THROWS_AS(program.parser.parse(nested(100)), Parser::LimitError);
+
+  program.parser.limits.depth = 1000000;
+  auto tree = program.parser.parse(nested(100000));
+  REQUIRE(tree->valid);
+  REQUIRE(tree->end == 200001);
+  REQUIRE(program.parser.recognize(nested(100000)).valid);
+}
+
+TEST_CASE("Parse limits") {
+  ParserGenerator<> program;
+  program.setSeparator(program["Whitespace"] << "[\t ]");
+  program["Number"] << "[0-9]+";
+  program["Sum"] << "Sum '+' Number | Number";
+  program.setStart(program["Sum"]);
+  std::string input = "0";
+  for (int i = 1; i < 1000; ++i) {
+    input += " + " + std::to_string(i);
+  }
+
+  auto &limits = program.parser.limits;
+  auto exceededLimit = [&]() -> std::optional<Parser::LimitError::Type> {
+    try {
+      program.parser.parse(input);
+      program.parser.recognize(input);
+    } catch (const Parser::LimitError &error) {
+      return error.type;
+    }
+    return std::nullopt;
+  };
+
+  limits.steps = limits.syntaxTrees = limits.cacheEntries = limits.memory = 1000000000;
+  limits.time = std::chrono::hours(1);
+  REQUIRE(!exceededLimit());
+
+  SECTION("steps") {
+    limits.steps = 1000;
+    REQUIRE(exceededLimit() == Parser::LimitError::STEPS);
+  }
+
+  SECTION("syntax trees") {
+    limits.syntaxTrees = 1000;
+    REQUIRE(exceededLimit() == Parser::LimitError::SYNTAX_TREES);
+  }
+
+  SECTION("cache entries") {
+    limits.cacheEntries = 1000;
+    REQUIRE(exceededLimit() == Parser::LimitError::CACHE_ENTRIES);
+  }
+
+  SECTION("memory") {
+    limits.memory = 100000;
+    REQUIRE(exceededLimit() == Parser::LimitError::MEMORY);
+  }
+
+  SECTION("time") {
+    limits.time = std::chrono::steady_clock::duration::zero();
+    REQUIRE(exceededLimit() == Parser::LimitError::TIME);
+  }
+
+  SECTION("error message") {
+    limits.steps = 10;
+    REQUIRE_THROWS_WITH(program.run(input), "parse limit exceeded: more than 10 steps");
+  }
+}
+
+TEST_CASE("Parse context") {
+  ParserGenerator<int> program;
+  program.setSeparator(program["Whitespace"] << "[\t ]");
+  program["Number"] << "[0-9]+" >> [](auto e) { return e.template number<int>(); };
+  program["Sum"] << "Sum '+' Number | Number"
+      >> [](auto e) { return e.size() == 1 ? e[0].evaluate() : e[0].evaluate() + e[1].evaluate(); };
+  program.setStart(program["Sum"]);
+  Parser::Context context;
+
+  for (int i = 0; i < 3; ++i) {
+    REQUIRE(program.run("1 + 2 + 3", context) == 6);
+    REQUIRE(program.run("4", context) == 4);
+    REQUIRE(program.parser.parse("1 + 2", context)->end == 5);
+    REQUIRE(program.parser.parse("1 +", context)->end == program.parser.parse("1 +")->end);
+    auto result = program.parser.parseAndGetError("1 + + 2", context);
+    REQUIRE(result.error->begin == program.parser.parseAndGetError("1 + + 2").error->begin);
+    REQUIRE_THROWS_AS(program.run("1 + a", context), SyntaxError);
+  }
+
+  SECTION("reuse after exceeding a limit") {
+    program.parser.limits.steps = 10;
+    REQUIRE_THROWS_AS(program.run("1 + 2 + 3 + 4", context), Parser::LimitError);
+    program.parser.limits = ParseLimits();
+    REQUIRE(program.run("1 + 2 + 3 + 4", context) == 10);
+  }
+
+  SECTION("simultaneous use") {
+    ParserGenerator<> outer;
+    outer.setStart(outer.setFilteredRule("Inner", "[0-9]+", [&](auto &tree) {
+      return program.run(tree->view(), context) > 0;
+    }));
+    REQUIRE(outer.parser.parse("5")->valid);
+    REQUIRE_THROWS_AS(outer.parser.parse("5", context), std::logic_error);
+    REQUIRE(program.run("1 + 1", context) == 2);
+  }
+}
+
+TEST_CASE("Resumable parsing") {
+  ParserGenerator<float> calculator;
+  calculator.setSeparator(calculator["Whitespace"] << "[\t ]");
+  calculator.setStart(calculator["Sum"] << "Add | Product");
+  calculator["Add"] << "Sum '+' Product" >>
+      [](auto e) { return e[0].evaluate() + e[1].evaluate(); };
+  calculator["Product"] << "Multiply | Atomic";
+  calculator["Multiply"] << "Product '*' Atomic" >>
+      [](auto e) { return e[0].evaluate() * e[1].evaluate(); };
+  calculator["Atomic"] << "Number | '(' Sum ')'";
+  calculator["Number"] << "[0-9]+" >> [](auto e) { return e.template number<float>(); };
+
+  SECTION("interleaved") {
+    std::string longInput = "1", shortInput = "2 * 3";
+    for (int i = 0; i < 100; ++i) {
+      longInput += " + (1 * 2)";
+    }
+    auto longParse = calculator.start(longInput);
+    auto shortParse = calculator.start(shortInput);
+    size_t slices = 0;
+    while (!shortParse.resume(10)) {
+      REQUIRE(!longParse.resume(10));
+      ++slices;
+    }
+    REQUIRE(slices > 1);
+    REQUIRE(calculator.run(shortParse) == 6);
+    while (!longParse.resume(10)) {
+    }
+    REQUIRE(longParse.finished());
+    REQUIRE(calculator.run(longParse) == 201);
+  }
+
+  SECTION("errors") {
+    std::string input = "1 + 2 * (3 + 4";
+    auto parse = calculator.start(input);
+    REQUIRE_THROWS_AS(parse.result(), std::logic_error);
+    while (!parse.resume(5)) {
+    }
+    auto expected = calculator.parser.parseAndGetError(input);
+    REQUIRE(parse.result().error->end == expected.error->end);
+    REQUIRE(parse.result().expected == expected.expected);
+    REQUIRE_THROWS_AS(calculator.run(parse), SyntaxError);
+  }
+
+  SECTION("limits") {
+    calculator.parser.limits.steps = 20;
+    auto parse = calculator.start("1 + 2 + 3 + 4 + 5");
+    REQUIRE(!parse.resume(10));
+    REQUIRE_THROWS_AS(parse.resume(100), Parser::LimitError);
+    REQUIRE(parse.finished());
+    REQUIRE_THROWS_AS(parse.result(), std::logic_error);
+  }
+}
+
 TEST_CASE("Program with argument") {
   ParserGenerator<void, int &> program;
   int count = 0;
@@ -155,6 +583,93 @@ TEST_CASE("Evaluation") {
   REQUIRE(calculator.run("  1 + 2*3*1 +4 * 5  ") == 27);
   REQUIRE_THROWS(calculator.run("1+2*"));
 }
+
+TEST_CASE("Pure rules") {
+  ParserGenerator<int> program;
+  size_t evaluations = 0;
+  // evaluates the nested term twice, which takes exponential time unless memoized
+  program.setStart(program.setRule("Term", "'(' Term ')' | 'x'", [&](auto e) {
+    ++evaluations;
+    return e.size() == 0 ? 1 : e[0].evaluate() + e[0].evaluate();
+  }));
+  std::string input = std::string(20, '(') + "x" + std::string(20, ')');
+  REQUIRE(program.run(input) == 1 << 20);
+  REQUIRE(evaluations == (1 << 21) - 1);
+
+  evaluations = 0;
+  program.setPure("Term");
+  REQUIRE(program.run(input) == 1 << 20);
+  REQUIRE(evaluations == 21);
+
+  SECTION("once per evaluation") {
+    evaluations = 0;
+    REQUIRE(program.run(input) == 1 << 20);
+    REQUIRE(evaluations == 21);
+  }
+
+  SECTION("unset") {
+    evaluations = 0;
+    program.setPure("Term", false);
+    REQUIRE(program.run("((x))") == 4);
+    REQUIRE(evaluations == 7);
+  }
+}
+
+TEST_CASE("Move-only results") {
+  ParserGenerator<std::unique_ptr<int>> program;
+  program.setStart(program["Sum"] << "Number ('+' Number)*" >> [](auto e) {
+    auto sum = std::make_unique<int>(0);
+    for (auto n : e) {
+      *sum += *n.evaluate();
+    }
+    return sum;
+  });
+  program["Number"] << "[0-9]+"
+                    >> [](auto e) { return std::make_unique<int>(e.template number<int>()); };
+  REQUIRE(*program.run("1+2+3") == 6);
+}
+
+TEST_CASE("Parallel evaluation") {
+  ParserGenerator<long> program;
+  program.setSeparator(program["Whitespace"] << "[\t ]");
+  program.setStart(program["List"] << "Item (',' Item)*");
+  program["Item"] << "Sum | '[' List ']'";
+  program["Sum"] << "[0-9]+" >> [](auto e) {
+    long sum = 0;
+    for (long i = 0; i <= e.template number<long>(); ++i) {
+      sum += i;
+    }
+    return sum;
+  };
+  program.setEvaluator("List", [](auto e) {
+    long sum = 0;
+    for (auto item : e) {
+      sum += item.evaluate();
+    }
+    return sum;
+  });
+
+  std::string input = "[1, 2, [3, 4]], 5";
+  for (int i = 0; i < 200; ++i) {
+    input += ", [" + std::to_string(i) + ", [" + std::to_string(i * 3) + ", 7]]";
+  }
+  auto expected = program.run(input);
+  program.setPure("Item");
+  program.setPure("Sum");
+  program.setParallel("List");
+  program.interpreter.minParallelLength = 4;
+  REQUIRE(program.run(input) == expected);
+
+  SECTION("errors") {
+    program.setEvaluator("Sum", [](auto e) -> long {
+      if (e.view() == "7") {
+        throw std::domain_error("seven");
+      }
+      return 1;
+    });
+    REQUIRE_THROWS_WITH(program.run(input), "seven");
+  }
+}
 #include <iostream>
 TEST_CASE("Left recursion") {
   ParserGenerator<float> calculator;
@@ -187,6 +702,68 @@ TEST_CASE("Left recursion") {
   REQUIRE_THROWS(calculator.run("1+2*"));
 }
 
+TEST_CASE("Operator precedence") {
+  ParserGenerator<float> calculator;
+  calculator.setSeparatorRule("Whitespace", "[\t ]");
+  calculator.setRule("Atomic", "Number | '(' Expression ')'");
+  calculator.setProgramRule("Number", presets::createFloatProgram());
+  calculator["Add"] >> [](auto e) { return e[0].evaluate() + e[1].evaluate(); };
+  calculator["Subtract"] >> [](auto e) { return e[0].evaluate() - e[1].evaluate(); };
+  calculator["Multiply"] >> [](auto e) { return e[0].evaluate() * e[1].evaluate(); };
+  calculator["Power"] >> [](auto e) { return std::pow(e[0].evaluate(), e[1].evaluate()); };
+
+  SECTION("PEG syntax") {
+    calculator.setStart(calculator.setRule(
+        "Expression",
+        "{Atomic; left: Add '+', Subtract '-'; left: Multiply '*'; right: Power '^'}"));
+    REQUIRE(stream_to_string(*calculator.getRule("Expression")->node)
+            == "{(Whitespace* Atomic Whitespace*); left: Add '+', Subtract '-'; left: Multiply "
+               "'*'; right: Power '^'}");
+  }
+
+  SECTION("operator table") {
+    calculator.setStart(calculator.setPrecedenceRule("Expression", "Atomic"));
+    calculator.addOperator("Expression", "Add", "'+'", 1);
+    calculator.addOperator("Expression", "Subtract", "'-'", 1);
+    calculator.addOperator("Expression", "Multiply", "'*'", 2);
+    calculator.addOperator("Expression", "Power", "'^'", 3, true);
+    REQUIRE_THROWS_AS(calculator.addOperator("Atomic", "Add", "'+'", 1), std::invalid_argument);
+  }
+
+  REQUIRE(calculator.run("42") == 42);
+  REQUIRE(calculator.run("1 + 2 * 3") == 7);
+  REQUIRE(calculator.run("2 * 3 + 1") == 7);
+  REQUIRE(calculator.run("1 - 2 - 3") == -4);
+  REQUIRE(calculator.run("2 ^ 3 ^ 2") == 512);
+  REQUIRE(calculator.run("2 * 2 ^ 2 + 1 - (1 - 2) * 3") == 12);
+  REQUIRE_THROWS_AS(calculator.run("1 + 2 *"), SyntaxError);
+  REQUIRE(calculator.parser.parse("1 + 2 *")->end == calculator.parser.parse("1 + 2 ")->end);
+  REQUIRE(calculator.parser.recognize("1 + 2 * 3").end == 9);
+
+  // operations are direct children of each other
+  auto tree = calculator.parse("1 - 2 * 3 - 4");
+  REQUIRE(tree->inner.size() == 1);
+  auto &outer = *tree->inner[0];
+  REQUIRE(outer.rule->name == "Subtract");
+  REQUIRE(outer.view() == "1 - 2 * 3 - 4");
+  REQUIRE(outer.inner[0]->rule->name == "Subtract");
+  REQUIRE(outer.inner[0]->inner[1]->rule->name == "Multiply");
+  REQUIRE(outer.inner[0]->inner[1]->view() == " 2 * 3 ");
+  REQUIRE(outer.inner[1]->rule->name == "Atomic");
+
+  auto captures = calculator.parser.createCaptures({calculator.getRule("Multiply")});
+  tree = calculator.parser.parse("1 - 2 * 3 - 4", captures);
+  REQUIRE(tree->inner.size() == 1);
+  REQUIRE(tree->inner[0]->rule->name == "Multiply");
+  REQUIRE(tree->inner[0]->inner.empty());
+
+  std::string input = "0";
+  for (int i = 1; i < 10000; ++i) {
+    input += i % 3 ? " + 1" : " * 1";
+  }
+  REQUIRE(calculator.run(input) == 6666);
+}
+
 TEST_CASE("Filter") {
   ParserGenerator<> program;
   program.setStart(program.setFilteredRule("B", "A+", [](auto tree) {
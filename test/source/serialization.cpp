@@ -0,0 +1,115 @@
+#include <peg_parser/generator.h>
+
+#include <catch2/catch.hpp>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+using namespace peg_parser;
+
+namespace {
+
+  void setCalculatorRules(ParserGenerator<float> &calculator) {
+    calculator.setSeparatorRule("Whitespace", "[\t ]");
+    calculator.setStart(calculator.setRule("Expression", "Sum | Atomic"));
+    calculator.setRule("Sum", "Add | Product");
+    calculator.setRule("Add", "Sum '+' Product");
+    calculator.setRule("Product", "Multiply | Atomic");
+    calculator.setRule("Multiply", "Product '*' Atomic");
+    calculator.setRule("Atomic", "Number | '(' Expression ')'");
+    calculator.setProgramRule("Number", presets::createFloatProgram());
+  }
+
+  void setCalculatorEvaluators(ParserGenerator<float> &calculator) {
+    calculator["Add"] >> [](auto e) { return e[0].evaluate() + e[1].evaluate(); };
+    calculator["Multiply"] >> [](auto e) { return e[0].evaluate() * e[1].evaluate(); };
+    calculator.setEvaluator("Number", [](auto e) { return e.template number<float>(); });
+  }
+
+}  // namespace
+
+TEST_CASE("Grammar serialization") {
+  ParserGenerator<float> original;
+  setCalculatorRules(original);
+  setCalculatorEvaluators(original);
+  auto data = original.save();
+  REQUIRE(data.substr(0, 4) == "PEGG");
+
+  SECTION("load into a new generator") {
+    ParserGenerator<float> loaded;
+    setCalculatorEvaluators(loaded);
+    loaded.load(data);
+    REQUIRE(loaded.run("42") == Approx(42));
+    REQUIRE(loaded.run("1 + 2 * (3 + 4)") == Approx(15));
+    REQUIRE(loaded.run(" 2*3*4 + 1 ") == Approx(25));
+    REQUIRE_THROWS_AS(loaded.run("1 +"), SyntaxError);
+    REQUIRE(loaded.save() == data);
+  }
+
+  SECTION("evaluators set after loading") {
+    ParserGenerator<float> loaded;
+    loaded.load(data);
+    setCalculatorEvaluators(loaded);
+    REQUIRE(loaded.run("1 + 2 * 3") == Approx(7));
+  }
+
+  SECTION("load from file") {
+    auto path = "peg_parser_serialization_test.bin";
+    std::ofstream(path, std::ios::binary) << data;
+    ParserGenerator<float> loaded;
+    setCalculatorEvaluators(loaded);
+    loaded.loadFile(path);
+    std::remove(path);
+    REQUIRE(loaded.run("2 * (1 + 1)") == Approx(4));
+  }
+
+  SECTION("load after optimizing") {
+    ParserGenerator<> loaded;
+    loaded.setStart(loaded.setRule("Start", "'a'+"));
+    loaded.optimize();
+    REQUIRE(loaded.parser.parse("aaa")->valid);
+    ParserGenerator<> other;
+    other.setStart(other.setRule("Start", "'b'+"));
+    loaded.load(other.save());
+    REQUIRE(!loaded.parser.parse("aaa")->valid);
+    REQUIRE(loaded.parser.parse("bbb")->valid);
+  }
+
+  SECTION("invalid data") {
+    ParserGenerator<float> loaded;
+    REQUIRE_THROWS_AS(loaded.load("nope"), serialization::SerializationError);
+    REQUIRE_THROWS_AS(loaded.load(data.substr(0, data.size() / 2)),
+                      serialization::SerializationError);
+    REQUIRE_THROWS_AS(loaded.loadFile("/does/not/exist"), serialization::SerializationError);
+  }
+}
+
+TEST_CASE("Grammar serialization of presets") {
+  auto program = presets::createPEGProgram();
+  serialization::Grammar grammar;
+  grammar.start = program.parser.grammar;
+  auto loaded = serialization::load(serialization::save(grammar));
+  REQUIRE(loaded.rules.empty());
+  REQUIRE(loaded.start->name == "FullExpression");
+  REQUIRE(Parser::parse("a | 'b'* [c-d]", loaded.start)->valid);
+  REQUIRE(!Parser::parse("a | ", loaded.start)->valid);
+
+  ParserGenerator<float> precedence;
+  precedence.setStart(precedence.setRule("Sum", "{Digit; left: Add '+'; right: Power '^'}"));
+  precedence.setRule("Digit", "[0-9]");
+  precedence.setEvaluator("Digit", [](auto e) { return e.template number<float>(); });
+  precedence["Add"] >> [](auto e) { return e[0].evaluate() + e[1].evaluate(); };
+  precedence["Power"] >> [](auto e) { return std::pow(e[0].evaluate(), e[1].evaluate()); };
+  ParserGenerator<float> loadedPrecedence;
+  loadedPrecedence["Add"] >> [](auto e) { return e[0].evaluate() + e[1].evaluate(); };
+  loadedPrecedence["Power"] >> [](auto e) { return std::pow(e[0].evaluate(), e[1].evaluate()); };
+  loadedPrecedence.setEvaluator("Digit", [](auto e) { return e.template number<float>(); });
+  loadedPrecedence.load(precedence.save());
+  REQUIRE(loadedPrecedence.run("1+2^3^2+5") == Approx(518));
+  REQUIRE(loadedPrecedence.save() == precedence.save());
+
+  ParserGenerator<> filtered;
+  filtered.setStart(filtered.setFilteredRule("A", ".", [](auto) { return true; }));
+  REQUIRE_THROWS_AS(filtered.save(), serialization::SerializationError);
+}
@@ -0,0 +1,169 @@
+#include <peg_parser/generator.h>
+#include <peg_parser/static_grammar.h>
+
+#include <catch2/catch.hpp>
+#include <sstream>
+
+using namespace peg_parser::static_grammar;
+
+namespace {
+
+  template <class T> std::string streamToString(const T &obj) {
+    std::stringstream stream;
+    stream << obj;
+    return stream.str();
+  }
+
+  namespace calculator {
+
+    struct Whitespace : Rule<Whitespace, Choice<Char<' '>, Char<'\t'>>> {
+      static constexpr auto name = "Whitespace";
+      static constexpr bool hidden = true;
+    };
+
+    /** Mirrors the separator inserted around rule references by `ParserGenerator` */
+    template <class R> using Token
+        = Sequence<ZeroOrMore<Ref<Whitespace>>, Ref<R>, ZeroOrMore<Ref<Whitespace>>>;
+
+    struct Sum;
+    struct Product;
+    struct Atomic;
+
+    struct Number
+        : Rule<Number, Sequence<Optional<Char<'-'>>, OneOrMore<Range<'0', '9'>>,
+                                Optional<Sequence<Char<'.'>, OneOrMore<Range<'0', '9'>>>>>> {
+      static constexpr auto name = "Number";
+    };
+
+    struct Add : Rule<Add, Sequence<Token<Sum>, Char<'+'>, Token<Product>>> {
+      static constexpr auto name = "Add";
+    };
+
+    struct Subtract : Rule<Subtract, Sequence<Token<Sum>, Char<'-'>, Token<Product>>> {
+      static constexpr auto name = "Subtract";
+    };
+
+    struct Multiply : Rule<Multiply, Sequence<Token<Product>, Char<'*'>, Token<Atomic>>> {
+      static constexpr auto name = "Multiply";
+    };
+
+    struct Divide : Rule<Divide, Sequence<Token<Product>, Char<'/'>, Token<Atomic>>> {
+      static constexpr auto name = "Divide";
+    };
+
+    struct Atomic
+        : Rule<Atomic, Choice<Token<Number>, Sequence<Char<'('>, Token<Sum>, Char<')'>>>> {
+      static constexpr auto name = "Atomic";
+    };
+
+    struct Product : Rule<Product, Choice<Token<Multiply>, Token<Divide>, Token<Atomic>>> {
+      static constexpr auto name = "Product";
+      static constexpr bool leftRecursive = true;
+    };
+
+    struct Sum : Rule<Sum, Choice<Token<Add>, Token<Subtract>, Token<Product>>> {
+      static constexpr auto name = "Sum";
+      static constexpr bool leftRecursive = true;
+    };
+
+    void setRules(peg_parser::ParserGenerator<float> &g) {
+      g.setSeparator(g["Whitespace"] << "[\t ]");
+      g["Sum"] << "Add | Subtract | Product";
+      g["Product"] << "Multiply | Divide | Atomic";
+      g["Atomic"] << "Number | '(' Sum ')'";
+      g["Add"] << "Sum '+' Product";
+      g["Subtract"] << "Sum '-' Product";
+      g["Multiply"] << "Product '*' Atomic";
+      g["Divide"] << "Product '/' Atomic";
+      g["Number"] << "'-'? [0-9]+ ('.' [0-9]+)?";
+      g.setStart(g["Sum"]);
+    }
+
+  }  // namespace calculator
+
+  /** Backtracks over the whole nested input at every level unless results are memoized */
+  template <bool Cacheable> struct Nested
+      : Rule<Nested<Cacheable>,
+             Choice<Sequence<Char<'('>, Ref<Nested<Cacheable>>, Char<')'>, Char<'!'>>,
+                    Sequence<Char<'('>, Ref<Nested<Cacheable>>, Char<')'>>, Char<'x'>>> {
+    static constexpr auto name = "Nested";
+    static constexpr bool cacheable = Cacheable;
+  };
+
+}  // namespace
+
+TEST_CASE("Static grammar") {
+  using namespace calculator;
+
+  SECTION("matching") {
+    REQUIRE(parse<Number>("42").syntax->valid);
+    REQUIRE(parse<Number>("-4.2").syntax->end == 4);
+    REQUIRE(!parse<Number>("-").syntax->valid);
+    REQUIRE(parse<Sum>("1+2").syntax->end == 3);
+    REQUIRE(parse<Sum>("1+2+").syntax->end == 3);
+    REQUIRE(!parse<Sum>("(1+2").syntax->valid);
+  }
+
+  SECTION("same syntax tree as the parser generator") {
+    peg_parser::ParserGenerator<float> g;
+    setRules(g);
+
+    for (auto input : {"42", "1 + 2 * (3+4)/2 - 3", " 1 - 2*3/2 + 4", "((1))*-2.5"}) {
+      auto expected = g.parse(input);
+      auto actual = parse<Sum>(input).syntax;
+      REQUIRE(actual->valid == expected->valid);
+      REQUIRE(actual->end == expected->end);
+      REQUIRE(streamToString(*actual) == streamToString(*expected));
+    }
+  }
+
+  SECTION("evaluation") {
+    Program<Sum, float> program;
+    program.setEvaluator<Add>([](auto e) { return e[0].evaluate() + e[1].evaluate(); });
+    program.setEvaluator<Subtract>([](auto e) { return e[0].evaluate() - e[1].evaluate(); });
+    program.setEvaluator<Multiply>([](auto e) { return e[0].evaluate() * e[1].evaluate(); });
+    program.setEvaluator<Divide>([](auto e) { return e[0].evaluate() / e[1].evaluate(); });
+    program.setEvaluator<Number>([](auto e) { return e.template number<float>(); });
+
+    REQUIRE(program.run("42") == Approx(42));
+    REQUIRE(program.run("1+2-3") == Approx(0));
+    REQUIRE(program.run("2*2/4*3") == Approx(3));
+    REQUIRE(program.run("1 + 2 * (3+4)/ 2 - 3") == Approx(5));
+    REQUIRE_THROWS_AS(program.run("1 + 2 *"), peg_parser::SyntaxError);
+    REQUIRE_THROWS_WITH(program.run("(1 + 2"),
+                        Catch::Matchers::StartsWith("syntax error at character 7"));
+    REQUIRE_THROWS_WITH(program.run("1 + 2 *"), Catch::Matchers::EndsWith("expected Atomic"));
+  }
+
+  SECTION("same errors as the parser generator") {
+    peg_parser::ParserGenerator<float> g;
+    setRules(g);
+
+    for (auto input : {"1 + ", "(1 + 2", "1 2", "*", "", "2 * (3 -", "4 +- 2"}) {
+      auto expected = g.parser.parseAndGetError(input);
+      auto actual = parse<Sum>(input);
+      REQUIRE(actual.error->end == expected.error->end);
+      REQUIRE(actual.error->rule->name == expected.error->rule->name);
+      REQUIRE(actual.expected == expected.expected);
+    }
+  }
+
+  SECTION("nesting limit") {
+    auto nested = std::string(100000, '(') + "1" + std::string(100000, ')');
+    REQUIRE_THROWS_AS(parse<Sum>(nested), peg_parser::Parser::LimitError);
+    peg_parser::ParseLimits limits;
+    limits.depth = 20;
+    REQUIRE(parse<Sum>("((1))", limits).syntax->valid);
+    REQUIRE_THROWS_AS(parse<Sum>("((((((((((1))))))))))", limits), peg_parser::Parser::LimitError);
+  }
+}
+
+TEST_CASE("Static grammar memoization") {
+  auto nested = [](size_t depth) {
+    return std::string(depth, '(') + "x" + std::string(depth, ')');
+  };
+  REQUIRE(parse<Nested<true>>(nested(200)).syntax->end == 401);
+  REQUIRE(parse<Nested<false>>(nested(8)).syntax->end == 17);
+  REQUIRE(streamToString(*parse<Nested<true>>(nested(2)).syntax)
+          == streamToString(*parse<Nested<false>>(nested(2)).syntax));
+}
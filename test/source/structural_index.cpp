@@ -0,0 +1,74 @@
+#include <peg_parser/generator.h>
+#include <peg_parser/structural_index.h>
+
+#include <catch2/catch.hpp>
+#include <random>
+
+using namespace peg_parser;
+
+TEST_CASE("Structural index") {
+  SECTION("positions") {
+    std::mt19937 random(7);
+    std::string alphabet = "ab()=\n";
+    // covers full blocks as well as the remaining bytes of each length
+    for (size_t length = 0; length < 70; ++length) {
+      std::string input;
+      for (size_t i = 0; i < length; ++i) {
+        input += alphabet[std::uniform_int_distribution<size_t>(0, alphabet.size() - 1)(random)];
+      }
+      std::vector<uint32_t> expected;
+      for (size_t i = 0; i < input.size(); ++i) {
+        if (input[i] == '(' || input[i] == ')' || input[i] == '\n') {
+          expected.push_back(uint32_t(i));
+        }
+      }
+      CAPTURE(input);
+      REQUIRE(StructuralIndex(input, "()\n").positions() == expected);
+    }
+    REQUIRE(StructuralIndex(std::string(40, '\xff') + "\x80", "\x80").positions()
+            == std::vector<uint32_t>{40});
+  }
+
+  SECTION("records") {
+    StructuralIndex index("a = 1\n\nb = (a + 1)\nb", "\n");
+    REQUIRE(index.split() == std::vector<std::string_view>{"a = 1", "", "b = (a + 1)", "b"});
+    REQUIRE(StructuralIndex("", "\n").split() == std::vector<std::string_view>{""});
+  }
+
+  SECTION("brackets") {
+    std::string input = "(1 + (2))\n(3 + 4))\n((5)\n6";
+    StructuralIndex index(input, "()\n");
+    REQUIRE(index.findUnbalanced('(', ')', 0, 9) == StructuralIndex::npos);
+    REQUIRE(index.findUnbalanced('(', ')', 10, 18) == 17);
+    REQUIRE(index.findUnbalanced('(', ')', 19, 23) == 19);
+    REQUIRE(index.findUnbalanced('(', ')', 24) == StructuralIndex::npos);
+    REQUIRE(index.findUnbalanced('(', ')') == 17);
+  }
+
+  SECTION("batches") {
+    ParserGenerator<float> calculator;
+    calculator.setSeparator(calculator["Whitespace"] << "[\t ]");
+    calculator.setStart(calculator["Sum"] << "Add | Atomic");
+    calculator["Add"] << "Sum '+' Atomic" >>
+        [](auto e) { return e[0].evaluate() + e[1].evaluate(); };
+    calculator["Atomic"] << "Number | Brackets";
+    calculator["Brackets"] << "'(' Sum ')'" >> [](auto e) { return e[0].evaluate(); };
+    calculator["Number"] << "[0-9]+" >> [](auto e) { return e.template number<float>(); };
+
+    std::string batch = "1 + 2\n(1 + (2 + 3)\n(4) + 5";
+    StructuralIndex index(batch, "()\n");
+    std::vector<float> results;
+    size_t unbalanced = 0;
+    for (auto record : index.split()) {
+      auto begin = size_t(record.data() - batch.data());
+      if (index.findUnbalanced('(', ')', begin, begin + record.size()) != StructuralIndex::npos) {
+        REQUIRE_THROWS_AS(calculator.run(record), SyntaxError);
+        ++unbalanced;
+      } else {
+        results.push_back(calculator.run(record));
+      }
+    }
+    REQUIRE(results == std::vector<float>{3, 9});
+    REQUIRE(unbalanced == 1);
+  }
+}
@@ -0,0 +1,62 @@
+#include <peg_parser/thread_pool.h>
+
+#include <atomic>
+#include <catch2/catch.hpp>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+using namespace peg_parser;
+
+namespace {
+
+  /** Adds a task for each recursive call, so that groups wait within tasks */
+  size_t fibonacci(ThreadPool &pool, size_t n) {
+    if (n < 2) {
+      return n;
+    }
+    size_t a = 0, b = 0;
+    ThreadPool::Group group(pool);
+    group.run([&]() { a = fibonacci(pool, n - 1); });
+    b = fibonacci(pool, n - 2);
+    group.wait();
+    return a + b;
+  }
+
+}  // namespace
+
+TEST_CASE("Thread pool") {
+  ThreadPool pool(3);
+  REQUIRE(pool.size() == 3);
+
+  SECTION("nested groups") {
+    REQUIRE(fibonacci(pool, 18) == 2584);
+  }
+
+  SECTION("tasks running on other threads") {
+    ThreadPool::Group group(pool);
+    std::atomic<bool> started{false}, finished{false};
+    group.run([&]() {
+      started = true;
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      finished = true;
+    });
+    while (!started) {
+      std::this_thread::yield();
+    }
+    group.wait();
+    REQUIRE(finished);
+  }
+
+  SECTION("errors") {
+    ThreadPool::Group group(pool);
+    size_t finished = 0;
+    group.run([]() { throw std::runtime_error("failed"); });
+    group.run([&]() { ++finished; });
+    REQUIRE_THROWS_WITH(group.wait(), "failed");
+    REQUIRE(finished == 1);
+    group.run([&]() { ++finished; });
+    REQUIRE_NOTHROW(group.wait());
+    REQUIRE(finished == 2);
+  }
+}